@@ -0,0 +1,719 @@
+/*
+ * Macro benchmark driver: bulk-loads generated data and runs YCSB core
+ * workloads A-F and a TPC-H style query set through ExecStmt in-process,
+ * then reports throughput and latency percentiles.
+ *
+ * Usage: my_db_macro_bench [--workload=a,b,c,d,e,f,tpch] [--records=N]
+ *        [--operations=N] [--distribution=zipfian|uniform] [--scale=SF]
+ *        [--runs=N] [--seed=N]
+ */
+#include "metadata.h"
+#include "metrics.h"
+#include "session.h"
+#include "storage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace mydb;
+using namespace hsql;
+
+/* YCSB defaults: ten 100 byte fields per record. */
+#define YCSB_FIELD_NUM 10
+#define YCSB_FIELD_LEN 100
+#define YCSB_MAX_SCAN_LEN 100
+#define ZIPFIAN_CONSTANT 0.99
+
+/* Rows per scale factor 1 in TPC-H. */
+#define TPCH_CUSTOMERS 150000
+#define TPCH_ORDERS 1500000
+
+struct Options {
+    Options()
+        : workloads("a,b,c,d,e,f,tpch"),
+          records(10000),
+          operations(10000),
+          zipfian(true),
+          scale(0.01),
+          runs(5),
+          seed(42) {}
+
+    std::string workloads;
+    int64_t records;
+    int64_t operations;
+    bool zipfian;
+    double scale;
+    int runs;
+    uint64_t seed;
+};
+
+/* Swallows the result sets and messages printed by the engine. */
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+static NullBuffer g_null_buffer;
+static std::streambuf* g_stdout_buffer = std::cout.rdbuf();
+
+static void Quiet(bool quiet) {
+    std::cout.rdbuf(quiet ? &g_null_buffer : g_stdout_buffer);
+}
+
+class Random {
+public:
+    explicit Random(uint64_t seed) : state_(seed * 0x9e3779b97f4a7c15ULL + 1) {}
+
+    uint64_t next() {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 7;
+        state_ ^= state_ << 17;
+        return state_;
+    }
+
+    /* Uniform in [0, n). */
+    int64_t uniform(int64_t n) { return static_cast<int64_t>(next() % static_cast<uint64_t>(n)); }
+
+    double unit() { return (next() >> 11) * (1.0 / (1ULL << 53)); }
+
+    std::string string(size_t len) {
+        std::string str(len, ' ');
+        for (auto& c : str) {
+            c = 'a' + next() % 26;
+        }
+        return str;
+    }
+
+private:
+    uint64_t state_;
+};
+
+/*
+ * Zipfian ranks in [0, items) following Gray et al., "Quickly Generating
+ * Billion-Record Synthetic Databases", as YCSB does. zeta(n) is extended
+ * incrementally when the item count grows.
+ */
+class Zipfian {
+public:
+    explicit Zipfian(int64_t items) : items_(0), zetan_(0) {
+        theta_ = ZIPFIAN_CONSTANT;
+        alpha_ = 1.0 / (1.0 - theta_);
+        zeta2_ = 1.0 + std::pow(0.5, theta_);
+        grow(items);
+    }
+
+    int64_t next(Random* rand, int64_t items) {
+        if (items != items_) {
+            grow(items);
+        }
+
+        double u = rand->unit();
+        double uz = u * zetan_;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < zeta2_) {
+            return 1;
+        }
+        int64_t rank = static_cast<int64_t>(items_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+        return std::min(rank, items_ - 1);
+    }
+
+private:
+    void grow(int64_t items) {
+        for (int64_t i = items_; i < items; i++) {
+            zetan_ += 1.0 / std::pow(static_cast<double>(i + 1), theta_);
+        }
+        items_ = items;
+        eta_ = (1 - std::pow(2.0 / items_, 1 - theta_)) / (1 - zeta2_ / zetan_);
+    }
+
+    int64_t items_;
+    double theta_;
+    double alpha_;
+    double zeta2_;
+    double zetan_;
+    double eta_;
+};
+
+/* Spread the hot zipfian ranks over the key space, like YCSB's scrambled zipfian. */
+static int64_t ScrambleKey(int64_t rank, int64_t items) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 8; i++) {
+        h = (h ^ ((rank >> (i * 8)) & 0xff)) * 0x100000001b3ULL;
+    }
+    return static_cast<int64_t>(h % static_cast<uint64_t>(items));
+}
+
+/* Latencies of one kind of operation, in nanoseconds. */
+struct OpStats {
+    explicit OpStats(const char* op_name) : name(op_name), errors(0) {}
+
+    void add(uint64_t nanos, bool failed) {
+        latencies.push_back(nanos);
+        if (failed) {
+            errors++;
+        }
+    }
+
+    const char* name;
+    std::vector<uint64_t> latencies;
+    uint64_t errors;
+};
+
+static double PercentileUs(std::vector<uint64_t>& sorted, double q) {
+    size_t pos = static_cast<size_t>(std::ceil(q * sorted.size()));
+    pos = std::min(std::max(pos, static_cast<size_t>(1)), sorted.size());
+    return sorted[pos - 1] / 1e3;
+}
+
+static void PrintReport(const std::string& title, std::vector<OpStats>& ops, uint64_t nanos) {
+    uint64_t total = 0;
+    for (auto& op : ops) {
+        total += op.latencies.size();
+    }
+
+    std::cout << "# " << title << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "runtime(ms) " << nanos / 1e6 << ", operations " << total << ", throughput(ops/s) "
+              << (nanos == 0 ? 0 : total * 1e9 / nanos) << std::endl;
+    std::cout << std::left << std::setw(16) << "operation" << std::right << std::setw(10)
+              << "count" << std::setw(8) << "errors" << std::setw(12) << "avg(us)"
+              << std::setw(12) << "p50" << std::setw(12) << "p95" << std::setw(12) << "p99"
+              << std::setw(12) << "p99.9" << std::setw(12) << "max" << std::endl;
+
+    for (auto& op : ops) {
+        std::vector<uint64_t>& lat = op.latencies;
+        if (lat.empty()) {
+            continue;
+        }
+        std::sort(lat.begin(), lat.end());
+        double sum = 0;
+        for (auto nanos : lat) {
+            sum += nanos;
+        }
+        std::cout << std::left << std::setw(16) << op.name << std::right << std::setw(10)
+                  << lat.size() << std::setw(8) << op.errors << std::setw(12)
+                  << sum / lat.size() / 1e3 << std::setw(12) << PercentileUs(lat, 0.5)
+                  << std::setw(12) << PercentileUs(lat, 0.95) << std::setw(12)
+                  << PercentileUs(lat, 0.99) << std::setw(12) << PercentileUs(lat, 0.999)
+                  << std::setw(12) << lat.back() / 1e3 << std::endl;
+    }
+    std::cout << std::endl;
+    std::cout.unsetf(std::ios::fixed | std::ios::left | std::ios::right);
+}
+
+static bool Exec(const std::string& stmt) {
+    Quiet(true);
+    bool ret = ExecStmt(stmt);
+    Quiet(false);
+    if (ret) {
+        std::cout << "[BYDB-Error]  Failed to execute: " << stmt << std::endl;
+    }
+    return ret;
+}
+
+/* Timed statement whose output and errors are accounted in 'op'. */
+static void TimedExec(const std::string& stmt, OpStats* op) {
+    Quiet(true);
+    uint64_t start = MetricsNow();
+    bool ret = ExecStmt(stmt);
+    op->add(MetricsNow() - start, ret);
+    Quiet(false);
+}
+
+/* Bulk load: rows go straight to the TableStore, bypassing parsing and planning. */
+class BulkLoader {
+public:
+    BulkLoader(const char* schema, const char* name) {
+        std::string s(schema);
+        std::string n(name);
+        Table* table = g_meta_data.getTable(&s[0], &n[0]);
+        tableStore_ = table->getTableStore();
+    }
+
+    ~BulkLoader() { clear(); }
+
+    BulkLoader& add(int64_t val) {
+        row_.push_back(Expr::makeLiteral(val));
+        return *this;
+    }
+
+    BulkLoader& add(const std::string& val) {
+        row_.push_back(Expr::makeLiteral(strdup(val.c_str())));
+        return *this;
+    }
+
+    bool insert() {
+        bool ret = tableStore_->insertTuple(&row_);
+        clear();
+        return ret;
+    }
+
+private:
+    void clear() {
+        for (auto expr : row_) {
+            delete expr;
+        }
+        row_.clear();
+    }
+
+    TableStore* tableStore_;
+    std::vector<Expr*> row_;
+};
+
+/*
+ * YCSB core workloads, see
+ * https://github.com/brianfrankcooper/YCSB/wiki/Core-Workloads
+ */
+struct YcsbWorkload {
+    char name;
+    double read;
+    double update;
+    double insert;
+    double scan;
+    double rmw;
+    bool latest;  // Requests favor the most recently inserted keys.
+};
+
+static const YcsbWorkload kYcsbWorkloads[] = {
+        {'a', 0.50, 0.50, 0, 0, 0, false}, {'b', 0.95, 0.05, 0, 0, 0, false},
+        {'c', 1.00, 0, 0, 0, 0, false},    {'d', 0.95, 0, 0.05, 0, 0, true},
+        {'e', 0, 0, 0.05, 0.95, 0, false}, {'f', 0.50, 0, 0, 0, 0.50, false},
+};
+
+class Ycsb {
+public:
+    explicit Ycsb(Options& options) : options_(options), rand_(options.seed), records_(0) {}
+
+    bool load() {
+        std::string create = "CREATE TABLE ycsb.usertable (ycsb_key INT";
+        for (int i = 0; i < YCSB_FIELD_NUM; i++) {
+            create += ", field" + std::to_string(i) + " VARCHAR(" +
+                      std::to_string(YCSB_FIELD_LEN) + ")";
+        }
+        create += ");";
+        if (Exec(create)) {
+            return true;
+        }
+
+        uint64_t start = MetricsNow();
+        BulkLoader loader("ycsb", "usertable");
+        for (records_ = 0; records_ < options_.records; records_++) {
+            loader.add(records_);
+            for (int i = 0; i < YCSB_FIELD_NUM; i++) {
+                loader.add(rand_.string(YCSB_FIELD_LEN));
+            }
+            if (loader.insert()) {
+                return true;
+            }
+        }
+        if (Exec("CREATE INDEX ycsb_pk ON ycsb.usertable (ycsb_key);") ||
+            Exec("ANALYZE ycsb.usertable")) {
+            return true;
+        }
+
+        std::cout << "# YCSB load: " << records_ << " records in " << std::fixed
+                  << std::setprecision(1) << (MetricsNow() - start) / 1e6 << " ms" << std::endl
+                  << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        return false;
+    }
+
+    /* Each workload starts from the data the previous ones left, as YCSB runs usually do. */
+    void run(const YcsbWorkload& workload) {
+        std::vector<OpStats> ops = {OpStats("read"), OpStats("update"), OpStats("insert"),
+                                    OpStats("scan"), OpStats("read-modify-write")};
+        Zipfian zipfian(records_);
+
+        uint64_t start = MetricsNow();
+        for (int64_t i = 0; i < options_.operations; i++) {
+            double dice = rand_.unit();
+            int64_t key = chooseKey(workload, &zipfian);
+            if ((dice -= workload.read) < 0) {
+                TimedExec(readStmt(key), &ops[0]);
+            } else if ((dice -= workload.update) < 0) {
+                TimedExec(updateStmt(key), &ops[1]);
+            } else if ((dice -= workload.insert) < 0) {
+                TimedExec(insertStmt(records_++), &ops[2]);
+            } else if ((dice -= workload.scan) < 0) {
+                scan(key, 1 + rand_.uniform(YCSB_MAX_SCAN_LEN), &ops[3]);
+            } else {
+                uint64_t rmw_start = MetricsNow();
+                Quiet(true);
+                bool ret = ExecStmt(readStmt(key)) || ExecStmt(updateStmt(key));
+                Quiet(false);
+                ops[4].add(MetricsNow() - rmw_start, ret);
+            }
+        }
+
+        std::string title = std::string("YCSB-") + static_cast<char>(toupper(workload.name)) +
+                            " records=" + std::to_string(records_) + " distribution=" +
+                            (workload.latest ? "latest" : (options_.zipfian ? "zipfian" : "uniform"));
+        PrintReport(title, ops, MetricsNow() - start);
+    }
+
+    void unload() { Exec("DROP TABLE ycsb.usertable;"); }
+
+private:
+    int64_t chooseKey(const YcsbWorkload& workload, Zipfian* zipfian) {
+        if (workload.latest) {
+            return records_ - 1 - zipfian->next(&rand_, records_);
+        }
+        if (options_.zipfian) {
+            return ScrambleKey(zipfian->next(&rand_, records_), records_);
+        }
+        return rand_.uniform(records_);
+    }
+
+    std::string readStmt(int64_t key) {
+        return "SELECT * FROM ycsb.usertable WHERE ycsb_key = " + std::to_string(key) + ";";
+    }
+
+    std::string updateStmt(int64_t key) {
+        return "UPDATE ycsb.usertable SET field" + std::to_string(rand_.uniform(YCSB_FIELD_NUM)) +
+               " = '" + rand_.string(YCSB_FIELD_LEN) + "' WHERE ycsb_key = " +
+               std::to_string(key) + ";";
+    }
+
+    std::string insertStmt(int64_t key) {
+        std::string stmt = "INSERT INTO ycsb.usertable VALUES (" + std::to_string(key);
+        for (int i = 0; i < YCSB_FIELD_NUM; i++) {
+            stmt += ", '" + rand_.string(YCSB_FIELD_LEN) + "'";
+        }
+        return stmt + ");";
+    }
+
+    /*
+     * SQL has no range predicate yet, so the scan walks the primary key
+     * index from 'key' and parses 'len' records, as a range scan plan would.
+     */
+    void scan(int64_t key, int64_t len, OpStats* op) {
+        char schema[] = "ycsb";
+        char name[] = "usertable";
+        char index_name[] = "ycsb_pk";
+        Table* table = g_meta_data.getTable(schema, name);
+        Index* index = table->getIndex(index_name);
+        TableStore* table_store = table->getTableStore();
+
+        uint64_t start = MetricsNow();
+        std::vector<Expr*> values(1, Expr::makeLiteral(key));
+        std::vector<size_t> idxs(1, 0);
+        std::string start_key;
+        index->makeKey(values, idxs, &start_key);
+        delete values[0];
+        values.clear();
+
+        auto iter = index->lowerBound(start_key);
+        for (int64_t i = 0; i < len && iter != index->entries.end(); i++, ++iter) {
+            table_store->parseTuple(iter->second, values);
+            for (auto expr : values) {
+                delete expr;
+            }
+            values.clear();
+        }
+        op->add(MetricsNow() - start, false);
+    }
+
+    Options& options_;
+    Random rand_;
+    int64_t records_;
+};
+
+/*
+ * TPC-H style data and queries. The engine has no aggregates, GROUP BY or
+ * range predicates, so the queries keep the join shape and selective
+ * equality filters of their TPC-H namesakes and return rows instead of sums.
+ */
+class Tpch {
+public:
+    explicit Tpch(Options& options) : options_(options), rand_(options.seed) {}
+
+    bool load() {
+        static const char* kCreates[] = {
+                "CREATE TABLE tpch.region (r_regionkey INT, r_name VARCHAR(25));",
+                "CREATE TABLE tpch.nation (n_nationkey INT, n_name VARCHAR(25), "
+                "n_regionkey INT);",
+                "CREATE TABLE tpch.customer (c_custkey INT, c_name VARCHAR(25), c_nationkey INT, "
+                "c_acctbal INT, c_mktsegment VARCHAR(10));",
+                "CREATE TABLE tpch.orders (o_orderkey INT, o_custkey INT, o_orderstatus CHAR(1), "
+                "o_totalprice INT, o_orderdate CHAR(10), o_orderpriority VARCHAR(15));",
+                "CREATE TABLE tpch.lineitem (l_orderkey INT, l_linenumber INT, l_quantity INT, "
+                "l_extendedprice INT, l_returnflag CHAR(1), l_shipdate CHAR(10), "
+                "l_shipmode VARCHAR(10));"};
+        for (auto create : kCreates) {
+            if (Exec(create)) {
+                return true;
+            }
+        }
+
+        uint64_t start = MetricsNow();
+        if (loadNations() || loadCustomers() || loadOrders()) {
+            return true;
+        }
+
+        static const char* kIndexes[] = {
+                "CREATE INDEX c_pk ON tpch.customer (c_custkey);",
+                "CREATE INDEX o_pk ON tpch.orders (o_orderkey);",
+                "CREATE INDEX l_orderkey ON tpch.lineitem (l_orderkey);",
+                "ANALYZE"};
+        for (auto stmt : kIndexes) {
+            if (Exec(stmt)) {
+                return true;
+            }
+        }
+
+        std::cout << "# TPC-H load: scale " << options_.scale << ", " << customers_
+                  << " customers, " << orders_ << " orders, " << lineitems_ << " lineitems in "
+                  << std::fixed << std::setprecision(1) << (MetricsNow() - start) / 1e6 << " ms"
+                  << std::endl
+                  << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        return false;
+    }
+
+    void run() {
+        static const struct {
+            const char* name;
+            const char* sql;
+        } kQueries[] = {
+                {"Q3", "SELECT o_orderkey, o_orderdate, l_extendedprice FROM tpch.customer "
+                       "JOIN tpch.orders ON c_custkey = o_custkey JOIN tpch.lineitem ON "
+                       "o_orderkey = l_orderkey WHERE c_mktsegment = 'BUILDING' "
+                       "ORDER BY o_orderdate LIMIT 10;"},
+                {"Q4", "SELECT o_orderkey, o_orderpriority FROM tpch.orders WHERE o_orderkey IN "
+                       "(SELECT l_orderkey FROM tpch.lineitem WHERE l_returnflag = 'R') "
+                       "ORDER BY o_orderpriority LIMIT 20;"},
+                {"Q5", "SELECT c_name, n_name FROM tpch.customer JOIN tpch.nation ON "
+                       "c_nationkey = n_nationkey JOIN tpch.region ON n_regionkey = r_regionkey "
+                       "WHERE r_name = 'ASIA';"},
+                {"Q10", "SELECT c_custkey, c_name, o_orderkey, l_extendedprice FROM tpch.orders "
+                        "JOIN tpch.lineitem ON o_orderkey = l_orderkey JOIN tpch.customer ON "
+                        "o_custkey = c_custkey WHERE l_returnflag = 'R' ORDER BY c_custkey;"},
+                {"Q12", "SELECT l_orderkey, l_shipmode, o_orderpriority FROM tpch.orders JOIN "
+                        "tpch.lineitem ON o_orderkey = l_orderkey WHERE l_shipmode = 'MAIL';"},
+                {"Q18", "SELECT * FROM tpch.orders JOIN tpch.lineitem ON o_orderkey = l_orderkey "
+                        "WHERE o_orderkey = 7;"},
+        };
+
+        std::vector<OpStats> ops;
+        for (auto& query : kQueries) {
+            ops.push_back(OpStats(query.name));
+        }
+
+        uint64_t start = MetricsNow();
+        for (int run = 0; run < options_.runs; run++) {
+            for (size_t i = 0; i < ops.size(); i++) {
+                TimedExec(kQueries[i].sql, &ops[i]);
+            }
+        }
+
+        std::ostringstream title;
+        title << "TPC-H scale=" << options_.scale << " runs=" << options_.runs;
+        PrintReport(title.str(), ops, MetricsNow() - start);
+    }
+
+    void unload() {
+        Exec("DROP TABLE tpch.lineitem;");
+        Exec("DROP TABLE tpch.orders;");
+        Exec("DROP TABLE tpch.customer;");
+        Exec("DROP TABLE tpch.nation;");
+        Exec("DROP TABLE tpch.region;");
+    }
+
+private:
+    bool loadNations() {
+        static const char* kRegions[] = {"AFRICA", "AMERICA", "ASIA", "EUROPE", "MIDDLE EAST"};
+        BulkLoader region("tpch", "region");
+        for (int64_t i = 0; i < 5; i++) {
+            if (region.add(i).add(kRegions[i]).insert()) {
+                return true;
+            }
+        }
+
+        BulkLoader nation("tpch", "nation");
+        for (int64_t i = 0; i < 25; i++) {
+            if (nation.add(i).add("NATION" + std::to_string(i)).add(i % 5).insert()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool loadCustomers() {
+        static const char* kSegments[] = {"AUTOMOBILE", "BUILDING", "FURNITURE", "HOUSEHOLD",
+                                          "MACHINERY"};
+        customers_ = std::max<int64_t>(1, TPCH_CUSTOMERS * options_.scale);
+        BulkLoader customer("tpch", "customer");
+        for (int64_t i = 1; i <= customers_; i++) {
+            if (customer.add(i)
+                        .add("Customer#" + std::to_string(i))
+                        .add(rand_.uniform(25))
+                        .add(rand_.uniform(1000000) - 99999)
+                        .add(kSegments[rand_.uniform(5)])
+                        .insert()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool loadOrders() {
+        static const char* kPriorities[] = {"1-URGENT", "2-HIGH", "3-MEDIUM", "4-NOT SPECIFIED",
+                                            "5-LOW"};
+        static const char* kShipModes[] = {"REG AIR", "AIR", "RAIL", "SHIP", "TRUCK", "MAIL",
+                                           "FOB"};
+        orders_ = std::max<int64_t>(1, TPCH_ORDERS * options_.scale);
+        lineitems_ = 0;
+        BulkLoader order("tpch", "orders");
+        BulkLoader lineitem("tpch", "lineitem");
+        for (int64_t i = 1; i <= orders_; i++) {
+            std::string date = randomDate();
+            int64_t lines = 1 + rand_.uniform(7);
+            int64_t total = 0;
+            for (int64_t l = 1; l <= lines; l++) {
+                int64_t quantity = 1 + rand_.uniform(50);
+                int64_t price = quantity * (90000 + rand_.uniform(20000)) / 100;
+                total += price;
+                if (lineitem.add(i)
+                            .add(l)
+                            .add(quantity)
+                            .add(price)
+                            .add(rand_.uniform(4) == 0 ? "R" : (rand_.uniform(2) ? "A" : "N"))
+                            .add(date)
+                            .add(kShipModes[rand_.uniform(7)])
+                            .insert()) {
+                    return true;
+                }
+            }
+            lineitems_ += lines;
+
+            if (order.add(i)
+                        .add(1 + rand_.uniform(customers_))
+                        .add(rand_.uniform(2) ? "F" : "O")
+                        .add(total)
+                        .add(date)
+                        .add(kPriorities[rand_.uniform(5)])
+                        .insert()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string randomDate() {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%04d-%02d-%02d", static_cast<int>(1992 + rand_.uniform(7)),
+                 static_cast<int>(1 + rand_.uniform(12)), static_cast<int>(1 + rand_.uniform(28)));
+        return buf;
+    }
+
+    Options& options_;
+    Random rand_;
+    int64_t customers_;
+    int64_t orders_;
+    int64_t lineitems_;
+};
+
+static bool ParseOptions(int argc, char* argv[], Options* options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            std::cout << "[BYDB-Error]  Invalid argument " << arg << std::endl;
+            return true;
+        }
+
+        std::string name = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        if (name == "workload") {
+            options->workloads = value;
+        } else if (name == "records") {
+            options->records = atoll(value.c_str());
+        } else if (name == "operations") {
+            options->operations = atoll(value.c_str());
+        } else if (name == "distribution" && (value == "zipfian" || value == "uniform")) {
+            options->zipfian = (value == "zipfian");
+        } else if (name == "scale") {
+            options->scale = atof(value.c_str());
+        } else if (name == "runs") {
+            options->runs = atoi(value.c_str());
+        } else if (name == "seed") {
+            options->seed = strtoull(value.c_str(), nullptr, 10);
+        } else {
+            std::cout << "[BYDB-Error]  Invalid argument " << arg << std::endl;
+            return true;
+        }
+    }
+
+    if (options->records <= 0 || options->operations < 0 || options->scale <= 0 ||
+        options->runs <= 0) {
+        std::cout << "[BYDB-Error]  Sizes must be positive." << std::endl;
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (ParseOptions(argc, argv, &options)) {
+        return 1;
+    }
+
+    std::vector<std::string> workloads;
+    std::stringstream list(options.workloads);
+    std::string workload;
+    while (std::getline(list, workload, ',')) {
+        workloads.push_back(workload);
+    }
+
+    std::vector<const YcsbWorkload*> ycsb_runs;
+    bool run_tpch = false;
+    for (auto& name : workloads) {
+        if (name == "tpch") {
+            run_tpch = true;
+            continue;
+        }
+        const YcsbWorkload* found = nullptr;
+        for (auto& ycsb_workload : kYcsbWorkloads) {
+            if (name.size() == 1 && tolower(name[0]) == ycsb_workload.name) {
+                found = &ycsb_workload;
+            }
+        }
+        if (found == nullptr) {
+            std::cout << "[BYDB-Error]  Unknown workload " << name << std::endl;
+            return 1;
+        }
+        ycsb_runs.push_back(found);
+    }
+
+    if (!ycsb_runs.empty()) {
+        Ycsb ycsb(options);
+        if (ycsb.load()) {
+            return 1;
+        }
+        for (auto ycsb_workload : ycsb_runs) {
+            ycsb.run(*ycsb_workload);
+        }
+        ycsb.unload();
+    }
+
+    if (run_tpch) {
+        Tpch tpch(options);
+        if (tpch.load()) {
+            return 1;
+        }
+        tpch.run();
+        tpch.unload();
+    }
+
+    return 0;
+}
@@ -0,0 +1,562 @@
+#include "executor.h"
+#include "metadata.h"
+#include "optimizer.h"
+#include "session.h"
+#include "storage.h"
+#include "trx.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace mydb;
+using namespace hsql;
+
+/* Updates/deletes done inside a transaction are committed in batches of this size. */
+#define BENCH_TRX_SIZE 1024
+#define BENCH_DELETE_BATCH (16 * 1024)
+
+/* Swallows everything the engine prints while a benchmark runs. */
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+class QuietCout {
+public:
+    QuietCout() { old_ = std::cout.rdbuf(&null_); }
+    ~QuietCout() { std::cout.rdbuf(old_); }
+
+private:
+    NullBuffer null_;
+    std::streambuf* old_;
+};
+
+/* bench.t (id INT, val INT, name VARCHAR(32)), not registered in the metadata. */
+static Table* NewBenchTable() {
+    char schema[] = "bench";
+    char name[] = "t";
+    std::vector<ColumnDefinition*> cols;
+    cols.push_back(new ColumnDefinition(strdup("id"), ColumnType(DataType::INT),
+                                        new std::unordered_set<ConstraintType>()));
+    cols.push_back(new ColumnDefinition(strdup("val"), ColumnType(DataType::INT),
+                                        new std::unordered_set<ConstraintType>()));
+    cols.push_back(new ColumnDefinition(strdup("name"), ColumnType(DataType::VARCHAR, 32),
+                                        new std::unordered_set<ConstraintType>()));
+
+    Table* table = new Table(schema, name, &cols);
+    for (auto col : cols) {
+        delete col;
+    }
+    return table;
+}
+
+/* bench.f (id INT, val INT, big LONG), all fixed width so it gets a specialized tuple codec. */
+static Table* NewFixedBenchTable() {
+    char schema[] = "bench";
+    char name[] = "f";
+    std::vector<ColumnDefinition*> cols;
+    cols.push_back(new ColumnDefinition(strdup("id"), ColumnType(DataType::INT),
+                                        new std::unordered_set<ConstraintType>()));
+    cols.push_back(new ColumnDefinition(strdup("val"), ColumnType(DataType::INT),
+                                        new std::unordered_set<ConstraintType>()));
+    cols.push_back(new ColumnDefinition(strdup("big"), ColumnType(DataType::LONG),
+                                        new std::unordered_set<ConstraintType>()));
+
+    Table* table = new Table(schema, name, &cols);
+    for (auto col : cols) {
+        delete col;
+    }
+    return table;
+}
+
+static void MakeFixedRow(int64_t id, int64_t val, std::vector<Expr*>* row) {
+    row->push_back(Expr::makeLiteral(id));
+    row->push_back(Expr::makeLiteral(val));
+    row->push_back(Expr::makeLiteral(id * 1000000007));
+}
+
+static void MakeRow(int64_t id, int64_t val, std::vector<Expr*>* row) {
+    row->push_back(Expr::makeLiteral(id));
+    row->push_back(Expr::makeLiteral(val));
+    row->push_back(Expr::makeLiteral(strdup("benchmark-row-name")));
+}
+
+static void FreeRow(std::vector<Expr*>* row) {
+    for (auto expr : *row) {
+        delete expr;
+    }
+    row->clear();
+}
+
+/* Insert 'rows' rows whose val column cycles through 'distinct' values. */
+static void FillTable(Table* table, int64_t rows, int64_t distinct) {
+    TableStore* table_store = table->getTableStore();
+    std::vector<Expr*> row;
+    for (int64_t i = 0; i < rows; i++) {
+        MakeRow(i, i % distinct, &row);
+        table_store->insertTuple(&row);
+        FreeRow(&row);
+    }
+}
+
+static void BM_InsertTuple(benchmark::State& state) {
+    Table* table = NewBenchTable();
+    TableStore* table_store = table->getTableStore();
+    std::vector<Expr*> row;
+    MakeRow(1, 2, &row);
+
+    for (auto _ : state) {
+        table_store->insertTuple(&row);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    FreeRow(&row);
+    delete table;
+}
+BENCHMARK(BM_InsertTuple);
+
+static void BM_InsertTupleFixed(benchmark::State& state) {
+    Table* table = NewFixedBenchTable();
+    TableStore* table_store = table->getTableStore();
+    std::vector<Expr*> row;
+    MakeFixedRow(1, 2, &row);
+
+    for (auto _ : state) {
+        table_store->insertTuple(&row);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    FreeRow(&row);
+    delete table;
+}
+BENCHMARK(BM_InsertTupleFixed);
+
+static void BM_SeqScanParse(benchmark::State& state) {
+    Table* table = NewBenchTable();
+    TableStore* table_store = table->getTableStore();
+    FillTable(table, state.range(0), 100);
+    std::vector<Expr*> values;
+
+    for (auto _ : state) {
+        for (Tuple* tup = table_store->seqScan(nullptr); tup != nullptr;
+             tup = table_store->seqScan(tup)) {
+            table_store->parseTuple(tup, values);
+            FreeRow(&values);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * state.range(0) * table_store->tupleSize());
+    delete table;
+}
+BENCHMARK(BM_SeqScanParse)->Arg(1 << 10)->Arg(1 << 14)->Arg(1 << 17);
+
+static void BM_SeqScanParseFixed(benchmark::State& state) {
+    Table* table = NewFixedBenchTable();
+    TableStore* table_store = table->getTableStore();
+    std::vector<Expr*> row;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        MakeFixedRow(i, i % 100, &row);
+        table_store->insertTuple(&row);
+        FreeRow(&row);
+    }
+    Arena arena;
+
+    for (auto _ : state) {
+        for (Tuple* tup = table_store->seqScan(nullptr); tup != nullptr;
+             tup = table_store->seqScan(tup)) {
+            table_store->parseTuple(tup, row, &arena);
+            row.clear();
+        }
+        arena.reset();
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * state.range(0) * table_store->tupleSize());
+    delete table;
+}
+BENCHMARK(BM_SeqScanParseFixed)->Arg(1 << 14)->Arg(1 << 17);
+
+/* 'val = 0' over 64K rows where val has range(0) distinct values, i.e. selectivity 1/range(0). */
+static void BM_FilterSelectivity(benchmark::State& state) {
+    const int64_t rows = 1 << 16;
+    Table* table = NewBenchTable();
+    FillTable(table, rows, state.range(0));
+
+    ScanPlan* scan = new ScanPlan();
+    scan->type = kSeqScan;
+    scan->table = table;
+    FilterPlan* filter = new FilterPlan();
+    filter->idx = 1;
+    filter->col = (*table->columns())[1];
+    filter->val = Expr::makeLiteral(static_cast<int64_t>(0));
+    filter->next = scan;
+
+    Arena arena;
+    int64_t matched = 0;
+    for (auto _ : state) {
+        // The executor leaves the filter to the scan, see Executor::generateOperator.
+        BaseOperator* op = arena.create<SeqScanOperator>(scan, nullptr, filter, &arena);
+        TupleIter* iter = nullptr;
+        while (!op->exec(&iter) && iter != nullptr) {
+            matched++;
+        }
+        arena.reset();
+    }
+
+    state.SetItemsProcessed(state.iterations() * rows);
+    state.counters["selected"] = static_cast<double>(matched) / state.iterations();
+    delete filter->val;
+    delete filter;
+    delete table;
+}
+BENCHMARK(BM_FilterSelectivity)->Arg(1)->Arg(10)->Arg(100)->Arg(1000);
+
+/* range(0) is 1 to run inside transactions that commit every BENCH_TRX_SIZE updates. */
+static void BM_UpdateTuple(benchmark::State& state) {
+    const int64_t rows = 1 << 14;
+    bool in_trx = state.range(0) != 0;
+    Table* table = NewBenchTable();
+    TableStore* table_store = table->getTableStore();
+    FillTable(table, rows, 100);
+
+    std::vector<Tuple*> tuples;
+    for (Tuple* tup = table_store->seqScan(nullptr); tup != nullptr;
+         tup = table_store->seqScan(tup)) {
+        tuples.push_back(tup);
+    }
+    std::vector<size_t> idxs(1, 1);
+    std::vector<Expr*> values(1, Expr::makeLiteral(static_cast<int64_t>(7)));
+
+    size_t n = 0;
+    if (in_trx) {
+        g_transaction.begin();
+    }
+    for (auto _ : state) {
+        table_store->updateTuple(tuples[n % tuples.size()], idxs, values);
+        if (in_trx && ++n % BENCH_TRX_SIZE == 0) {
+            g_transaction.commit();
+            g_transaction.begin();
+        } else if (!in_trx) {
+            n++;
+        }
+    }
+    if (in_trx) {
+        g_transaction.commit();
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    FreeRow(&values);
+    delete table;
+}
+BENCHMARK(BM_UpdateTuple)->Arg(0)->Arg(1);
+
+static void BM_DeleteTuple(benchmark::State& state) {
+    bool in_trx = state.range(0) != 0;
+    Table* table = NewBenchTable();
+    TableStore* table_store = table->getTableStore();
+
+    size_t n = 0;
+    if (in_trx) {
+        g_transaction.begin();
+    }
+    for (auto _ : state) {
+        Tuple* tup = table_store->seqScan(nullptr);
+        if (tup == nullptr) {
+            state.PauseTiming();
+            FillTable(table, BENCH_DELETE_BATCH, 100);
+            tup = table_store->seqScan(nullptr);
+            state.ResumeTiming();
+        }
+
+        table_store->deleteTuple(tup);
+        if (in_trx && ++n % BENCH_TRX_SIZE == 0) {
+            g_transaction.commit();
+            g_transaction.begin();
+        }
+    }
+    if (in_trx) {
+        g_transaction.commit();
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    delete table;
+}
+BENCHMARK(BM_DeleteTuple)->Arg(0)->Arg(1);
+
+static void BM_ExecStmtInsert(benchmark::State& state) {
+    QuietCout quiet;
+    ExecStmt("CREATE TABLE bench.e (id INT, val INT, name VARCHAR(32));");
+
+    std::vector<std::string> stmts;
+    for (int i = 0; i < 1024; i++) {
+        stmts.push_back("INSERT INTO bench.e VALUES (" + std::to_string(i) + ", " +
+                        std::to_string(i % 100) + ", 'benchmark-row-name');");
+    }
+
+    size_t n = 0;
+    for (auto _ : state) {
+        ExecStmt(stmts[n++ % stmts.size()]);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    ExecStmt("DROP TABLE bench.e;");
+}
+BENCHMARK(BM_ExecStmtInsert);
+
+/* Point SELECT on range(0) rows, range(1) is 1 to answer it through an index. */
+static void BM_ExecStmtPointSelect(benchmark::State& state) {
+    QuietCout quiet;
+    char schema[] = "bench";
+    char name[] = "e";
+    ExecStmt("CREATE TABLE bench.e (id INT, val INT, name VARCHAR(32));");
+    FillTable(g_meta_data.getTable(schema, name), state.range(0), state.range(0));
+    if (state.range(1) != 0) {
+        ExecStmt("CREATE INDEX idx_e ON bench.e (id);");
+    }
+    ExecStmt("ANALYZE bench.e");
+
+    for (auto _ : state) {
+        ExecStmt("SELECT * FROM bench.e WHERE id = 77;");
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    ExecStmt("DROP TABLE bench.e;");
+}
+BENCHMARK(BM_ExecStmtPointSelect)->Args({1 << 10, 0})->Args({1 << 14, 0})->Args({1 << 14, 1});
+
+/*
+ * UPDATE of all range(0) rows, range(1) is 1 for the counter increment 'val = val + 1'
+ * computed by an expression program, 0 for a literal value.
+ */
+static void BM_ExecStmtCounterUpdate(benchmark::State& state) {
+    QuietCout quiet;
+    char schema[] = "bench";
+    char name[] = "e";
+    ExecStmt("CREATE TABLE bench.e (id INT, val INT, name VARCHAR(32));");
+    FillTable(g_meta_data.getTable(schema, name), state.range(0), 100);
+    const char* stmt = (state.range(1) != 0) ? "UPDATE bench.e SET val = val + 1;"
+                                             : "UPDATE bench.e SET val = 7;";
+
+    for (auto _ : state) {
+        ExecStmt(stmt);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    ExecStmt("DROP TABLE bench.e;");
+}
+BENCHMARK(BM_ExecStmtCounterUpdate)->Args({1 << 14, 0})->Args({1 << 14, 1});
+
+/*
+ * Filtered, computed SELECT over range(0) rows, run as a fused pipeline; set
+ * MYDB_PIPELINE=0 to compare with the chain of operators.
+ */
+static void BM_ExecStmtScanQuery(benchmark::State& state) {
+    QuietCout quiet;
+    char schema[] = "bench";
+    char name[] = "e";
+    ExecStmt("CREATE TABLE bench.e (id INT, val INT, name VARCHAR(32));");
+    FillTable(g_meta_data.getTable(schema, name), state.range(0), 100);
+
+    for (auto _ : state) {
+        ExecStmt("SELECT id, val * 2 + 1 FROM bench.e WHERE val < 10;");
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    ExecStmt("DROP TABLE bench.e;");
+}
+BENCHMARK(BM_ExecStmtScanQuery)->Arg(1 << 14)->Arg(1 << 17);
+
+/*
+ * DELETE of half of range(0) rows inside a transaction that is rolled back,
+ * so every iteration logs and undoes the same deletes.
+ */
+static void BM_ExecStmtDeleteRollback(benchmark::State& state) {
+    QuietCout quiet;
+    char schema[] = "bench";
+    char name[] = "e";
+    ExecStmt("CREATE TABLE bench.e (id INT, val INT, name VARCHAR(32));");
+    FillTable(g_meta_data.getTable(schema, name), state.range(0), 100);
+
+    for (auto _ : state) {
+        ExecStmt("BEGIN;");
+        ExecStmt("DELETE FROM bench.e WHERE val < 50;");
+        ExecStmt("ROLLBACK;");
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0) / 2);
+    ExecStmt("DROP TABLE bench.e;");
+}
+BENCHMARK(BM_ExecStmtDeleteRollback)->Arg(1 << 14)->Arg(1 << 17);
+
+/* Emptying a table of range(0) rows, with TRUNCATE if range(1) is 1, else with DELETE. */
+static void BM_ExecStmtClearTable(benchmark::State& state) {
+    QuietCout quiet;
+    char schema[] = "bench";
+    char name[] = "e";
+    ExecStmt("CREATE TABLE bench.e (id INT, val INT, name VARCHAR(32));");
+    Table* table = g_meta_data.getTable(schema, name);
+    const char* stmt = (state.range(1) != 0) ? "TRUNCATE bench.e;" : "DELETE FROM bench.e;";
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        FillTable(table, state.range(0), 100);
+        state.ResumeTiming();
+        ExecStmt(stmt);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    ExecStmt("DROP TABLE bench.e;");
+}
+BENCHMARK(BM_ExecStmtClearTable)->Args({1 << 14, 0})->Args({1 << 14, 1})->Args({1 << 17, 0})
+        ->Args({1 << 17, 1});
+
+/* Compaction of range(0) rows after a purge of the 80% whose val is below 80. */
+static void BM_CompactTable(benchmark::State& state) {
+    size_t groups = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        Table* table = NewBenchTable();
+        TableStore* table_store = table->getTableStore();
+        FillTable(table, state.range(0), 100);
+        Arena arena;
+        std::vector<Expr*> values;
+        std::vector<Tuple*> purged;
+        for (Tuple* tup = table_store->seqScan(nullptr); tup != nullptr;
+             tup = table_store->seqScan(tup)) {
+            values.clear();
+            table_store->parseTuple(tup, values, &arena);
+            if (values[1]->ival < 80) {
+                purged.push_back(tup);
+            }
+        }
+        table_store->deleteTuples(purged);
+        size_t before = table_store->tupleGroups().size();
+        state.ResumeTiming();
+
+        table_store->compact();
+
+        state.PauseTiming();
+        groups += before - table_store->tupleGroups().size();
+        delete table;
+        state.ResumeTiming();
+    }
+
+    state.counters["groups_freed"] = benchmark::Counter(groups, benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations() * state.range(0) / 5);
+}
+BENCHMARK(BM_CompactTable)->Arg(1 << 14)->Arg(1 << 17);
+
+/*
+ * Removing the 80% oldest of range(0) rows, by a TTL expiry pass if range(1)
+ * is 1, else with the DELETE a nightly purge would run.
+ */
+static void BM_ExpireRows(benchmark::State& state) {
+    QuietCout quiet;
+    char schema[] = "bench";
+    char name[] = "x";
+    ExecStmt("CREATE TABLE bench.x (id INT, ts LONG, name VARCHAR(32)) "
+             "WITH (ttl_column = ts, ttl = '1 day');");
+    Table* table = g_meta_data.getTable(schema, name);
+    TableStore* table_store = table->getTableStore();
+    int64_t cutoff = state.range(0) * 8 / 10;
+    std::string purge = "DELETE FROM bench.x WHERE ts < " + std::to_string(cutoff) + ";";
+
+    std::vector<Expr*> row;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (int64_t i = 0; i < state.range(0); i++) {
+            MakeRow(i, i, &row);
+            table_store->insertTuple(&row);
+            FreeRow(&row);
+        }
+        state.ResumeTiming();
+
+        if (state.range(1) != 0) {
+            table_store->expire(table->ttl().column, cutoff - 1, SIZE_MAX);
+        } else {
+            ExecStmt(purge);
+        }
+
+        state.PauseTiming();
+        ExecStmt("TRUNCATE bench.x;");
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * cutoff);
+    ExecStmt("DROP TABLE bench.x;");
+}
+BENCHMARK(BM_ExpireRows)->Args({1 << 14, 0})->Args({1 << 14, 1})->Args({1 << 17, 0})
+        ->Args({1 << 17, 1});
+
+/*
+ * One hour out of range(0) rows taken a minute apart, from a table
+ * partitioned by day if range(1) is 1, else from an unpartitioned one.
+ */
+static void BM_PartitionPrunedScan(benchmark::State& state) {
+    QuietCout quiet;
+    char schema[] = "bench";
+    char name[] = "p";
+    ExecStmt((state.range(1) != 0)
+                 ? "CREATE TABLE bench.p (id INT, ts LONG, name VARCHAR(32)) "
+                   "WITH (partition_column = ts, partition_range = '1 day');"
+                 : "CREATE TABLE bench.p (id INT, ts LONG, name VARCHAR(32));");
+    TableStore* table_store = g_meta_data.getTable(schema, name)->getTableStore();
+    std::vector<Expr*> row;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        MakeRow(i, i * 60, &row);
+        table_store->insertTuple(&row);
+        FreeRow(&row);
+    }
+    int64_t from = state.range(0) * 60 / 2;
+    std::string query = "SELECT id FROM bench.p WHERE ts >= " + std::to_string(from) +
+                        " AND ts < " + std::to_string(from + 3600) + ";";
+
+    for (auto _ : state) {
+        ExecStmt(query);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    ExecStmt("DROP TABLE bench.p;");
+}
+BENCHMARK(BM_PartitionPrunedScan)->Args({1 << 17, 0})->Args({1 << 17, 1});
+
+/* Removing the first day of range(0) rows a minute apart, by DROP PARTITION if range(1) is 1. */
+static void BM_DropPartition(benchmark::State& state) {
+    QuietCout quiet;
+    char schema[] = "bench";
+    char name[] = "p";
+    ExecStmt("CREATE TABLE bench.p (id INT, ts LONG, name VARCHAR(32)) "
+             "WITH (partition_column = ts, partition_range = '1 day');");
+    TableStore* table_store = g_meta_data.getTable(schema, name)->getTableStore();
+    const char* stmt = (state.range(1) != 0) ? "ALTER TABLE bench.p DROP PARTITION 0;"
+                                             : "DELETE FROM bench.p WHERE ts < 86400;";
+
+    std::vector<Expr*> row;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (int64_t i = 0; i < state.range(0); i++) {
+            MakeRow(i, i * 60, &row);
+            table_store->insertTuple(&row);
+            FreeRow(&row);
+        }
+        state.ResumeTiming();
+
+        ExecStmt(stmt);
+
+        state.PauseTiming();
+        ExecStmt("TRUNCATE bench.p;");
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * std::min<int64_t>(state.range(0), 1440));
+    ExecStmt("DROP TABLE bench.p;");
+}
+BENCHMARK(BM_DropPartition)->Args({1 << 14, 0})->Args({1 << 14, 1});
+
+BENCHMARK_MAIN();
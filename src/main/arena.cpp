@@ -0,0 +1,78 @@
+#include "arena.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mydb {
+
+    Arena::Arena() : cur_(nullptr), end_(nullptr), used_(0) { newBlock(ARENA_BLOCK_SIZE); }
+
+    Arena::~Arena() {
+        reset();
+        ::operator delete(blocks_[0]);
+    }
+
+    void* Arena::allocate(size_t size, size_t align) {
+        uintptr_t pos = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(align - 1);
+        if (pos + size > reinterpret_cast<uintptr_t>(end_)) {
+            newBlock(std::max(static_cast<size_t>(ARENA_BLOCK_SIZE), size + align));
+            pos = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(align - 1);
+        }
+
+        cur_ = reinterpret_cast<char*>(pos + size);
+        used_ += size;
+        CountAlloc(size);
+        return reinterpret_cast<void*>(pos);
+    }
+
+    void Arena::newBlock(size_t size) {
+        char* block = static_cast<char*>(::operator new(size));
+        blocks_.push_back(block);
+        cur_ = block;
+        end_ = block + size;
+    }
+
+    Expr* Arena::makeLiteral(int64_t val) {
+        Expr* e = new (allocate(sizeof(Expr), alignof(Expr))) Expr(kExprLiteralInt);
+        e->ival = val;
+        return e;
+    }
+
+    Expr* Arena::makeLiteral(double val) {
+        Expr* e = new (allocate(sizeof(Expr), alignof(Expr))) Expr(kExprLiteralFloat);
+        e->fval = val;
+        return e;
+    }
+
+    Expr* Arena::makeLiteral(const char* val, size_t len) {
+        char* str = static_cast<char*>(allocate(len + 1, 1));
+        memcpy(str, val, len);
+        str[len] = '\0';
+
+        Expr* e = new (allocate(sizeof(Expr), alignof(Expr))) Expr(kExprLiteralString);
+        e->name = str;
+        return e;
+    }
+
+    Expr* Arena::makeNullLiteral() {
+        return new (allocate(sizeof(Expr), alignof(Expr))) Expr(kExprLiteralNull);
+    }
+
+    /* Objects are destroyed newest first, as if they had been stack variables. */
+    void Arena::reset() {
+        for (auto iter = cleanups_.rbegin(); iter != cleanups_.rend(); ++iter) {
+            iter->destroy(iter->obj);
+        }
+        cleanups_.clear();
+
+        for (size_t i = 1; i < blocks_.size(); i++) {
+            ::operator delete(blocks_[i]);
+        }
+        blocks_.resize(1);
+        cur_ = blocks_[0];
+        end_ = blocks_[0] + ARENA_BLOCK_SIZE;
+        used_ = 0;
+    }
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "sql/statements.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace hsql;
+
+namespace mydb {
+
+/* Allocations are carved out of blocks of this size, larger ones get a block of their own. */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+    /*
+     * Bump allocator for everything that lives exactly as long as one
+     * statement: the plan tree, the operator tree, the TupleIters operators
+     * hand to each other and the Expr values of those rows. Nothing is freed
+     * on its own; reset() runs the destructors registered by create() and
+     * drops every block but the first, which is kept for the next statement.
+     *
+     * Expr made by the arena never have their destructor run, so their
+     * strings are arena memory as well and must not be freed or kept past
+     * the statement.
+     */
+    class Arena {
+    public:
+        Arena();
+        ~Arena();
+
+        void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+        template <typename T, typename... Args>
+        T* create(Args&&... args) {
+            T* obj = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            if (!std::is_trivially_destructible<T>::value) {
+                cleanups_.push_back(Cleanup{obj, &Destroy<T>});
+            }
+            return obj;
+        }
+
+        Expr* makeLiteral(int64_t val);
+        Expr* makeLiteral(double val);
+        /* String literal holding a copy of the first 'len' bytes of 'val'. */
+        Expr* makeLiteral(const char* val, size_t len);
+        Expr* makeNullLiteral();
+
+        void reset();
+
+        /* Bytes handed out since the last reset. */
+        size_t used() { return used_; }
+
+    private:
+        struct Cleanup {
+            void* obj;
+            void (*destroy)(void*);
+        };
+
+        template <typename T>
+        static void Destroy(void* obj) {
+            static_cast<T*>(obj)->~T();
+        }
+
+        void newBlock(size_t size);
+
+        std::vector<char*> blocks_;
+        std::vector<Cleanup> cleanups_;
+        char* cur_;
+        char* end_;
+        size_t used_;
+    };
+
+    /* Resets the arena of a statement when the statement is done, whatever way it ends. */
+    class ArenaScope {
+    public:
+        explicit ArenaScope(Arena* arena) : arena_(arena) {}
+        ~ArenaScope() { arena_->reset(); }
+
+    private:
+        Arena* arena_;
+    };
+
+}
@@ -0,0 +1,39 @@
+#include "bloom.h"
+
+#include <cstring>
+
+namespace mydb {
+
+    /* Odd constants spreading the low half of a hash to the eight words of a block. */
+    static const uint32_t kBloomSalts[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                            0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+    BloomFilter::BloomFilter(size_t keys) {
+        size_t bits = keys * BLOOM_BITS_PER_KEY;
+        size_t block_num = (bits + sizeof(Block) * 8 - 1) / (sizeof(Block) * 8);
+        blocks_.resize((block_num == 0) ? 1 : block_num);
+        clear();
+    }
+
+    void BloomFilter::add(uint64_t hash) {
+        Block& block = blockOf(hash);
+        uint32_t key = static_cast<uint32_t>(hash);
+        for (int i = 0; i < 8; i++) {
+            block.words[i] |= 1U << ((key * kBloomSalts[i]) >> 27);
+        }
+    }
+
+    bool BloomFilter::mayContain(uint64_t hash) {
+        Block& block = blockOf(hash);
+        uint32_t key = static_cast<uint32_t>(hash);
+        for (int i = 0; i < 8; i++) {
+            if ((block.words[i] & (1U << ((key * kBloomSalts[i]) >> 27))) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void BloomFilter::clear() { memset(blocks_.data(), 0, bytes()); }
+
+}
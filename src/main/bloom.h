@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mydb {
+
+/* About 1% false positives at this many bits per key. */
+#define BLOOM_BITS_PER_KEY 10
+/* ANALYZE adds tuple group Bloom filters on columns with at least this share of distinct values. */
+#define BLOOM_DISTINCT_RATIO 0.5
+/*
+ * A scan stops checking a runtime filter once it has checked this many rows
+ * and more than BLOOM_MAX_PASS_RATIO of them passed.
+ */
+#define BLOOM_ADAPT_ROWS 4096
+#define BLOOM_MAX_PASS_RATIO 0.75
+
+    static inline uint64_t MixHash(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /* Fold the hash 'h' of one more key column into 'hash', see HashKeys. */
+    static inline uint64_t CombineKeyHash(uint64_t hash, uint64_t h) {
+        return MixHash(hash ^ (h + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2)));
+    }
+
+    /*
+     * Split block Bloom filter: a key sets one bit in each of the eight 32-bit
+     * words of a single 32-byte block, so adding or checking a key touches
+     * one cache line. Keys are the 64-bit hashes of HashKeys/CombineKeyHash.
+     */
+    class BloomFilter {
+    public:
+        explicit BloomFilter(size_t keys);
+
+        void add(uint64_t hash);
+        bool mayContain(uint64_t hash);
+        void clear();
+        size_t bytes() { return blocks_.size() * sizeof(Block); }
+
+    private:
+        struct Block {
+            uint32_t words[8];
+        };
+
+        Block& blockOf(uint64_t hash) {
+            return blocks_[((hash >> 32) * blocks_.size()) >> 32];
+        }
+
+        std::vector<Block> blocks_;
+    };
+
+}
@@ -0,0 +1,224 @@
+#include "compress.h"
+#include "metadata.h"
+#include "trx.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mydb {
+
+    static uint32_t BitWidth(uint64_t max_code) {
+        uint32_t width = 0;
+        while (width < 64 && (max_code >> width) != 0) {
+            width++;
+        }
+        return width;
+    }
+
+    void CodeStream::encode(const std::vector<uint64_t>& codes) {
+        rows_ = codes.size();
+        uint64_t max_code = 0;
+        size_t runs = 0;
+        for (size_t i = 0; i < rows_; i++) {
+            max_code = std::max(max_code, codes[i]);
+            if (i == 0 || codes[i] != codes[i - 1]) {
+                runs++;
+            }
+        }
+
+        width_ = BitWidth(max_code);
+        size_t packed_bytes = (rows_ * width_ + 63) / 64 * sizeof(uint64_t);
+        size_t rle_bytes = runs * (sizeof(uint64_t) + sizeof(uint32_t));
+        if (rle_bytes < packed_bytes) {
+            encoding_ = kRunLength;
+            for (size_t i = 0; i < rows_; i++) {
+                if (i == 0 || codes[i] != codes[i - 1]) {
+                    runCodes_.push_back(codes[i]);
+                    runEnds_.push_back(i + 1);
+                } else {
+                    runEnds_.back() = i + 1;
+                }
+            }
+            return;
+        }
+
+        encoding_ = kBitPacked;
+        words_.assign((rows_ * width_ + 63) / 64, 0);
+        for (size_t i = 0; i < rows_ && width_ > 0; i++) {
+            size_t bit = i * width_;
+            size_t word = bit / 64;
+            size_t shift = bit % 64;
+            words_[word] |= codes[i] << shift;
+            if (shift + width_ > 64) {
+                words_[word + 1] |= codes[i] >> (64 - shift);
+            }
+        }
+    }
+
+    uint64_t CodeStream::get(size_t row) const {
+        if (encoding_ == kRunLength) {
+            size_t run = std::upper_bound(runEnds_.begin(), runEnds_.end(), row) - runEnds_.begin();
+            return runCodes_[run];
+        }
+        if (width_ == 0) {
+            return 0;
+        }
+
+        size_t bit = row * width_;
+        size_t word = bit / 64;
+        size_t shift = bit % 64;
+        uint64_t code = words_[word] >> shift;
+        if (shift + width_ > 64) {
+            code |= words_[word + 1] << (64 - shift);
+        }
+        return (width_ == 64) ? code : (code & ((1ULL << width_) - 1));
+    }
+
+    void CodeStream::match(uint64_t code, std::vector<uint32_t>* rows) const {
+        if (encoding_ == kRunLength) {
+            uint32_t begin = 0;
+            for (size_t run = 0; run < runCodes_.size(); run++) {
+                if (runCodes_[run] == code) {
+                    for (uint32_t row = begin; row < runEnds_[run]; row++) {
+                        rows->push_back(row);
+                    }
+                }
+                begin = runEnds_[run];
+            }
+            return;
+        }
+
+        for (size_t row = 0; row < rows_; row++) {
+            if (get(row) == code) {
+                rows->push_back(row);
+            }
+        }
+    }
+
+    size_t CodeStream::bytes() const {
+        return words_.size() * sizeof(uint64_t) + runCodes_.size() * sizeof(uint64_t) +
+               runEnds_.size() * sizeof(uint32_t);
+    }
+
+    ColdGroup::ColdGroup(std::vector<ColumnDefinition*>* columns,
+                         std::vector<std::vector<Expr*>>& rows)
+            : rows_(rows.size()), columns_(columns->size()) {
+        std::vector<uint64_t> codes(rows_);
+        for (size_t i = 0; i < columns->size(); i++) {
+            ColdColumn& col = columns_[i];
+            col.type = (*columns)[i]->type.data_type;
+            bool is_str = (col.type == DataType::CHAR || col.type == DataType::VARCHAR);
+
+            bool has_null = false;
+            bool has_val = false;
+            for (auto& row : rows) {
+                Expr* val = row[i];
+                if (val->type == kExprLiteralNull) {
+                    has_null = true;
+                } else if (is_str) {
+                    col.dict.push_back(val->name);
+                } else if (!has_val || val->ival < col.base) {
+                    col.base = val->ival;
+                }
+                has_val = has_val || val->type != kExprLiteralNull;
+            }
+            if (has_null) {
+                col.nulls.assign((rows_ + 63) / 64, 0);
+            }
+            std::sort(col.dict.begin(), col.dict.end());
+            col.dict.erase(std::unique(col.dict.begin(), col.dict.end()), col.dict.end());
+
+            for (size_t r = 0; r < rows_; r++) {
+                Expr* val = rows[r][i];
+                if (val->type == kExprLiteralNull) {
+                    col.nulls[r / 64] |= 1ULL << (r % 64);
+                    codes[r] = 0;
+                } else if (is_str) {
+                    codes[r] = std::lower_bound(col.dict.begin(), col.dict.end(), val->name) -
+                               col.dict.begin();
+                } else {
+                    codes[r] = static_cast<uint64_t>(val->ival) - static_cast<uint64_t>(col.base);
+                }
+            }
+            col.codes.encode(codes);
+        }
+    }
+
+    size_t ColdGroup::bytes() {
+        size_t bytes = sizeof(ColdGroup);
+        for (auto& col : columns_) {
+            bytes += sizeof(ColdColumn) + col.codes.bytes() + col.nulls.size() * sizeof(uint64_t);
+            for (auto& str : col.dict) {
+                bytes += sizeof(std::string) + str.size();
+            }
+        }
+        return bytes;
+    }
+
+    void ColdGroup::decodeRow(size_t row, std::vector<Expr*>& values, Arena* arena,
+                              std::vector<bool>* cols, Expr* skipped) {
+        for (size_t i = 0; i < columns_.size(); i++) {
+            ColdColumn& col = columns_[i];
+            if (cols != nullptr && !(*cols)[i]) {
+                values.push_back(skipped);
+                continue;
+            }
+            if (isNull(col, row)) {
+                values.push_back(arena->makeNullLiteral());
+                continue;
+            }
+
+            uint64_t code = col.codes.get(row);
+            if (col.type == DataType::CHAR || col.type == DataType::VARCHAR) {
+                std::string& str = col.dict[code];
+                values.push_back(arena->makeLiteral(str.data(), str.size()));
+            } else {
+                int64_t val = static_cast<int64_t>(static_cast<uint64_t>(col.base) + code);
+                values.push_back(arena->makeLiteral(val));
+            }
+        }
+    }
+
+    /* A value outside the frame or missing from the dictionary rules out the whole group. */
+    void ColdGroup::matchEquals(size_t idx, Expr* val, std::vector<uint32_t>* rows) {
+        ColdColumn& col = columns_[idx];
+        uint64_t code = 0;
+        if (col.type == DataType::CHAR || col.type == DataType::VARCHAR) {
+            if (val->type != kExprLiteralString) {
+                return;
+            }
+            auto pos = std::lower_bound(col.dict.begin(), col.dict.end(), val->name);
+            if (pos == col.dict.end() || *pos != val->name) {
+                return;
+            }
+            code = pos - col.dict.begin();
+        } else {
+            if (val->type != kExprLiteralInt || val->ival < col.base) {
+                return;
+            }
+            code = static_cast<uint64_t>(val->ival) - static_cast<uint64_t>(col.base);
+        }
+
+        size_t begin = rows->size();
+        col.codes.match(code, rows);
+        if (col.nulls.empty()) {
+            return;
+        }
+        auto end = std::remove_if(rows->begin() + begin, rows->end(),
+                                  [&](uint32_t row) { return isNull(col, row); });
+        rows->erase(end, rows->end());
+    }
+
+    void CompressColdGroups() {
+        if (g_transaction.inTransaction()) {
+            return;
+        }
+
+        std::vector<Table*> tables;
+        g_meta_data.getAllTables(&tables);
+        for (auto table : tables) {
+            table->getTableStore()->compress();
+        }
+    }
+
+}
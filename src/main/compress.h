@@ -0,0 +1,88 @@
+#pragma once
+
+#include "arena.h"
+
+#include "sql/statements.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace hsql;
+
+namespace mydb {
+
+/* The shell runs a compression pass every this many statements. */
+#define COMPRESS_INTERVAL 1000
+
+    enum CodeEncoding { kBitPacked, kRunLength };
+
+    /* Unsigned codes of one column, bit-packed or run-length encoded, whichever is smaller. */
+    class CodeStream {
+    public:
+        CodeStream() : encoding_(kBitPacked), width_(0), rows_(0) {}
+
+        void encode(const std::vector<uint64_t>& codes);
+        uint64_t get(size_t row) const;
+        /* Append the rows whose code is 'code'. */
+        void match(uint64_t code, std::vector<uint32_t>* rows) const;
+        size_t bytes() const;
+
+    private:
+        CodeEncoding encoding_;
+        uint32_t width_;  // Bits per code when bit-packed.
+        size_t rows_;
+        std::vector<uint64_t> words_;
+        std::vector<uint64_t> runCodes_;
+        std::vector<uint32_t> runEnds_;  // Row after the last row of each run.
+    };
+
+    /*
+     * A column of a cold group. Integers are stored as their difference to
+     * the smallest value of the group (frame of reference), strings as their
+     * position in the sorted dictionary of the group. NULL rows have code 0
+     * and a bit in 'nulls', which is empty when the group has no NULL.
+     */
+    struct ColdColumn {
+        ColdColumn() : type(DataType::UNKNOWN), base(0) {}
+        DataType type;
+        int64_t base;
+        std::vector<std::string> dict;
+        std::vector<uint64_t> nulls;
+        CodeStream codes;
+    };
+
+    /*
+     * Read-only columnar copy of the rows of a full tuple group that is no
+     * longer modified. Rows are decoded one at a time; equality filters are
+     * answered on the codes.
+     */
+    class ColdGroup {
+    public:
+        ColdGroup(std::vector<ColumnDefinition*>* columns, std::vector<std::vector<Expr*>>& rows);
+
+        size_t rows() { return rows_; }
+        size_t bytes();
+        /*
+         * Values are statement lifetime Expr from 'arena'. With 'cols', the
+         * columns not set in it are not decoded and get 'skipped' instead.
+         */
+        void decodeRow(size_t row, std::vector<Expr*>& values, Arena* arena,
+                       std::vector<bool>* cols = nullptr, Expr* skipped = nullptr);
+        /* Append the rows where column 'idx' = 'val'. */
+        void matchEquals(size_t idx, Expr* val, std::vector<uint32_t>* rows);
+
+    private:
+        bool isNull(ColdColumn& col, size_t row) {
+            return !col.nulls.empty() && ((col.nulls[row / 64] >> (row % 64)) & 1);
+        }
+
+        size_t rows_;
+        std::vector<ColdColumn> columns_;
+    };
+
+    /* Compress the cold tuple groups of every table, outside of transactions. */
+    void CompressColdGroups();
+
+}
@@ -1,9 +1,15 @@
 #include "executor.h"
 #include "metadata.h"
+#include "metrics.h"
 #include "optimizer.h"
 #include "trx.h"
 #include "util.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
 
 using namespace hsql;
@@ -14,58 +20,326 @@ namespace mydb {
 
     bool Executor::exec() { return opTree_->exec(); }
 
-    BaseOperator* Executor::generateOperator(Plan* plan) {
+    static bool PipelinesEnabled() {
+        static int enabled = -1;
+        if (enabled < 0) {
+            const char* env = getenv(PIPELINE_ENV);
+            enabled = (env != nullptr && strcmp(env, "0") == 0) ? 0 : 1;
+        }
+        return enabled == 1;
+    }
+
+    /* A profiled tree is never fused, so EXPLAIN ANALYZE has the actuals of every node. */
+    static bool RunFused(Plan* plan, bool profile) {
+        return plan->planType == kSelect && !profile && PipelinesEnabled() &&
+               PipelineOperator::fusible(static_cast<SelectPlan*>(plan));
+    }
+
+    BaseOperator* Executor::generateOperator(Plan* plan, Plan* parent) {
         BaseOperator* op = nullptr;
         BaseOperator* next = nullptr;
+        bool fused = RunFused(plan, profile_);
 
-        /* Build Operator tree from the leaf. */
-        if (plan->next != nullptr) {
-            next = generateOperator(plan->next);
+        /* Build Operator tree from the leaf, a fused pipeline reads its plan nodes itself. */
+        if (plan->next != nullptr && !fused) {
+            next = generateOperator(plan->next, plan);
         }
 
         switch (plan->planType) {
             case kCreate:
-                op = new CreateOperator(plan, next);
+                op = arena_->create<CreateOperator>(plan, next, arena_);
                 break;
             case kDrop:
-                op = new DropOperator(plan, next);
+                op = arena_->create<DropOperator>(plan, next, arena_);
                 break;
             case kInsert:
-                op = new InsertOperator(plan, next);
+                op = arena_->create<InsertOperator>(plan, next, arena_);
                 break;
             case kUpdate:
-                op = new UpdateOperator(plan, next);
+                op = arena_->create<UpdateOperator>(plan, next, arena_);
                 break;
             case kDelete:
-                op = new DeleteOperator(plan, next);
+                op = arena_->create<DeleteOperator>(plan, next, arena_);
                 break;
             case kSelect:
-                op = new SelectOperator(plan, next);
+                if (fused) {
+                    op = arena_->create<PipelineOperator>(plan, arena_);
+                } else {
+                    op = arena_->create<SelectOperator>(plan, next, arena_);
+                }
                 break;
             case kScan: {
                 ScanPlan* scan_plan = static_cast<ScanPlan*>(plan);
                 if (scan_plan->type == kSeqScan) {
-                    op = new SeqScanOperator(plan, next);
+                    FilterPlan* filter = (parent != nullptr && parent->planType == kFilter)
+                                                 ? static_cast<FilterPlan*>(parent)
+                                                 : nullptr;
+                    if (filter != nullptr && filter->program != nullptr) {
+                        filter = nullptr;
+                    }
+                    op = arena_->create<SeqScanOperator>(plan, next, filter, arena_);
+                } else if (scan_plan->type == kIndexScan) {
+                    op = arena_->create<IndexScanOperator>(plan, next, arena_);
                 }
                 break;
             }
-            case kFilter:
-                op = new FilterOperator(plan, next);
+            case kFilter: {
+                // A seq scan right below already returns only the rows equal to the literal.
+                Plan* child = plan->next;
+                if (static_cast<FilterPlan*>(plan)->program == nullptr &&
+                    child->planType == kScan && static_cast<ScanPlan*>(child)->type == kSeqScan) {
+                    op = next;
+                } else {
+                    op = arena_->create<FilterOperator>(plan, next, arena_);
+                }
+                break;
+            }
+            case kProjection:
+                op = arena_->create<ProjectionOperator>(plan, next, arena_);
                 break;
+            case kSort:
+                op = arena_->create<SortOperator>(plan, next, arena_);
+                break;
+            case kLimit:
+                op = arena_->create<LimitOperator>(plan, next, arena_);
+                break;
+            case kJoin: {
+                JoinPlan* join_plan = static_cast<JoinPlan*>(plan);
+                if (join_plan->algo == kHashJoin) {
+                    BaseOperator* build = generateOperator(join_plan->right);
+                    op = arena_->create<HashJoinOperator>(plan, next, build, arena_);
+                } else if (join_plan->algo == kIndexJoin) {
+                    op = arena_->create<IndexJoinOperator>(plan, next, arena_);
+                } else if (join_plan->algo == kMergeJoin) {
+                    BaseOperator* right = generateOperator(join_plan->right);
+                    op = arena_->create<MergeJoinOperator>(plan, next, right, arena_);
+                }
+                break;
+            }
             case kTrx:
-                op = new TrxOperator(plan, next);
+                op = arena_->create<TrxOperator>(plan, next, arena_);
                 break;
             case kShow:
-                op = new ShowOperator(plan, next);
+                op = arena_->create<ShowOperator>(plan, next, arena_);
+                break;
+            case kAnalyze:
+                op = arena_->create<AnalyzeOperator>(plan, next, arena_);
+                break;
+            case kMetrics:
+                op = arena_->create<MetricsOperator>(plan, next, arena_);
+                break;
+            case kTruncate:
+                op = arena_->create<TruncateOperator>(plan, next, arena_);
+                break;
+            case kDropPartition:
+                op = arena_->create<DropPartitionOperator>(plan, next, arena_);
                 break;
             default:
                 std::cout << "[BYDB-Error]  Not support plan node " << PlanTypeToString(plan->planType);
                 break;
         }
 
+        if (profile_ && op != nullptr) {
+            op = arena_->create<ProfileOperator>(plan, op, &profiles_[plan], arena_);
+        }
         return op;
     }
 
+    bool Executor::explain(bool analyze) {
+        if (analyze) {
+            if (planTree_->planType == kSelect) {
+                static_cast<SelectPlan*>(planTree_)->discard = true;
+            }
+            profile_ = true;
+            init();
+            if (exec()) {
+                return true;
+            }
+        }
+
+        printPlan(planTree_, 0);
+        return false;
+    }
+
+    static void DescribeJoinKeys(std::vector<size_t>& keys, const char* side) {
+        for (size_t i = 0; i < keys.size(); i++) {
+            std::cout << ((i == 0) ? "" : ", ") << side << "#" << keys[i];
+        }
+    }
+
+    static void DescribePlan(Plan* plan, bool profile) {
+        switch (plan->planType) {
+            case kScan: {
+                ScanPlan* scan = static_cast<ScanPlan*>(plan);
+                std::cout << ((scan->type == kSeqScan) ? "SeqScan on " : "IndexScan on ")
+                          << TableNameToString(scan->table->schema(), scan->table->name());
+                if (scan->type == kIndexScan) {
+                    std::cout << " using " << scan->index->name;
+                    if (scan->lookup) {
+                        std::cout << " (lookup)";
+                    }
+                }
+                TableStore* table_store = scan->table->getTableStore();
+                if (scan->type == kSeqScan && table_store->partitioning().kind != kNoPartitions) {
+                    std::cout << " (partitions: " << table_store->partitionCount(&scan->partitions)
+                              << " of " << table_store->partitionCount() << ")";
+                }
+                size_t read = std::count(scan->columns.begin(), scan->columns.end(), true);
+                if (!scan->columns.empty() && read < scan->columns.size()) {
+                    std::cout << " (" << read << " of " << scan->columns.size() << " columns)";
+                }
+                break;
+            }
+            case kFilter: {
+                FilterPlan* filter = static_cast<FilterPlan*>(plan);
+                if (filter->program != nullptr) {
+                    std::cout << "Filter: " << ExprToString(filter->where);
+                    break;
+                }
+                std::cout << "Filter: " << filter->col->name << " = ";
+                if (filter->val->type == kExprLiteralString) {
+                    std::cout << "'" << filter->val->name << "'";
+                } else if (filter->val->type == kExprLiteralInt) {
+                    std::cout << filter->val->ival;
+                } else {
+                    std::cout << ExprTypeToString(filter->val->type);
+                }
+                break;
+            }
+            case kProjection: {
+                ProjectionPlan* projection = static_cast<ProjectionPlan*>(plan);
+                std::cout << "Projection: ";
+                for (size_t i = 0; i < projection->names.size(); i++) {
+                    std::cout << ((i == 0) ? "" : ", ") << projection->names[i];
+                }
+                break;
+            }
+            case kSort: {
+                SortPlan* sort = static_cast<SortPlan*>(plan);
+                std::cout << ((sort->limit > 0) ? "Top-N Sort: " : "Sort: ");
+                for (size_t i = 0; i < sort->keys.size(); i++) {
+                    std::cout << ((i == 0) ? "" : ", ") << sort->keys[i].col->name
+                              << (sort->keys[i].isAsc ? " ASC" : " DESC");
+                }
+                if (sort->limit > 0) {
+                    std::cout << " (first " << sort->limit << ")";
+                }
+                break;
+            }
+            case kLimit: {
+                LimitPlan* limit = static_cast<LimitPlan*>(plan);
+                std::cout << "Limit: offset " << limit->offset << ", limit " << limit->limit;
+                break;
+            }
+            case kJoin: {
+                JoinPlan* join = static_cast<JoinPlan*>(plan);
+                const char* algos[] = {"HashJoin", "IndexJoin", "MergeJoin"};
+                const char* kinds[] = {"inner", "left", "semi"};
+                std::cout << algos[join->algo] << " (" << kinds[join->kind] << "): ";
+                DescribeJoinKeys(join->leftKeys, "left");
+                std::cout << " = ";
+                DescribeJoinKeys(join->rightKeys, "right");
+                if (join->algo == kIndexJoin) {
+                    std::cout << " using " << join->index->name;
+                }
+                if (join->probeScan != nullptr) {
+                    std::cout << " (runtime filter)";
+                }
+                break;
+            }
+            case kTruncate: {
+                Table* table = static_cast<TruncatePlan*>(plan)->table;
+                std::cout << "Truncate " << TableNameToString(table->schema(), table->name());
+                break;
+            }
+            case kSelect:
+                std::cout << "Select: " << static_cast<SelectPlan*>(plan)->outCols.size()
+                          << " columns" << (RunFused(plan, profile) ? " (fused)" : "");
+                break;
+            default:
+                std::cout << PlanTypeToString(plan->planType);
+                break;
+        }
+    }
+
+    /*
+     * One line per operator, children indented below it. Times and counters
+     * of a profiled operator include its inputs, so its own share is what is
+     * left after subtracting them.
+     */
+    void Executor::printPlan(Plan* plan, int depth) {
+        std::vector<Plan*> children;
+        if (plan->next != nullptr) {
+            children.push_back(plan->next);
+        }
+        if (plan->planType == kJoin && static_cast<JoinPlan*>(plan)->algo != kIndexJoin) {
+            children.push_back(static_cast<JoinPlan*>(plan)->right);
+        }
+
+        std::cout << std::string(depth * 4, ' ') << ((depth == 0) ? "" : "-> ");
+        DescribePlan(plan, profile_);
+        std::cout << "  (rows=" << static_cast<uint64_t>(plan->estRows + 0.5) << ")";
+
+        auto iter = profiles_.find(plan);
+        if (iter != profiles_.end()) {
+            OperatorProfile self = iter->second;
+            uint64_t rows_in = 0;
+            for (auto child : children) {
+                // A child without an operator of its own has no profile.
+                auto found = profiles_.find(child);
+                if (found == profiles_.end()) {
+                    continue;
+                }
+                OperatorProfile& input = found->second;
+                rows_in += input.rows;
+                self.nanos -= input.nanos;
+                self.allocs -= input.allocs;
+                self.allocBytes -= input.allocBytes;
+                self.bytesRead -= input.bytesRead;
+            }
+
+            std::cout << std::fixed << std::setprecision(3) << "  (actual time="
+                      << iter->second.nanos / 1e6 << " ms self=" << self.nanos / 1e6
+                      << " ms rows_in=" << rows_in << " rows_out=" << iter->second.rows
+                      << " calls=" << iter->second.calls << " allocs=" << self.allocs
+                      << " alloc_bytes=" << self.allocBytes << " bytes_read=" << self.bytesRead
+                      << ")";
+            std::cout.unsetf(std::ios::fixed);
+        }
+        std::cout << std::endl;
+
+        // The inner side of an index join is read through the index, not by an operator.
+        if (plan->planType == kJoin && static_cast<JoinPlan*>(plan)->algo == kIndexJoin) {
+            std::cout << std::string((depth + 1) * 4, ' ') << "-> ";
+            DescribePlan(static_cast<JoinPlan*>(plan)->right, profile_);
+            std::cout << "  (probed)" << std::endl;
+        }
+
+        for (auto child : children) {
+            printPlan(child, depth + 1);
+        }
+    }
+
+    bool ProfileOperator::exec(TupleIter** iter) {
+        ProfileCounters before = g_profile_counters;
+        g_profile_counters.active = true;
+        auto start = std::chrono::steady_clock::now();
+        bool ret = op_->exec(iter);
+        auto end = std::chrono::steady_clock::now();
+        g_profile_counters.active = before.active;
+
+        profile_->calls++;
+        profile_->nanos +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        profile_->allocs += g_profile_counters.allocs - before.allocs;
+        profile_->allocBytes += g_profile_counters.allocBytes - before.allocBytes;
+        profile_->bytesRead += g_profile_counters.bytesRead - before.bytesRead;
+        if (iter != nullptr && *iter != nullptr) {
+            profile_->rows++;
+        }
+        return ret;
+    }
+
     bool CreateOperator::exec(TupleIter** iter) {
         CreatePlan* plan = static_cast<CreatePlan*>(plan_);
 
@@ -85,6 +359,8 @@ namespace mydb {
                 }
                 delete table;
             }
+            table->setTtl(plan->ttl);
+            table->getTableStore()->setPartitioning(plan->partitions);
 
             std::cout << "[BYDB-Info]  Create table successfully." << std::endl;
             return false;
@@ -109,9 +385,14 @@ namespace mydb {
             }
 
             index = new Index();
-            index->name = plan->indexName;
+            index->name = strdup(plan->indexName);
             index->columns = *plan->indexColumns;
-            table->addIndex(index);
+            if (table->addIndex(index)) {
+                std::cout << "[BYDB-Error]  Invalid columns for index " << plan->indexName
+                          << std::endl;
+                delete index;
+                return true;
+            }
             std::cout << "[BYDB-Info]  Create index successfully." << std::endl;
         } else {
             std::cout << "[BYDB-Error]  Invalid 'Show' statement." << std::endl;
@@ -188,22 +469,82 @@ namespace mydb {
         return false;
     }
 
+    /* Pull up to EXPR_BATCH_SIZE rows from 'op', setting *done once it has no more. */
+    static bool PullBatch(BaseOperator* op, std::vector<TupleIter*>* rows, bool* done) {
+        rows->clear();
+        while (rows->size() < EXPR_BATCH_SIZE) {
+            TupleIter* tup_iter = nullptr;
+            if (op->exec(&tup_iter)) {
+                return true;
+            }
+            if (tup_iter == nullptr) {
+                *done = true;
+                break;
+            }
+            rows->push_back(tup_iter);
+        }
+        return false;
+    }
+
+    /* Whether a value, literal or computed, can be stored in the column. */
+    static bool CheckColumnValue(ColumnDefinition* col_def, Expr* val) {
+        if (val->type == kExprLiteralInt && col_def->type.data_type == DataType::INT &&
+            (val->ival > INT32_MAX || val->ival < INT32_MIN)) {
+            std::cout << "[BYDB-Error]  The value " << val->ival
+                      << " exceed the limitation of INT32 for column " << col_def->name
+                      << std::endl;
+            return true;
+        }
+        if (val->type == kExprLiteralString &&
+            strlen(val->name) > static_cast<size_t>(col_def->type.length)) {
+            std::cout << "[BYDB-Error]  The value '" << val->name << "' is too long for column "
+                      << col_def->name << std::endl;
+            return true;
+        }
+        return false;
+    }
+
     bool UpdateOperator::exec(TupleIter** iter) {
         UpdatePlan* update = static_cast<UpdatePlan *>(plan_);
         Table *table = update->table;
         TableStore *table_store = table->getTableStore();
+        ExprProgram* program = update->program;
         int upd_cnt = 0;
+        table_store->thaw();
 
-        while (true) {
-            TupleIter* tup_iter = nullptr;
-            if (next_->exec(&tup_iter)) {
+        std::vector<ColumnDefinition*> cols;
+        for (size_t i = 0; i < update->idxs.size(); i++) {
+            cols.push_back((*table->columns())[update->idxs[i]]);
+            Expr* val;
+            if ((program == nullptr || program->isConst(i, &val)) &&
+                CheckColumnValue(cols[i], update->values[i])) {
                 return true;
             }
+        }
 
-            if (tup_iter == nullptr) {
-                break;
-            } else {
-                table_store->updateTuple(tup_iter->tup, update->idxs, update->values);
+        // Computed values are evaluated a batch of rows at a time before those rows change.
+        std::vector<TupleIter*> rows;
+        std::vector<Expr*> values(update->values);
+        bool done = false;
+        while (!done) {
+            if (PullBatch(next_, &rows, &done)) {
+                return true;
+            }
+            if (program != nullptr && !rows.empty()) {
+                program->eval(rows, 0, rows.size(), arena_);
+            }
+
+            for (size_t i = 0; i < rows.size(); i++) {
+                for (size_t j = 0; program != nullptr && j < values.size(); j++) {
+                    if (program->isConst(j, &values[j])) {
+                        continue;
+                    }
+                    values[j] = program->result(j, i, arena_);
+                    if (CheckColumnValue(cols[j], values[j])) {
+                        return true;
+                    }
+                }
+                table_store->updateTuple(rows[i]->tup, update->idxs, values);
                 upd_cnt++;
             }
         }
@@ -217,19 +558,22 @@ namespace mydb {
         Table *table = static_cast<DeletePlan *>(plan_)->table;
         TableStore *table_store = table->getTableStore();
         int del_cnt = 0;
+        table_store->thaw();
 
-        while (true) {
-            TupleIter* tup_iter = nullptr;
-            if (next_->exec(&tup_iter)) {
+        // Rows are read a batch ahead of the deletes, the scan has moved past all of them.
+        std::vector<TupleIter*> rows;
+        std::vector<Tuple*> tups;
+        bool done = false;
+        while (!done) {
+            if (PullBatch(next_, &rows, &done)) {
                 return true;
             }
-
-            if (tup_iter == nullptr) {
-                break;
-            } else {
-                table_store->deleteTuple(tup_iter->tup);
-                del_cnt++;
+            tups.clear();
+            for (auto row : rows) {
+                tups.push_back(row->tup);
             }
+            table_store->deleteTuples(tups);
+            del_cnt += tups.size();
         }
 
         std::cout << "[BYDB-Info]  Delete " << del_cnt << " tuple successfully." << std::endl;
@@ -299,6 +643,63 @@ namespace mydb {
         return false;
     }
 
+    bool AnalyzeOperator::exec(TupleIter** iter) {
+        AnalyzePlan* plan = static_cast<AnalyzePlan*>(plan_);
+        for (auto table : plan->tables) {
+            table->analyze();
+            TableStats* stats = table->stats();
+            std::cout << "# Statistics of " << TableNameToString(table->schema(), table->name())
+                      << ": " << stats->rowCount << " rows" << std::endl;
+            for (size_t i = 0; i < stats->columns.size(); i++) {
+                ColumnStats& col_stats = stats->columns[i];
+                std::cout << (*table->columns())[i]->name << "\tdistinct "
+                          << static_cast<uint64_t>(col_stats.distinct + 0.5) << "\tnulls "
+                          << col_stats.nullCount << "\tbuckets " << col_stats.bounds.size()
+                          << std::endl;
+            }
+        }
+
+        std::cout << "[BYDB-Info]  Analyze " << plan->tables.size() << " tables successfully."
+                  << std::endl;
+        return false;
+    }
+
+    bool MetricsOperator::exec(TupleIter** iter) {
+        PrintMetrics(std::cout);
+        if (DumpMetricsFile()) {
+            std::cout << "[BYDB-Error]  Failed to write the metrics file." << std::endl;
+            return true;
+        }
+        return false;
+    }
+
+    bool TruncateOperator::exec(TupleIter** iter) {
+        Table* table = static_cast<TruncatePlan*>(plan_)->table;
+        table->getTableStore()->truncate();
+        std::cout << "[BYDB-Info]  Truncate table "
+                  << TableNameToString(table->schema(), table->name()) << " successfully."
+                  << std::endl;
+        return false;
+    }
+
+    /* Its tuple groups are freed at once, there is no undo record to keep them for. */
+    bool DropPartitionOperator::exec(TupleIter** iter) {
+        DropPartitionPlan* plan = static_cast<DropPartitionPlan*>(plan_);
+        if (g_transaction.inTransaction()) {
+            std::cout << "[BYDB-Error]  Can not drop a partition inside a transaction."
+                      << std::endl;
+            return true;
+        }
+
+        uint64_t rows = 0;
+        if (plan->table->getTableStore()->dropPartition(plan->value, &rows)) {
+            return true;
+        }
+        std::cout << "[BYDB-Info]  Drop partition of " << ExprToString(plan->value) << " with "
+                  << rows << " rows successfully." << std::endl;
+        return false;
+    }
+
     bool SelectOperator::exec(TupleIter** iter) {
         SelectPlan* plan = static_cast<SelectPlan*>(plan_);
         std::vector<std::vector<Expr*>> tuples;
@@ -315,43 +716,144 @@ namespace mydb {
             }
         }
 
-        PrintTuples(plan->outCols, plan->colIds, tuples);
+        CountMetric(kMetricRowsReturned, tuples.size());
+        if (!plan->discard) {
+            PrintTuples(plan->outCols, plan->colIds, tuples);
+        }
         return false;
     }
 
+    /* Columns a scan has to decode, nullptr for all of them. */
+    static std::vector<bool>* ScanColumns(ScanPlan* plan) {
+        return plan->columns.empty() ? nullptr : &plan->columns;
+    }
+
+    /* Partition column values a scan has to read, nullptr for all of them. */
+    static PartitionBounds* ScanBounds(ScanPlan* plan) {
+        return plan->partitions.all() ? nullptr : &plan->partitions;
+    }
+
     bool SeqScanOperator::exec(TupleIter** iter) {
         ScanPlan* plan = static_cast<ScanPlan*>(plan_);
         TableStore* table_store = plan->table->getTableStore();
         Tuple* tup = nullptr;
+        *iter = nullptr;
 
         if (finish) {
-            return false;
+            return execCold(iter);
         }
 
         if (nextTuple_ == nullptr) {
-            tup = table_store->seqScan(nullptr);
+            tup = nextTuple(nullptr);
         } else {
             tup = nextTuple_;
         }
 
+        while (tup != nullptr && useRuntimeFilter()) {
+            bool has_null = false;
+            uint64_t hash = table_store->keyHash(tup, plan->runtimeKeys, &has_null);
+            if (!runtimeFiltered(hash, has_null)) {
+                break;
+            }
+            tup = nextTuple(tup);
+        }
+
         if (tup == nullptr) {
-            *iter = nullptr;
-            return false;
+            finish = true;
+            return execCold(iter);
         }
 
-        TupleIter* tup_iter = new TupleIter(tup);
-        table_store->parseTuple(tup, tup_iter->values);
-        tuples_.push_back(tup_iter);
+        TupleIter* tup_iter = arena_->create<TupleIter>(tup);
+        table_store->parseTuple(tup, tup_iter->values, arena_, ScanColumns(plan), skipped_);
+        g_profile_counters.bytesRead += table_store->tupleSize();
+        CountMetric(kMetricRowsScanned);
         *iter = tup_iter;
 
-        nextTuple_ = table_store->seqScan(tup);
+        nextTuple_ = nextTuple(tup);
         if (nextTuple_ == nullptr) {
             finish = true;
         }
         return false;
     }
 
+    Tuple* SeqScanOperator::nextTuple(Tuple* tup) {
+        ScanPlan* plan = static_cast<ScanPlan*>(plan_);
+        TableStore* table_store = plan->table->getTableStore();
+        if (filter_ == nullptr) {
+            return table_store->seqScan(tup, nullptr, ScanBounds(plan));
+        }
+        if (tup == nullptr) {
+            table_store->compilePredicate(filter_->idx, filter_->val, &pred_);
+        }
+        return table_store->seqScan(tup, &pred_, ScanBounds(plan));
+    }
+
+    bool SeqScanOperator::useRuntimeFilter() {
+        return !filterOff_ && static_cast<ScanPlan*>(plan_)->runtimeFilter != nullptr;
+    }
+
+    /* True if no build row of the probing join can have the join keys hashed to 'hash'. */
+    bool SeqScanOperator::runtimeFiltered(uint64_t hash, bool has_null) {
+        ScanPlan* plan = static_cast<ScanPlan*>(plan_);
+        filterChecked_++;
+        if (!has_null && plan->runtimeFilter->mayContain(hash)) {
+            // A filter letting nearly every row through costs more than it saves.
+            filterPassed_++;
+            if (filterChecked_ >= BLOOM_ADAPT_ROWS &&
+                filterPassed_ > filterChecked_ * BLOOM_MAX_PASS_RATIO) {
+                filterOff_ = true;
+            }
+            return false;
+        }
+
+        CountMetric(kMetricRuntimeFilteredRows);
+        return true;
+    }
+
+    /* Cold group rows come after the tuples, only the matching ones if there is a filter. */
+    bool SeqScanOperator::execCold(TupleIter** iter) {
+        ScanPlan* plan = static_cast<ScanPlan*>(plan_);
+        std::vector<ColdGroup*>& groups = plan->table->getTableStore()->coldGroups();
+        TupleIter* tup_iter = nullptr;
+
+        while (coldGroup_ < groups.size()) {
+            ColdGroup* group = groups[coldGroup_];
+            if (coldRow_ == 0 && filter_ != nullptr) {
+                matches_.clear();
+                group->matchEquals(filter_->idx, filter_->val, &matches_);
+            }
+
+            size_t end = (filter_ != nullptr) ? matches_.size() : group->rows();
+            if (coldRow_ < end) {
+                size_t row = (filter_ != nullptr) ? matches_[coldRow_] : coldRow_;
+                coldRow_++;
+                if (tup_iter == nullptr) {
+                    tup_iter = arena_->create<TupleIter>(nullptr);
+                }
+                tup_iter->values.clear();
+                group->decodeRow(row, tup_iter->values, arena_, ScanColumns(plan), skipped_);
+                if (useRuntimeFilter()) {
+                    bool has_null = false;
+                    uint64_t hash = HashKeys(tup_iter->values, plan->runtimeKeys, &has_null);
+                    if (runtimeFiltered(hash, has_null)) {
+                        continue;
+                    }
+                }
+                CountMetric(kMetricRowsScanned);
+                *iter = tup_iter;
+                return false;
+            }
+            coldGroup_++;
+            coldRow_ = 0;
+        }
+        return false;
+    }
+
     bool FilterOperator::exec(TupleIter** iter) {
+        if (static_cast<FilterPlan*>(plan_)->program != nullptr) {
+            return execProgram(iter);
+        }
+
         *iter = nullptr;
         while (true) {
             TupleIter* tup_iter = nullptr;
@@ -377,6 +879,12 @@ namespace mydb {
         Expr* val = filter->val;
         size_t col_id = filter->idx;
 
+        // Right above a scan the row is still a tuple of that table, compare in place.
+        if (filter->next->planType == kScan && iter->tup != nullptr) {
+            ScanPlan* scan = static_cast<ScanPlan*>(filter->next);
+            return scan->table->getTableStore()->columnEquals(iter->tup, col_id, val);
+        }
+
         Expr* col_val = iter->values[col_id];
         if (col_val->type != val->type) {
             return false;
@@ -393,4 +901,627 @@ namespace mydb {
         return false;
     }
 
+    bool FilterOperator::execProgram(TupleIter** iter) {
+        ExprProgram* program = static_cast<FilterPlan*>(plan_)->program;
+        *iter = nullptr;
+        while (pos_ == passed_.size()) {
+            if (done_) {
+                return false;
+            }
+            if (PullBatch(next_, &rows_, &done_)) {
+                return true;
+            }
+            passed_.clear();
+            pos_ = 0;
+            if (rows_.empty()) {
+                continue;
+            }
+
+            program->eval(rows_, 0, rows_.size(), arena_);
+            for (size_t i = 0; i < rows_.size(); i++) {
+                if (program->isTrue(0, i)) {
+                    passed_.push_back(rows_[i]);
+                }
+            }
+        }
+
+        *iter = passed_[pos_++];
+        return false;
+    }
+
+    /* Plain columns and literals of the select list are passed on as they are. */
+    bool ProjectionOperator::exec(TupleIter** iter) {
+        ExprProgram& program = static_cast<ProjectionPlan*>(plan_)->program;
+        *iter = nullptr;
+        if (pos_ == rows_.size()) {
+            if (done_) {
+                return false;
+            }
+            if (PullBatch(next_, &rows_, &done_)) {
+                return true;
+            }
+            pos_ = 0;
+            if (rows_.empty()) {
+                return false;
+            }
+
+            program.eval(rows_, 0, rows_.size(), arena_);
+            for (size_t i = 0; i < rows_.size(); i++) {
+                TupleIter* out = arena_->create<TupleIter>(nullptr);
+                out->values.resize(program.outputs());
+                for (size_t j = 0; j < program.outputs(); j++) {
+                    size_t idx;
+                    if (program.isColumn(j, &idx)) {
+                        out->values[j] = rows_[i]->values[idx];
+                    } else if (!program.isConst(j, &out->values[j])) {
+                        out->values[j] = program.result(j, i, arena_);
+                    }
+                }
+                rows_[i] = out;
+            }
+        }
+
+        *iter = rows_[pos_++];
+        return false;
+    }
+
+    PipelineOperator::PipelineOperator(Plan* plan, Arena* arena)
+            : BaseOperator(plan, nullptr, arena), scan_(nullptr), filter_(nullptr),
+              limit_(nullptr), projection_(nullptr), equals_(false), nextTuple_(nullptr),
+              coldGroup_(0), coldRow_(0), skipped_(arena->makeNullLiteral()) {
+        for (Plan* node = plan->next; node != nullptr; node = node->next) {
+            switch (node->planType) {
+                case kProjection:
+                    projection_ = static_cast<ProjectionPlan*>(node);
+                    break;
+                case kLimit:
+                    limit_ = static_cast<LimitPlan*>(node);
+                    break;
+                case kFilter:
+                    filter_ = static_cast<FilterPlan*>(node);
+                    break;
+                default:
+                    scan_ = static_cast<ScanPlan*>(node);
+                    break;
+            }
+        }
+        equals_ = filter_ != nullptr && filter_->program == nullptr;
+    }
+
+    /* Select <- [Projection] <- [Limit] <- [Filter] <- SeqScan, as the optimizer stacks them. */
+    bool PipelineOperator::fusible(SelectPlan* plan) {
+        Plan* node = plan->next;
+        if (node != nullptr && node->planType == kProjection) {
+            node = node->next;
+        }
+        if (node != nullptr && node->planType == kLimit) {
+            node = node->next;
+        }
+        if (node != nullptr && node->planType == kFilter) {
+            node = node->next;
+        }
+        return node != nullptr && node->planType == kScan && node->next == nullptr &&
+               static_cast<ScanPlan*>(node)->type == kSeqScan;
+    }
+
+    bool PipelineOperator::exec(TupleIter** iter) {
+        typedef void (PipelineOperator::*RunFunc)(std::vector<std::vector<Expr*>>&);
+        static const RunFunc kRuns[8] = {
+                &PipelineOperator::run<false, false, false>,
+                &PipelineOperator::run<false, false, true>,
+                &PipelineOperator::run<false, true, false>,
+                &PipelineOperator::run<false, true, true>,
+                &PipelineOperator::run<true, false, false>,
+                &PipelineOperator::run<true, false, true>,
+                &PipelineOperator::run<true, true, false>,
+                &PipelineOperator::run<true, true, true>};
+        SelectPlan* plan = static_cast<SelectPlan*>(plan_);
+        TableStore* table_store = scan_->table->getTableStore();
+
+        if (equals_) {
+            table_store->compilePredicate(filter_->idx, filter_->val, &pred_);
+        }
+        nextTuple_ = table_store->seqScan(nullptr, equals_ ? &pred_ : nullptr, ScanBounds(scan_));
+
+        std::vector<std::vector<Expr*>> tuples;
+        size_t variant = ((filter_ != nullptr && !equals_) ? 4 : 0) +
+                         ((limit_ != nullptr) ? 2 : 0) + ((projection_ != nullptr) ? 1 : 0);
+        (this->*kRuns[variant])(tuples);
+
+        CountMetric(kMetricFusedPipelines);
+        CountMetric(kMetricRowsReturned, tuples.size());
+        if (!plan->discard) {
+            PrintTuples(plan->outCols, plan->colIds, tuples);
+        }
+        return false;
+    }
+
+    template <bool kProgram, bool kLimit, bool kProject>
+    void PipelineOperator::run(std::vector<std::vector<Expr*>>& tuples) {
+        uint64_t skip = kLimit ? limit_->offset : 0;
+        uint64_t left = kLimit ? limit_->limit : UINT64_MAX;
+
+        // Where every output comes from: a row position, a literal or the program.
+        std::vector<size_t> columns;
+        std::vector<Expr*> consts;
+        bool computed = false;
+        if (kProject) {
+            ExprProgram& program = projection_->program;
+            columns.resize(program.outputs(), SIZE_MAX);
+            consts.resize(program.outputs(), nullptr);
+            for (size_t j = 0; j < program.outputs(); j++) {
+                size_t idx;
+                if (program.isColumn(j, &idx)) {
+                    columns[j] = idx;
+                } else if (!program.isConst(j, &consts[j])) {
+                    computed = true;
+                }
+            }
+        }
+
+        while (left > 0) {
+            // Without a filter the limit tells how many rows are still needed.
+            size_t want = EXPR_BATCH_SIZE;
+            if (kLimit && !kProgram && left < EXPR_BATCH_SIZE && skip < EXPR_BATCH_SIZE - left) {
+                want = skip + left;
+            }
+            size_t n = scanBatch(want);
+            if (n == 0) {
+                break;
+            }
+
+            std::vector<TupleIter*>* batch = &rows_;
+            if (kProgram) {
+                ExprProgram* program = filter_->program;
+                program->eval(rows_, 0, n, arena_);
+                passed_.clear();
+                for (size_t i = 0; i < n; i++) {
+                    if (program->isTrue(0, i)) {
+                        passed_.push_back(rows_[i]);
+                    }
+                }
+                batch = &passed_;
+                n = passed_.size();
+            }
+
+            size_t begin = 0;
+            if (kLimit) {
+                begin = std::min<uint64_t>(skip, n);
+                skip -= begin;
+                n = begin + std::min<uint64_t>(n - begin, left);
+                left -= n - begin;
+            }
+            if (begin == n) {
+                continue;
+            }
+
+            if (!kProject) {
+                for (size_t i = begin; i < n; i++) {
+                    tuples.push_back((*batch)[i]->values);
+                }
+                continue;
+            }
+
+            ExprProgram& program = projection_->program;
+            if (computed) {
+                program.eval(*batch, begin, n, arena_);
+            }
+            for (size_t i = begin; i < n; i++) {
+                tuples.push_back(consts);
+                std::vector<Expr*>& out = tuples.back();
+                for (size_t j = 0; j < out.size(); j++) {
+                    if (columns[j] != SIZE_MAX) {
+                        out[j] = (*batch)[i]->values[columns[j]];
+                    } else if (out[j] == nullptr) {
+                        out[j] = program.result(j, i - begin, arena_);
+                    }
+                }
+            }
+        }
+    }
+
+    /* Parse up to 'want' more rows into rows_, the tuples before the cold groups; 0 at the end. */
+    size_t PipelineOperator::scanBatch(size_t want) {
+        TableStore* table_store = scan_->table->getTableStore();
+        std::vector<bool>* cols = ScanColumns(scan_);
+        size_t n = 0;
+
+        while (n < want && nextTuple_ != nullptr) {
+            TupleIter* row = batchRow(n++);
+            row->tup = nextTuple_;
+            table_store->parseTuple(nextTuple_, row->values, arena_, cols, skipped_);
+            nextTuple_ = table_store->seqScan(nextTuple_, equals_ ? &pred_ : nullptr,
+                                              ScanBounds(scan_));
+        }
+        g_profile_counters.bytesRead += n * table_store->tupleSize();
+
+        std::vector<ColdGroup*>& groups = table_store->coldGroups();
+        while (n < want && coldGroup_ < groups.size()) {
+            ColdGroup* group = groups[coldGroup_];
+            if (coldRow_ == 0 && equals_) {
+                matches_.clear();
+                group->matchEquals(filter_->idx, filter_->val, &matches_);
+            }
+
+            size_t end = equals_ ? matches_.size() : group->rows();
+            for (; n < want && coldRow_ < end; coldRow_++) {
+                TupleIter* row = batchRow(n++);
+                row->tup = nullptr;
+                group->decodeRow(equals_ ? matches_[coldRow_] : coldRow_, row->values, arena_,
+                                 cols, skipped_);
+            }
+            if (coldRow_ == end) {
+                coldGroup_++;
+                coldRow_ = 0;
+            }
+        }
+
+        CountMetric(kMetricRowsScanned, n);
+        return n;
+    }
+
+    TupleIter* PipelineOperator::batchRow(size_t n) {
+        if (n == rows_.size()) {
+            rows_.push_back(arena_->create<TupleIter>(nullptr));
+        }
+        rows_[n]->values.clear();
+        return rows_[n];
+    }
+
+    bool SortOperator::exec(TupleIter** iter) {
+        *iter = nullptr;
+        if (!sorted_) {
+            if (sortInput()) {
+                return true;
+            }
+            sorted_ = true;
+        }
+
+        TupleIter* tup_iter = arena_->create<TupleIter>(nullptr);
+        bool eof = false;
+        if (sorter_->getNext(tup_iter->values, &eof, arena_)) {
+            return true;
+        }
+        if (eof) {
+            return false;
+        }
+
+        *iter = tup_iter;
+        return false;
+    }
+
+    bool SortOperator::sortInput() {
+        SortPlan* plan = static_cast<SortPlan*>(plan_);
+        sorter_ = arena_->create<Sorter>(plan->keys, SORT_MEMORY_LIMIT, plan->limit);
+
+        while (true) {
+            TupleIter* tup_iter = nullptr;
+            if (next_->exec(&tup_iter)) {
+                return true;
+            }
+
+            if (tup_iter == nullptr) {
+                break;
+            }
+
+            if (sorter_->addRow(tup_iter->values)) {
+                return true;
+            }
+        }
+
+        return sorter_->finish();
+    }
+
+    /* Stop pulling from the child once enough rows were returned, so the scan below ends early. */
+    bool LimitOperator::exec(TupleIter** iter) {
+        LimitPlan* plan = static_cast<LimitPlan*>(plan_);
+        *iter = nullptr;
+
+        while (count_ < plan->offset) {
+            TupleIter* tup_iter = nullptr;
+            if (next_->exec(&tup_iter)) {
+                return true;
+            }
+            if (tup_iter == nullptr) {
+                return false;
+            }
+            count_++;
+        }
+
+        if (count_ - plan->offset >= plan->limit) {
+            return false;
+        }
+
+        if (next_->exec(iter)) {
+            return true;
+        }
+        if (*iter != nullptr) {
+            count_++;
+        }
+        return false;
+    }
+
+    bool IndexScanOperator::exec(TupleIter** iter) {
+        ScanPlan* plan = static_cast<ScanPlan*>(plan_);
+        TableStore* table_store = plan->table->getTableStore();
+        IndexMap& entries = plan->index->entries;
+        *iter = nullptr;
+
+        if (!started_) {
+            if (plan->lookup) {
+                auto range = plan->index->equalRange(plan->key);
+                pos_ = range.first;
+                end_ = range.second;
+            } else {
+                pos_ = entries.begin();
+                end_ = entries.end();
+            }
+            started_ = true;
+        }
+        if (pos_ == end_) {
+            return false;
+        }
+
+        TupleIter* tup_iter = arena_->create<TupleIter>(pos_->second);
+        table_store->parseTuple(pos_->second, tup_iter->values, arena_, ScanColumns(plan),
+                                skipped_);
+        g_profile_counters.bytesRead += table_store->tupleSize();
+        CountMetric(kMetricRowsScanned);
+        *iter = tup_iter;
+        ++pos_;
+        return false;
+    }
+
+    JoinOperator::JoinOperator(Plan* plan, BaseOperator* next, Arena* arena)
+            : BaseOperator(plan, next, arena), done_(false), pos_(0) {
+        JoinPlan* join_plan = static_cast<JoinPlan*>(plan);
+        for (size_t i = 0; i < join_plan->rightWidth; i++) {
+            nulls_.push_back(arena->makeNullLiteral());
+        }
+    }
+
+    bool JoinOperator::exec(TupleIter** iter) {
+        *iter = nullptr;
+        while (pos_ >= out_.size()) {
+            if (done_) {
+                return false;
+            }
+            out_.clear();
+            pos_ = 0;
+            if (fillOutput()) {
+                return true;
+            }
+        }
+
+        *iter = out_[pos_++];
+        return false;
+    }
+
+    /* Output 'left' joined with 'right' (NULLs if there is none), or only 'left' for a semi join. */
+    void JoinOperator::emitRow(TupleIter* left, TupleIter* right) {
+        JoinPlan* plan = static_cast<JoinPlan*>(plan_);
+        if (plan->kind == kSemiJoin) {
+            out_.push_back(left);
+            return;
+        }
+
+        // Joined rows only borrow the values of their input rows.
+        TupleIter* tup_iter = arena_->create<TupleIter>(nullptr);
+        std::vector<Expr*>& right_values = (right == nullptr) ? nulls_ : right->values;
+        tup_iter->values.reserve(left->values.size() + right_values.size());
+        tup_iter->values.insert(tup_iter->values.end(), left->values.begin(), left->values.end());
+        tup_iter->values.insert(tup_iter->values.end(), right_values.begin(), right_values.end());
+        out_.push_back(tup_iter);
+    }
+
+    bool HashJoinOperator::fillOutput() {
+        if (table_ == nullptr && buildTable()) {
+            return true;
+        }
+
+        JoinPlan* plan = static_cast<JoinPlan*>(plan_);
+        std::vector<TupleIter*> batch;
+        std::vector<uint64_t> hashes;
+        std::vector<bool> has_nulls;
+
+        // Pull a batch of probe rows and hash them up front.
+        while (batch.size() < JOIN_PROBE_BATCH) {
+            TupleIter* tup_iter = nullptr;
+            if (next_->exec(&tup_iter)) {
+                return true;
+            }
+
+            if (tup_iter == nullptr) {
+                done_ = true;
+                break;
+            }
+
+            bool has_null = false;
+            batch.push_back(tup_iter);
+            hashes.push_back(HashKeys(tup_iter->values, plan->leftKeys, &has_null));
+            has_nulls.push_back(has_null);
+        }
+
+        // With a partitioned build side, probe the batch partition by partition
+        // so lookups stay within one cache-sized table at a time.
+        std::vector<size_t> order(batch.size());
+        if (table_->radixBits() > 0) {
+            std::vector<size_t> count(table_->partitionCount() + 1, 0);
+            for (auto hash : hashes) {
+                count[table_->partitionOf(hash) + 1]++;
+            }
+            for (size_t p = 1; p < count.size(); p++) {
+                count[p] += count[p - 1];
+            }
+            for (size_t i = 0; i < batch.size(); i++) {
+                order[count[table_->partitionOf(hashes[i])]++] = i;
+            }
+        } else {
+            for (size_t i = 0; i < batch.size(); i++) {
+                order[i] = i;
+            }
+        }
+
+        for (auto i : order) {
+            TupleIter* left = batch[i];
+            int64_t pos = -1;
+            if (!has_nulls[i]) {
+                pos = table_->findFirst(hashes[i], left->values, plan->leftKeys);
+            }
+
+            if (pos < 0) {
+                if (plan->kind == kLeftJoin) {
+                    emitRow(left, nullptr);
+                }
+                continue;
+            }
+
+            while (pos >= 0) {
+                emitRow(left, table_->row(pos));
+                if (plan->kind == kSemiJoin) {
+                    break;
+                }
+                pos = table_->findNext(pos, hashes[i], left->values, plan->leftKeys);
+            }
+        }
+
+        return false;
+    }
+
+    bool HashJoinOperator::buildTable() {
+        JoinPlan* plan = static_cast<JoinPlan*>(plan_);
+        table_ = arena_->create<JoinHashTable>(plan->rightKeys);
+
+        while (true) {
+            TupleIter* tup_iter = nullptr;
+            if (build_->exec(&tup_iter)) {
+                return true;
+            }
+
+            if (tup_iter == nullptr) {
+                break;
+            }
+            table_->addRow(tup_iter);
+        }
+
+        table_->build();
+
+        // Hand the build keys to the probe side scan before it reads its first row.
+        if (plan->probeScan != nullptr) {
+            BloomFilter* bloom = arena_->create<BloomFilter>(table_->size());
+            for (auto hash : table_->hashes()) {
+                bloom->add(hash);
+            }
+            plan->probeScan->runtimeFilter = bloom;
+            plan->probeScan->runtimeKeys = plan->leftKeys;
+        }
+        return false;
+    }
+
+    bool IndexJoinOperator::fillOutput() {
+        JoinPlan* plan = static_cast<JoinPlan*>(plan_);
+        ScanPlan* scan = static_cast<ScanPlan*>(plan->right);
+        TableStore* table_store = scan->table->getTableStore();
+
+        TupleIter* left = nullptr;
+        if (next_->exec(&left)) {
+            return true;
+        }
+        if (left == nullptr) {
+            done_ = true;
+            return false;
+        }
+
+        std::string key;
+        bool matched = false;
+        if (!plan->index->makeKey(left->values, plan->leftKeys, &key)) {
+            auto range = plan->index->equalRange(key);
+            for (auto entry = range.first; entry != range.second; ++entry) {
+                matched = true;
+                if (plan->kind == kSemiJoin) {
+                    emitRow(left, nullptr);
+                    break;
+                }
+
+                TupleIter* right = arena_->create<TupleIter>(entry->second);
+                table_store->parseTuple(entry->second, right->values, arena_, ScanColumns(scan),
+                                        skipped_);
+                g_profile_counters.bytesRead += table_store->tupleSize();
+                CountMetric(kMetricRowsScanned);
+                emitRow(left, right);
+            }
+        }
+
+        if (!matched && plan->kind == kLeftJoin) {
+            emitRow(left, nullptr);
+        }
+        return false;
+    }
+
+    /*
+     * Both inputs arrive ordered by the join keys. Right rows with the same
+     * key are kept as a group, so runs of equal left keys reuse it.
+     */
+    bool MergeJoinOperator::fillOutput() {
+        JoinPlan* plan = static_cast<JoinPlan*>(plan_);
+        if (!started_) {
+            if (right_->exec(&nextRight_)) {
+                return true;
+            }
+            started_ = true;
+        }
+
+        TupleIter* left = nullptr;
+        if (next_->exec(&left)) {
+            return true;
+        }
+        if (left == nullptr) {
+            done_ = true;
+            return false;
+        }
+
+        if (HasNullKey(left->values, plan->leftKeys)) {
+            if (plan->kind == kLeftJoin) {
+                emitRow(left, nullptr);
+            }
+            return false;
+        }
+
+        if (group_.empty() ||
+            CompareKeys(left->values, plan->leftKeys, group_[0]->values, plan->rightKeys) != 0) {
+            group_.clear();
+            while (nextRight_ != nullptr &&
+                   (HasNullKey(nextRight_->values, plan->rightKeys) ||
+                    CompareKeys(left->values, plan->leftKeys, nextRight_->values,
+                                plan->rightKeys) > 0)) {
+                if (right_->exec(&nextRight_)) {
+                    return true;
+                }
+            }
+            while (nextRight_ != nullptr &&
+                   CompareKeys(left->values, plan->leftKeys, nextRight_->values,
+                               plan->rightKeys) == 0) {
+                group_.push_back(nextRight_);
+                if (right_->exec(&nextRight_)) {
+                    return true;
+                }
+            }
+        }
+
+        if (group_.empty()) {
+            if (plan->kind == kLeftJoin) {
+                emitRow(left, nullptr);
+            }
+            return false;
+        }
+
+        for (auto right : group_) {
+            emitRow(left, right);
+            if (plan->kind == kSemiJoin) {
+                break;
+            }
+        }
+        return false;
+    }
+
 }
\ No newline at end of file
@@ -1,125 +1,376 @@
+#pragma once
+
+#include "arena.h"
+#include "join.h"
 #include "optimizer.h"
+#include "profile.h"
+
+#include <unordered_map>
 
 namespace mydb {
 
+/* Environment variable, "0" runs every SELECT as a chain of operators, see PipelineOperator. */
+#define PIPELINE_ENV "MYDB_PIPELINE"
+
+    /* A row passed between operators, allocated with its values in the statement's arena. */
     struct TupleIter {
         TupleIter(Tuple* t) : tup(t) {}
-        ~TupleIter() {
-            for (auto expr : values) {
-                delete expr;
-            }
-        }
 
         Tuple* tup;
         std::vector<Expr*> values;
     };
 
+    /* Operators and the rows they produce are owned by the arena of the statement. */
     class BaseOperator {
     public:
-        BaseOperator(Plan* plan, BaseOperator* next) : plan_(plan), next_(next) {}
-        virtual ~BaseOperator() {
-            delete next_;
-        }
+        BaseOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : plan_(plan), next_(next), arena_(arena) {}
+        virtual ~BaseOperator() {}
         virtual bool exec(TupleIter** iter = nullptr) = 0;
 
         Plan* plan_;
         BaseOperator* next_;
+        Arena* arena_;
     };
 
     class CreateOperator : public BaseOperator {
     public:
-        CreateOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next) {}
+        CreateOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
         ~CreateOperator() {}
         bool exec(TupleIter** iter = nullptr) override;
     };
 
     class DropOperator : public BaseOperator {
     public:
-        DropOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next) {}
+        DropOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
         ~DropOperator() {}
         bool exec(TupleIter** iter = nullptr) override;
     };
 
     class InsertOperator : public BaseOperator {
     public:
-        InsertOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next) {}
+        InsertOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
         ~InsertOperator() {}
         bool exec(TupleIter** iter = nullptr) override;
     };
 
     class UpdateOperator : public BaseOperator {
     public:
-        UpdateOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next) {}
+        UpdateOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
         ~UpdateOperator() {}
         bool exec(TupleIter** iter = nullptr) override;
     };
 
     class DeleteOperator : public BaseOperator {
     public:
-        DeleteOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next) {}
+        DeleteOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
         ~DeleteOperator() {}
         bool exec(TupleIter** iter = nullptr) override;
     };
 
     class TrxOperator : public BaseOperator {
     public:
-        TrxOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next) {}
+        TrxOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
         ~TrxOperator() {}
         bool exec(TupleIter** iter = nullptr) override;
     };
 
     class ShowOperator : public BaseOperator {
     public:
-        ShowOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next) {}
+        ShowOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
         ~ShowOperator() {}
         bool exec(TupleIter** iter = nullptr) override;
     };
 
+    class AnalyzeOperator : public BaseOperator {
+    public:
+        AnalyzeOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
+        ~AnalyzeOperator() {}
+        bool exec(TupleIter** iter = nullptr) override;
+    };
+
+    class MetricsOperator : public BaseOperator {
+    public:
+        MetricsOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
+        ~MetricsOperator() {}
+        bool exec(TupleIter** iter = nullptr) override;
+    };
+
+    class TruncateOperator : public BaseOperator {
+    public:
+        TruncateOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
+        ~TruncateOperator() {}
+        bool exec(TupleIter** iter = nullptr) override;
+    };
+
+    class DropPartitionOperator : public BaseOperator {
+    public:
+        DropPartitionOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
+        ~DropPartitionOperator() {}
+        bool exec(TupleIter** iter = nullptr) override;
+    };
+
     class SelectOperator : public BaseOperator {
     public:
-        SelectOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next) {}
+        SelectOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena) {}
         ~SelectOperator() {}
         bool exec(TupleIter** iter = nullptr) override;
     };
 
+    /*
+     * SELECT reading one table sequentially through at most a filter, a limit
+     * and a projection, fused into one loop instead of a chain of operators:
+     * tuples are parsed in batches into a reused set of rows, the filter and
+     * the projection are evaluated over each batch and the results go
+     * straight to the output. The loop is instantiated for every combination
+     * of the optional steps, so none of them costs a branch per row.
+     */
+    class PipelineOperator : public BaseOperator {
+    public:
+        PipelineOperator(Plan* plan, Arena* arena);
+        ~PipelineOperator() {}
+        bool exec(TupleIter** iter = nullptr) override;
+
+        /* Whether the plan below 'plan' has the shape run by this operator. */
+        static bool fusible(SelectPlan* plan);
+
+    private:
+        template <bool kProgram, bool kLimit, bool kProject>
+        void run(std::vector<std::vector<Expr*>>& tuples);
+        size_t scanBatch(size_t want);
+        TupleIter* batchRow(size_t n);
+
+        ScanPlan* scan_;
+        FilterPlan* filter_;
+        LimitPlan* limit_;
+        ProjectionPlan* projection_;
+        /* Equality filter applied by the scan, as SeqScanOperator does. */
+        bool equals_;
+        ScanPredicate pred_;
+        Tuple* nextTuple_;
+        size_t coldGroup_;
+        size_t coldRow_;
+        std::vector<uint32_t> matches_;
+        Expr* skipped_;
+        /* Rows of the current batch, allocated once and refilled. */
+        std::vector<TupleIter*> rows_;
+        std::vector<TupleIter*> passed_;
+    };
+
     class SeqScanOperator : public BaseOperator {
     public:
-        SeqScanOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next), finish(false), nextTuple_(nullptr) {}
-        ~SeqScanOperator() {
-            for (auto iter : tuples_) {
-                delete iter;
-            }
-        }
+        SeqScanOperator(Plan* plan, BaseOperator* next, FilterPlan* filter, Arena* arena)
+                : BaseOperator(plan, next, arena), finish(false), nextTuple_(nullptr),
+                  filter_(filter), coldGroup_(0), coldRow_(0), filterOff_(false),
+                  filterChecked_(0), filterPassed_(0), skipped_(arena->makeNullLiteral()) {}
+        ~SeqScanOperator() {}
         bool exec(TupleIter** iter = nullptr) override;
 
     private:
+        bool execCold(TupleIter** iter);
+        Tuple* nextTuple(Tuple* tup);
+        bool useRuntimeFilter();
+        bool runtimeFiltered(uint64_t hash, bool has_null);
+
         bool finish;
         Tuple* nextTuple_;
-        std::vector<TupleIter*> tuples_;
+        /*
+         * Equality filter right above, applied by the scan itself: as pred_
+         * to the tuples and to the codes of cold groups.
+         */
+        FilterPlan* filter_;
+        ScanPredicate pred_;
+        size_t coldGroup_;
+        size_t coldRow_;
+        std::vector<uint32_t> matches_;
+        /* Runtime filter of the hash join probing this scan, see ScanPlan::runtimeFilter. */
+        bool filterOff_;
+        uint64_t filterChecked_;
+        uint64_t filterPassed_;
+        /* Stands for the columns nothing above the scan reads, see ScanPlan::columns. */
+        Expr* skipped_;
     };
 
     class FilterOperator : public BaseOperator {
     public:
-        FilterOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next) {}
+        FilterOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena), done_(false), pos_(0) {}
         ~FilterOperator() {}
         bool exec(TupleIter** iter = nullptr) override;
 
     private:
         bool execEqualExpr(TupleIter* iter);
+        bool execProgram(TupleIter** iter);
+
+        /* A condition program is evaluated over batches of input rows, 'passed_' of them passed. */
+        bool done_;
+        size_t pos_;
+        std::vector<TupleIter*> rows_;
+        std::vector<TupleIter*> passed_;
+    };
+
+    class ProjectionOperator : public BaseOperator {
+    public:
+        ProjectionOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena), done_(false), pos_(0) {}
+        ~ProjectionOperator() {}
+        bool exec(TupleIter** iter = nullptr) override;
+
+    private:
+        bool done_;
+        size_t pos_;
+        std::vector<TupleIter*> rows_;
+    };
+
+    class SortOperator : public BaseOperator {
+    public:
+        SortOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena), sorted_(false), sorter_(nullptr) {}
+        ~SortOperator() {}
+        bool exec(TupleIter** iter = nullptr) override;
+
+    private:
+        bool sortInput();
+
+        bool sorted_;
+        Sorter* sorter_;
+    };
+
+    class LimitOperator : public BaseOperator {
+    public:
+        LimitOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena), count_(0) {}
+        ~LimitOperator() {}
+        bool exec(TupleIter** iter = nullptr) override;
+
+    private:
+        uint64_t count_;
+    };
+
+    class IndexScanOperator : public BaseOperator {
+    public:
+        IndexScanOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : BaseOperator(plan, next, arena), started_(false),
+                  skipped_(arena->makeNullLiteral()) {}
+        ~IndexScanOperator() {}
+        bool exec(TupleIter** iter = nullptr) override;
+
+    private:
+        bool started_;
+        Expr* skipped_;
+        IndexMap::iterator pos_;
+        IndexMap::iterator end_;
+    };
+
+    /* Common output handling of the join operators: rows are produced in small batches. */
+    class JoinOperator : public BaseOperator {
+    public:
+        JoinOperator(Plan* plan, BaseOperator* next, Arena* arena);
+        ~JoinOperator() {}
+        bool exec(TupleIter** iter = nullptr) override;
+
+    protected:
+        /* Append the next joined rows to out_ and set done_ once the left input is drained. */
+        virtual bool fillOutput() = 0;
+        void emitRow(TupleIter* left, TupleIter* right);
+
+        bool done_;
+        std::vector<Expr*> nulls_;
+        std::vector<TupleIter*> out_;
+        size_t pos_;
+    };
+
+    class HashJoinOperator : public JoinOperator {
+    public:
+        HashJoinOperator(Plan* plan, BaseOperator* next, BaseOperator* build, Arena* arena)
+                : JoinOperator(plan, next, arena), build_(build), table_(nullptr) {}
+        ~HashJoinOperator() {}
+
+    protected:
+        bool fillOutput() override;
+
+    private:
+        bool buildTable();
+
+        BaseOperator* build_;
+        JoinHashTable* table_;
+    };
+
+    class IndexJoinOperator : public JoinOperator {
+    public:
+        IndexJoinOperator(Plan* plan, BaseOperator* next, Arena* arena)
+                : JoinOperator(plan, next, arena), skipped_(arena->makeNullLiteral()) {}
+        ~IndexJoinOperator() {}
+
+    protected:
+        bool fillOutput() override;
+
+    private:
+        Expr* skipped_;
+    };
+
+    class MergeJoinOperator : public JoinOperator {
+    public:
+        MergeJoinOperator(Plan* plan, BaseOperator* next, BaseOperator* right, Arena* arena)
+                : JoinOperator(plan, next, arena), right_(right), started_(false),
+                  nextRight_(nullptr) {}
+        ~MergeJoinOperator() {}
+
+    protected:
+        bool fillOutput() override;
+
+    private:
+        BaseOperator* right_;
+        bool started_;
+        TupleIter* nextRight_;
+        std::vector<TupleIter*> group_;
+    };
+
+    /* Wraps an operator to measure its calls for EXPLAIN ANALYZE. */
+    class ProfileOperator : public BaseOperator {
+    public:
+        ProfileOperator(Plan* plan, BaseOperator* op, OperatorProfile* profile, Arena* arena)
+                : BaseOperator(plan, nullptr, arena), op_(op), profile_(profile) {}
+        ~ProfileOperator() {}
+        bool exec(TupleIter** iter = nullptr) override;
+
+    private:
+        BaseOperator* op_;
+        OperatorProfile* profile_;
     };
 
     class Executor {
     public:
-        Executor(Plan* plan) : planTree_(plan) {}
+        Executor(Plan* plan, Arena* arena)
+                : planTree_(plan), opTree_(nullptr), arena_(arena), profile_(false) {}
         ~Executor() {}
         void init();
         bool exec();
 
+        /* Print the plan tree; with 'analyze' run it first and add what every operator did. */
+        bool explain(bool analyze);
+
     private:
-        BaseOperator* generateOperator(Plan* Plan);
+        BaseOperator* generateOperator(Plan* plan, Plan* parent = nullptr);
+        void printPlan(Plan* plan, int depth);
 
         Plan* planTree_;
         BaseOperator* opTree_;
+        Arena* arena_;
+        bool profile_;
+        std::unordered_map<Plan*, OperatorProfile> profiles_;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,861 @@
+#include "expression.h"
+#include "executor.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <strings.h>
+
+namespace mydb {
+
+/* Longest text of a 64-bit integer, and the width printed for a NULL. */
+#define EVAL_INT_WIDTH 20
+#define EVAL_NULL_WIDTH 4
+
+    static const char* EvalTypeName(EvalType type) {
+        static const char* names[] = {"NULL", "BOOLEAN", "INT", "STRING"};
+        return names[type];
+    }
+
+    /* The type of values of both 'type' and 'other', false if there is none. */
+    static bool UnifyType(EvalType* type, EvalType other) {
+        if (other == kEvalNull || other == *type) {
+            return true;
+        }
+        if (*type == kEvalNull) {
+            *type = other;
+            return true;
+        }
+        if ((*type == kEvalInt && other == kEvalBool) ||
+            (*type == kEvalBool && other == kEvalInt)) {
+            *type = kEvalInt;
+            return true;
+        }
+        return false;
+    }
+
+    static void InvalidTypes(Expr* expr, EvalType type1, EvalType type2) {
+        std::cout << "[BYDB-Error]  Invalid operand types " << EvalTypeName(type1) << " and "
+                  << EvalTypeName(type2) << " in " << ExprToString(expr) << std::endl;
+    }
+
+    static void LoadValue(EvalValue* value, Expr* expr) {
+        value->null = (expr == nullptr || expr->type == kExprLiteralNull);
+        value->ival = 0;
+        if (value->null) {
+            return;
+        }
+        if (expr->type == kExprLiteralString) {
+            value->str = expr->name;
+            value->len = strlen(expr->name);
+        } else {
+            value->ival = expr->ival;
+        }
+    }
+
+    static bool CompareResult(int64_t op, int cmp) {
+        switch (op) {
+            case kOpEquals:
+                return cmp == 0;
+            case kOpNotEquals:
+                return cmp != 0;
+            case kOpLess:
+                return cmp < 0;
+            case kOpLessEq:
+                return cmp <= 0;
+            case kOpGreater:
+                return cmp > 0;
+            default:
+                return cmp >= 0;
+        }
+    }
+
+    static int CompareStrings(EvalValue& a, EvalValue& b) {
+        int cmp = memcmp(a.str, b.str, std::min(a.len, b.len));
+        if (cmp != 0) {
+            return cmp;
+        }
+        return (a.len < b.len) ? -1 : (a.len > b.len);
+    }
+
+    /* Decimal integer with an optional sign and nothing else, false if malformed or too large. */
+    static bool ParseInt(const char* str, size_t len, int64_t* val) {
+        size_t pos = 0;
+        bool neg = false;
+        if (pos < len && (str[pos] == '-' || str[pos] == '+')) {
+            neg = (str[pos] == '-');
+            pos++;
+        }
+        if (pos == len) {
+            return false;
+        }
+
+        // Accumulate negatively so that INT64_MIN fits.
+        int64_t result = 0;
+        for (; pos < len; pos++) {
+            if (!isdigit(static_cast<unsigned char>(str[pos])) ||
+                __builtin_mul_overflow(result, 10, &result) ||
+                __builtin_sub_overflow(result, str[pos] - '0', &result)) {
+                return false;
+            }
+        }
+        if (!neg && __builtin_mul_overflow(result, -1, &result)) {
+            return false;
+        }
+        *val = result;
+        return true;
+    }
+
+    bool ExprProgram::addOutput(Expr* expr, std::vector<TableScope>& scopes) {
+        size_t reg;
+        if (compile(expr, scopes, &reg)) {
+            return true;
+        }
+        outputs_.push_back(reg);
+        return false;
+    }
+
+    void ExprProgram::addColumn(size_t idx, ColumnDefinition* col_def) {
+        outputs_.push_back(emitColumn(idx, col_def));
+    }
+
+    size_t ExprProgram::emitColumn(size_t idx, ColumnDefinition* col_def) {
+        DataType type = col_def->type.data_type;
+        if (type == DataType::INT || type == DataType::LONG) {
+            return emit(kEvalColumn, kEvalInt, EVAL_INT_WIDTH, kNoReg, kNoReg, kNoReg, idx);
+        }
+        return emit(kEvalColumn, kEvalString, col_def->type.length, kNoReg, kNoReg, kNoReg, idx);
+    }
+
+    /* Registers are only written by the instruction that created them, code_[reg]. */
+    size_t ExprProgram::emit(EvalOp op, EvalType type, size_t width, size_t a, size_t b,
+                             size_t c, int64_t arg) {
+        size_t dst = regTypes_.size();
+        regTypes_.push_back(type);
+        regWidths_.push_back(width);
+        code_.push_back(EvalInstr{op, dst, a, b, c, arg});
+        return dst;
+    }
+
+    bool ExprProgram::isConst(size_t out, Expr** val) {
+        EvalInstr& ins = code_[outputs_[out]];
+        if (ins.op != kEvalConst || ins.arg < 0) {
+            return false;
+        }
+        *val = consts_[ins.arg];
+        return true;
+    }
+
+    bool ExprProgram::isColumn(size_t out, size_t* idx) {
+        EvalInstr& ins = code_[outputs_[out]];
+        if (ins.op != kEvalColumn) {
+            return false;
+        }
+        *idx = ins.arg;
+        return true;
+    }
+
+    void ExprProgram::markColumns(std::vector<bool>& needed) {
+        for (auto& ins : code_) {
+            if (ins.op == kEvalColumn) {
+                needed[ins.arg] = true;
+            }
+        }
+    }
+
+    bool ExprProgram::compile(Expr* expr, std::vector<TableScope>& scopes, size_t* reg) {
+        switch (expr->type) {
+            case kExprLiteralInt:
+                consts_.push_back(expr);
+                *reg = emit(kEvalConst, expr->isBoolLiteral ? kEvalBool : kEvalInt, EVAL_INT_WIDTH,
+                            kNoReg, kNoReg, kNoReg, consts_.size() - 1);
+                return false;
+            case kExprLiteralString:
+                consts_.push_back(expr);
+                *reg = emit(kEvalConst, kEvalString, strlen(expr->name), kNoReg, kNoReg, kNoReg,
+                            consts_.size() - 1);
+                return false;
+            case kExprLiteralNull:
+                consts_.push_back(expr);
+                *reg = emit(kEvalConst, kEvalNull, EVAL_NULL_WIDTH, kNoReg, kNoReg, kNoReg,
+                            consts_.size() - 1);
+                return false;
+            case kExprColumnRef: {
+                size_t idx;
+                ColumnDefinition* col_def;
+                if (ResolveColumn(scopes, expr, &idx, &col_def)) {
+                    return true;
+                }
+                *reg = emitColumn(idx, col_def);
+                return false;
+            }
+            case kExprOperator:
+                return compileOperator(expr, scopes, reg);
+            case kExprFunctionRef:
+                return compileFunction(expr, scopes, reg);
+            case kExprCast:
+                return compileCast(expr, scopes, reg);
+            default:
+                std::cout << "[BYDB-Error]  Unsupported expression " << ExprToString(expr)
+                          << std::endl;
+                return true;
+        }
+    }
+
+    bool ExprProgram::compileOperator(Expr* expr, std::vector<TableScope>& scopes, size_t* reg) {
+        OperatorType op = expr->opType;
+        size_t a, b;
+        if (op == kOpCase) {
+            return compileCase(expr, scopes, reg);
+        }
+        if (op == kOpIn && expr->select != nullptr) {
+            std::cout << "[BYDB-Error]  Only support 'column IN (SELECT column ...)' as the "
+                      << "whole WHERE clause." << std::endl;
+            return true;
+        }
+        if (expr->expr == nullptr || compile(expr->expr, scopes, &a)) {
+            if (expr->expr == nullptr) {
+                std::cout << "[BYDB-Error]  Unsupported expression " << ExprToString(expr)
+                          << std::endl;
+            }
+            return true;
+        }
+
+        // 'a BETWEEN lo AND hi' and 'a IN (v1, v2, ...)' keep their other operands in exprList.
+        if (op == kOpBetween || op == kOpIn) {
+            size_t result = kNoReg;
+            for (size_t i = 0; i < expr->exprList->size(); i++) {
+                size_t cmp;
+                OperatorType cmp_op = (op == kOpIn) ? kOpEquals
+                                                    : ((i == 0) ? kOpGreaterEq : kOpLessEq);
+                if (compile((*expr->exprList)[i], scopes, &b) ||
+                    compileCompare(expr, cmp_op, a, b, &cmp)) {
+                    return true;
+                }
+                if (result == kNoReg) {
+                    result = cmp;
+                } else {
+                    result = emit((op == kOpIn) ? kEvalOr : kEvalAnd, kEvalBool, 0, result, cmp);
+                }
+            }
+            *reg = result;
+            return false;
+        }
+
+        EvalType type = regTypes_[a];
+        switch (op) {
+            case kOpNot:
+                if (type != kEvalBool && type != kEvalNull) {
+                    InvalidTypes(expr, type, kEvalBool);
+                    return true;
+                }
+                *reg = emit(kEvalNot, kEvalBool, 0, a);
+                return false;
+            case kOpUnaryMinus:
+                if (compileIntArgs(expr, a, kNoReg)) {
+                    return true;
+                }
+                *reg = emit(kEvalNeg, kEvalInt, EVAL_INT_WIDTH, a);
+                return false;
+            case kOpIsNull:
+                *reg = emit(kEvalIsNull, kEvalBool, 0, a);
+                return false;
+            default:
+                break;
+        }
+
+        if (expr->expr2 == nullptr || compile(expr->expr2, scopes, &b)) {
+            if (expr->expr2 == nullptr) {
+                std::cout << "[BYDB-Error]  Unsupported expression " << ExprToString(expr)
+                          << std::endl;
+            }
+            return true;
+        }
+        switch (op) {
+            case kOpPlus:
+            case kOpMinus:
+            case kOpAsterisk:
+            case kOpSlash:
+            case kOpPercentage: {
+                static const EvalOp ops[] = {kEvalAdd, kEvalSub, kEvalMul, kEvalDiv, kEvalMod};
+                if (compileIntArgs(expr, a, b)) {
+                    return true;
+                }
+                *reg = emit(ops[op - kOpPlus], kEvalInt, EVAL_INT_WIDTH, a, b);
+                return false;
+            }
+            case kOpEquals:
+            case kOpNotEquals:
+            case kOpLess:
+            case kOpLessEq:
+            case kOpGreater:
+            case kOpGreaterEq:
+                return compileCompare(expr, op, a, b, reg);
+            case kOpAnd:
+            case kOpOr: {
+                EvalType type2 = regTypes_[b];
+                if ((type != kEvalBool && type != kEvalNull) ||
+                    (type2 != kEvalBool && type2 != kEvalNull)) {
+                    InvalidTypes(expr, type, type2);
+                    return true;
+                }
+                *reg = emit((op == kOpAnd) ? kEvalAnd : kEvalOr, kEvalBool, 0, a, b);
+                return false;
+            }
+            case kOpConcat:
+                a = toString(a);
+                b = toString(b);
+                *reg = emit(kEvalConcat, kEvalString, regWidths_[a] + regWidths_[b], a, b);
+                return false;
+            default:
+                std::cout << "[BYDB-Error]  Unsupported operator in " << ExprToString(expr)
+                          << std::endl;
+                return true;
+        }
+    }
+
+    bool ExprProgram::compileIntArgs(Expr* expr, size_t a, size_t b) {
+        EvalType type1 = regTypes_[a];
+        EvalType type2 = (b == kNoReg) ? kEvalInt : regTypes_[b];
+        if ((type1 != kEvalInt && type1 != kEvalNull) ||
+            (type2 != kEvalInt && type2 != kEvalNull)) {
+            InvalidTypes(expr, type1, type2);
+            return true;
+        }
+        return false;
+    }
+
+    bool ExprProgram::compileCompare(Expr* expr, OperatorType op, size_t a, size_t b,
+                                     size_t* reg) {
+        EvalType type = regTypes_[a];
+        if (!UnifyType(&type, regTypes_[b])) {
+            InvalidTypes(expr, regTypes_[a], regTypes_[b]);
+            return true;
+        }
+        *reg = emit((type == kEvalString) ? kEvalCmpString : kEvalCmpInt, kEvalBool, 0, a, b,
+                    kNoReg, op);
+        return false;
+    }
+
+    /* Integers are turned into their decimal text where a string is expected. */
+    size_t ExprProgram::toString(size_t reg) {
+        if (regTypes_[reg] != kEvalInt && regTypes_[reg] != kEvalBool) {
+            return reg;
+        }
+        return emit(kEvalIntToString, kEvalString, EVAL_INT_WIDTH, reg);
+    }
+
+    bool ExprProgram::compileFunction(Expr* expr, std::vector<TableScope>& scopes, size_t* reg) {
+        std::vector<size_t> args;
+        if (expr->exprList != nullptr) {
+            for (auto arg : *expr->exprList) {
+                size_t arg_reg;
+                if (compile(arg, scopes, &arg_reg)) {
+                    return true;
+                }
+                args.push_back(arg_reg);
+            }
+        }
+
+        const char* name = expr->name;
+        size_t min_args = 1;
+        size_t max_args = 1;
+        if (strcasecmp(name, "SUBSTR") == 0 || strcasecmp(name, "SUBSTRING") == 0) {
+            min_args = 2;
+            max_args = 3;
+        } else if (strcasecmp(name, "COALESCE") == 0) {
+            max_args = SIZE_MAX;
+        } else if (strcasecmp(name, "UPPER") != 0 && strcasecmp(name, "LOWER") != 0 &&
+                   strcasecmp(name, "LENGTH") != 0 && strcasecmp(name, "ABS") != 0) {
+            std::cout << "[BYDB-Error]  Unsupported function " << name << std::endl;
+            return true;
+        }
+        if (args.size() < min_args || args.size() > max_args) {
+            std::cout << "[BYDB-Error]  Wrong number of arguments for function " << name
+                      << std::endl;
+            return true;
+        }
+
+        if (strcasecmp(name, "COALESCE") == 0) {
+            EvalType type = kEvalNull;
+            size_t width = 0;
+            for (auto arg : args) {
+                if (!UnifyType(&type, regTypes_[arg])) {
+                    InvalidTypes(expr, type, regTypes_[arg]);
+                    return true;
+                }
+                width = std::max(width, regWidths_[arg]);
+            }
+            *reg = args.back();
+            for (size_t i = args.size() - 1; i > 0; i--) {
+                *reg = emit(kEvalCoalesce, type, width, args[i - 1], *reg);
+            }
+            return false;
+        }
+
+        if (strcasecmp(name, "ABS") == 0) {
+            if (compileIntArgs(expr, args[0], kNoReg)) {
+                return true;
+            }
+            *reg = emit(kEvalAbs, kEvalInt, EVAL_INT_WIDTH, args[0]);
+            return false;
+        }
+
+        size_t str = toString(args[0]);
+        if (strcasecmp(name, "LENGTH") == 0) {
+            *reg = emit(kEvalLength, kEvalInt, EVAL_INT_WIDTH, str);
+        } else if (strcasecmp(name, "UPPER") == 0) {
+            *reg = emit(kEvalUpper, kEvalString, regWidths_[str], str);
+        } else if (strcasecmp(name, "LOWER") == 0) {
+            *reg = emit(kEvalLower, kEvalString, regWidths_[str], str);
+        } else {
+            size_t len = (args.size() == 3) ? args[2] : kNoReg;
+            if (compileIntArgs(expr, args[1], len)) {
+                return true;
+            }
+            *reg = emit(kEvalSubstr, kEvalString, regWidths_[str], str, args[1], len);
+        }
+        return false;
+    }
+
+    /*
+     * Every branch is computed for the whole batch, then the results are
+     * picked from the last WHEN to the first so that the first match wins.
+     */
+    bool ExprProgram::compileCase(Expr* expr, std::vector<TableScope>& scopes, size_t* reg) {
+        size_t operand = kNoReg;
+        if (expr->expr != nullptr && compile(expr->expr, scopes, &operand)) {
+            return true;
+        }
+
+        std::vector<size_t> conds;
+        std::vector<size_t> thens;
+        EvalType type = kEvalNull;
+        size_t width = EVAL_NULL_WIDTH;
+        for (auto when : *expr->exprList) {
+            size_t cond, then;
+            if (compile(when->expr, scopes, &cond) || compile(when->expr2, scopes, &then)) {
+                return true;
+            }
+            if (operand != kNoReg) {
+                if (compileCompare(expr, kOpEquals, operand, cond, &cond)) {
+                    return true;
+                }
+            } else if (regTypes_[cond] != kEvalBool && regTypes_[cond] != kEvalNull) {
+                InvalidTypes(expr, regTypes_[cond], kEvalBool);
+                return true;
+            }
+            if (!UnifyType(&type, regTypes_[then])) {
+                InvalidTypes(expr, type, regTypes_[then]);
+                return true;
+            }
+            width = std::max(width, regWidths_[then]);
+            conds.push_back(cond);
+            thens.push_back(then);
+        }
+
+        size_t result;
+        if (expr->expr2 != nullptr) {
+            if (compile(expr->expr2, scopes, &result)) {
+                return true;
+            }
+            if (!UnifyType(&type, regTypes_[result])) {
+                InvalidTypes(expr, type, regTypes_[result]);
+                return true;
+            }
+            width = std::max(width, regWidths_[result]);
+        } else {
+            result = emit(kEvalConst, kEvalNull, EVAL_NULL_WIDTH, kNoReg, kNoReg, kNoReg, -1);
+        }
+
+        for (size_t i = conds.size(); i > 0; i--) {
+            result = emit(kEvalSelect, type, width, thens[i - 1], result, conds[i - 1]);
+        }
+        *reg = result;
+        return false;
+    }
+
+    bool ExprProgram::compileCast(Expr* expr, std::vector<TableScope>& scopes, size_t* reg) {
+        size_t src;
+        if (compile(expr->expr, scopes, &src)) {
+            return true;
+        }
+
+        ColumnType& type = expr->columnType;
+        switch (type.data_type) {
+            case DataType::INT:
+            case DataType::LONG:
+            case DataType::BIGINT:
+            case DataType::SMALLINT:
+                *reg = (regTypes_[src] == kEvalString)
+                               ? emit(kEvalStringToInt, kEvalInt, EVAL_INT_WIDTH, src)
+                               : src;
+                return false;
+            case DataType::CHAR:
+            case DataType::VARCHAR:
+            case DataType::TEXT:
+                *reg = toString(src);
+                if (type.length > 0) {
+                    size_t width = std::min(regWidths_[*reg], static_cast<size_t>(type.length));
+                    *reg = emit(kEvalTruncate, kEvalString, width, *reg, kNoReg, kNoReg,
+                                type.length);
+                }
+                return false;
+            default:
+                std::cout << "[BYDB-Error]  Unsupported cast to "
+                          << DataTypeToString(type.data_type) << std::endl;
+                return true;
+        }
+    }
+
+    void ExprProgram::eval(std::vector<TupleIter*>& rows, size_t begin, size_t end,
+                           Arena* arena) {
+        if (regs_.size() < regTypes_.size()) {
+            regs_.resize(regTypes_.size(), std::vector<EvalValue>(EXPR_BATCH_SIZE));
+        }
+        rows_ = end - begin;
+        for (auto& ins : code_) {
+            run(ins, rows, begin, rows_, arena);
+        }
+    }
+
+    bool ExprProgram::isTrue(size_t out, size_t row) {
+        EvalValue& value = regs_[outputs_[out]][row];
+        return !value.null && value.ival != 0;
+    }
+
+    Expr* ExprProgram::result(size_t out, size_t row, Arena* arena) {
+        size_t reg = outputs_[out];
+        EvalValue& value = regs_[reg][row];
+        if (value.null) {
+            return arena->makeNullLiteral();
+        }
+        if (regTypes_[reg] == kEvalString) {
+            return arena->makeLiteral(value.str, value.len);
+        }
+        return arena->makeLiteral(static_cast<int64_t>(value.ival));
+    }
+
+    void ExprProgram::run(EvalInstr& ins, std::vector<TupleIter*>& rows, size_t begin, size_t num,
+                          Arena* arena) {
+        EvalValue* d = regs_[ins.dst].data();
+        EvalValue* a = (ins.a == kNoReg) ? nullptr : regs_[ins.a].data();
+        EvalValue* b = (ins.b == kNoReg) ? nullptr : regs_[ins.b].data();
+        EvalValue* c = (ins.c == kNoReg) ? nullptr : regs_[ins.c].data();
+
+        switch (ins.op) {
+            case kEvalColumn:
+                for (size_t i = 0; i < num; i++) {
+                    LoadValue(&d[i], rows[begin + i]->values[ins.arg]);
+                }
+                break;
+            case kEvalConst: {
+                Expr* val = (ins.arg < 0) ? nullptr : consts_[ins.arg];
+                for (size_t i = 0; i < num; i++) {
+                    LoadValue(&d[i], val);
+                }
+                break;
+            }
+            case kEvalAdd:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null || b[i].null ||
+                                __builtin_add_overflow(a[i].ival, b[i].ival, &d[i].ival);
+                }
+                break;
+            case kEvalSub:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null || b[i].null ||
+                                __builtin_sub_overflow(a[i].ival, b[i].ival, &d[i].ival);
+                }
+                break;
+            case kEvalMul:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null || b[i].null ||
+                                __builtin_mul_overflow(a[i].ival, b[i].ival, &d[i].ival);
+                }
+                break;
+            case kEvalDiv:
+            case kEvalMod:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null || b[i].null || b[i].ival == 0 ||
+                                (a[i].ival == INT64_MIN && b[i].ival == -1);
+                    if (!d[i].null) {
+                        d[i].ival = (ins.op == kEvalDiv) ? a[i].ival / b[i].ival
+                                                         : a[i].ival % b[i].ival;
+                    }
+                }
+                break;
+            case kEvalNeg:
+            case kEvalAbs:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null || a[i].ival == INT64_MIN;
+                    if (!d[i].null) {
+                        d[i].ival = (ins.op == kEvalNeg || a[i].ival < 0) ? -a[i].ival : a[i].ival;
+                    }
+                }
+                break;
+            case kEvalCmpInt:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null || b[i].null;
+                    int cmp = (a[i].ival < b[i].ival) ? -1 : (a[i].ival > b[i].ival);
+                    d[i].ival = !d[i].null && CompareResult(ins.arg, cmp);
+                }
+                break;
+            case kEvalCmpString:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null || b[i].null;
+                    d[i].ival = !d[i].null && CompareResult(ins.arg, CompareStrings(a[i], b[i]));
+                }
+                break;
+            case kEvalAnd:
+            case kEvalOr:
+                // FALSE decides an AND whatever the other side is, as TRUE does an OR.
+                for (size_t i = 0; i < num; i++) {
+                    int64_t decides = (ins.op == kEvalAnd) ? 0 : 1;
+                    if ((!a[i].null && a[i].ival == decides) ||
+                        (!b[i].null && b[i].ival == decides)) {
+                        d[i].null = false;
+                        d[i].ival = decides;
+                    } else {
+                        d[i].null = a[i].null || b[i].null;
+                        d[i].ival = 1 - decides;
+                    }
+                }
+                break;
+            case kEvalNot:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null;
+                    d[i].ival = !a[i].ival;
+                }
+                break;
+            case kEvalIsNull:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = false;
+                    d[i].ival = a[i].null;
+                }
+                break;
+            case kEvalConcat:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null || b[i].null;
+                    if (!d[i].null) {
+                        char* str = static_cast<char*>(arena->allocate(a[i].len + b[i].len, 1));
+                        memcpy(str, a[i].str, a[i].len);
+                        memcpy(str + a[i].len, b[i].str, b[i].len);
+                        d[i].str = str;
+                        d[i].len = a[i].len + b[i].len;
+                    }
+                }
+                break;
+            case kEvalUpper:
+            case kEvalLower:
+                for (size_t i = 0; i < num; i++) {
+                    d[i] = a[i];
+                    if (d[i].null) {
+                        continue;
+                    }
+                    char* str = static_cast<char*>(arena->allocate(a[i].len, 1));
+                    for (size_t j = 0; j < a[i].len; j++) {
+                        unsigned char ch = a[i].str[j];
+                        str[j] = (ins.op == kEvalUpper) ? toupper(ch) : tolower(ch);
+                    }
+                    d[i].str = str;
+                }
+                break;
+            case kEvalLength:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null;
+                    d[i].ival = a[i].len;
+                }
+                break;
+            case kEvalSubstr:
+                // Positions count from 1; those before the string still use up the length.
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null || b[i].null || (c != nullptr && c[i].null) ||
+                                (c != nullptr && c[i].ival < 0);
+                    if (d[i].null) {
+                        continue;
+                    }
+                    int64_t len = static_cast<int64_t>(a[i].len);
+                    int64_t from = std::max<int64_t>(b[i].ival, 1);
+                    int64_t to = len + 1;
+                    int64_t end;
+                    if (c != nullptr && !__builtin_add_overflow(b[i].ival, c[i].ival, &end)) {
+                        to = std::min(to, end);
+                    }
+                    from = std::min(from, len + 1);
+                    d[i].str = a[i].str + from - 1;
+                    d[i].len = (to > from) ? to - from : 0;
+                }
+                break;
+            case kEvalCoalesce:
+                for (size_t i = 0; i < num; i++) {
+                    d[i] = a[i].null ? b[i] : a[i];
+                }
+                break;
+            case kEvalSelect:
+                for (size_t i = 0; i < num; i++) {
+                    d[i] = (!c[i].null && c[i].ival != 0) ? a[i] : b[i];
+                }
+                break;
+            case kEvalIntToString:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null;
+                    if (!d[i].null) {
+                        char* str = static_cast<char*>(arena->allocate(EVAL_INT_WIDTH + 1, 1));
+                        d[i].len = snprintf(str, EVAL_INT_WIDTH + 1, "%lld",
+                                            static_cast<long long>(a[i].ival));
+                        d[i].str = str;
+                    }
+                }
+                break;
+            case kEvalStringToInt:
+                for (size_t i = 0; i < num; i++) {
+                    d[i].null = a[i].null || !ParseInt(a[i].str, a[i].len, &d[i].ival);
+                }
+                break;
+            case kEvalTruncate:
+                for (size_t i = 0; i < num; i++) {
+                    d[i] = a[i];
+                    d[i].len = std::min(a[i].len, static_cast<size_t>(ins.arg));
+                }
+                break;
+        }
+    }
+
+    static const char* OperatorSymbol(OperatorType op) {
+        switch (op) {
+            case kOpPlus:
+                return "+";
+            case kOpMinus:
+                return "-";
+            case kOpAsterisk:
+                return "*";
+            case kOpSlash:
+                return "/";
+            case kOpPercentage:
+                return "%";
+            case kOpCaret:
+                return "^";
+            case kOpEquals:
+                return "=";
+            case kOpNotEquals:
+                return "!=";
+            case kOpLess:
+                return "<";
+            case kOpLessEq:
+                return "<=";
+            case kOpGreater:
+                return ">";
+            case kOpGreaterEq:
+                return ">=";
+            case kOpLike:
+                return "LIKE";
+            case kOpNotLike:
+                return "NOT LIKE";
+            case kOpILike:
+                return "ILIKE";
+            case kOpAnd:
+                return "AND";
+            case kOpOr:
+                return "OR";
+            case kOpConcat:
+                return "||";
+            default:
+                return "?";
+        }
+    }
+
+    /* Operands that are operators themselves are parenthesized. */
+    static std::string OperandToString(Expr* expr) {
+        if (expr->type == kExprOperator && expr->opType != kOpCase) {
+            return "(" + ExprToString(expr) + ")";
+        }
+        return ExprToString(expr);
+    }
+
+    static std::string ListToString(std::vector<Expr*>* list) {
+        std::string str;
+        for (size_t i = 0; list != nullptr && i < list->size(); i++) {
+            str += ((i == 0) ? "" : ", ") + ExprToString((*list)[i]);
+        }
+        return str;
+    }
+
+    static std::string OperatorToString(Expr* expr) {
+        switch (expr->opType) {
+            case kOpNot:
+                return "NOT " + OperandToString(expr->expr);
+            case kOpUnaryMinus:
+                return "-" + OperandToString(expr->expr);
+            case kOpIsNull:
+                return OperandToString(expr->expr) + " IS NULL";
+            case kOpExists:
+                return "EXISTS (...)";
+            case kOpBetween:
+                return OperandToString(expr->expr) + " BETWEEN " +
+                       OperandToString((*expr->exprList)[0]) + " AND " +
+                       OperandToString((*expr->exprList)[1]);
+            case kOpIn:
+                return OperandToString(expr->expr) + " IN (" +
+                       ((expr->select != nullptr) ? "SELECT ..." : ListToString(expr->exprList)) +
+                       ")";
+            case kOpCase: {
+                std::string str = "CASE";
+                if (expr->expr != nullptr) {
+                    str += " " + ExprToString(expr->expr);
+                }
+                for (auto when : *expr->exprList) {
+                    str += " WHEN " + ExprToString(when->expr) + " THEN " +
+                           ExprToString(when->expr2);
+                }
+                if (expr->expr2 != nullptr) {
+                    str += " ELSE " + ExprToString(expr->expr2);
+                }
+                return str + " END";
+            }
+            default:
+                return OperandToString(expr->expr) + " " + OperatorSymbol(expr->opType) + " " +
+                       OperandToString(expr->expr2);
+        }
+    }
+
+    std::string ExprToString(Expr* expr) {
+        switch (expr->type) {
+            case kExprLiteralInt:
+                if (expr->isBoolLiteral) {
+                    return (expr->ival != 0) ? "TRUE" : "FALSE";
+                }
+                return std::to_string(expr->ival);
+            case kExprLiteralFloat:
+                return std::to_string(expr->fval);
+            case kExprLiteralString:
+                return "'" + std::string(expr->name) + "'";
+            case kExprLiteralNull:
+                return "NULL";
+            case kExprStar:
+                return (expr->table != nullptr) ? std::string(expr->table) + ".*" : "*";
+            case kExprColumnRef:
+                return (expr->table != nullptr) ? std::string(expr->table) + "." + expr->name
+                                                : std::string(expr->name);
+            case kExprFunctionRef:
+                return std::string(expr->name) + "(" + ListToString(expr->exprList) + ")";
+            case kExprCast: {
+                std::string str = "CAST(" + ExprToString(expr->expr) + " AS " +
+                                  DataTypeToString(expr->columnType.data_type);
+                if (expr->columnType.length > 0) {
+                    str += "(" + std::to_string(expr->columnType.length) + ")";
+                }
+                return str + ")";
+            }
+            case kExprOperator:
+                return OperatorToString(expr);
+            default:
+                return ExprTypeToString(expr->type);
+        }
+    }
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "arena.h"
+#include "metadata.h"
+
+#include "sql/statements.h"
+
+#include <string>
+#include <vector>
+
+using namespace hsql;
+
+namespace mydb {
+
+/* Rows an expression program evaluates with one pass over its instructions. */
+#define EXPR_BATCH_SIZE 1024
+
+    struct TupleIter;
+
+    enum EvalType { kEvalNull, kEvalBool, kEvalInt, kEvalString };
+
+    /* Value of a register for one row. Strings are not NUL-terminated. */
+    struct EvalValue {
+        bool null;
+        int64_t ival;  // 0 or 1 for kEvalBool.
+        const char* str;
+        size_t len;
+    };
+
+    enum EvalOp {
+        kEvalColumn,     // dst = row[arg]
+        kEvalConst,      // dst = consts_[arg]
+        kEvalAdd,
+        kEvalSub,
+        kEvalMul,
+        kEvalDiv,        // NULL when dividing by zero, as kEvalMod.
+        kEvalMod,
+        kEvalNeg,
+        kEvalAbs,
+        kEvalCmpInt,     // dst = a <arg> b, 'arg' being one of kOpEquals ... kOpGreaterEq.
+        kEvalCmpString,
+        kEvalAnd,
+        kEvalOr,
+        kEvalNot,
+        kEvalIsNull,
+        kEvalConcat,
+        kEvalUpper,
+        kEvalLower,
+        kEvalLength,
+        kEvalSubstr,     // dst = SUBSTR(a, b, c), c is kNoReg for the rest of a.
+        kEvalCoalesce,   // dst = a unless it is NULL, else b
+        kEvalSelect,     // dst = c is TRUE ? a : b
+        kEvalIntToString,
+        kEvalStringToInt,
+        kEvalTruncate    // dst = first 'arg' bytes of a
+    };
+
+    struct EvalInstr {
+        EvalOp op;
+        size_t dst;
+        size_t a;
+        size_t b;
+        size_t c;
+        int64_t arg;
+    };
+
+    /*
+     * Expressions over the rows of a plan, compiled once per statement into
+     * instructions on registers. A register holds one value per row of a
+     * batch, so every instruction is dispatched once per EXPR_BATCH_SIZE rows
+     * and runs a tight loop over them. NULL propagates through operators and
+     * functions, AND/OR use three-valued logic, and whatever cannot be
+     * computed (division by zero, overflow, a CAST of a malformed string)
+     * yields NULL rather than an error.
+     */
+    class ExprProgram {
+    public:
+        /* Compile 'expr' over the columns of 'scopes' as the next output; true on error. */
+        bool addOutput(Expr* expr, std::vector<TableScope>& scopes);
+        /* Add the column at row position 'idx' as the next output. */
+        void addColumn(size_t idx, ColumnDefinition* col_def);
+
+        size_t outputs() { return outputs_.size(); }
+        EvalType type(size_t out) { return regTypes_[outputs_[out]]; }
+        /* Upper bound of the length of a string output. */
+        size_t width(size_t out) { return regWidths_[outputs_[out]]; }
+        /* True if output 'out' is only a literal, left in *val. */
+        bool isConst(size_t out, Expr** val);
+        /* True if output 'out' is only the column at row position *idx. */
+        bool isColumn(size_t out, size_t* idx);
+        /* Set needed[idx] for every row position the program reads. */
+        void markColumns(std::vector<bool>& needed);
+
+        /* Run the program over rows[begin, end), at most EXPR_BATCH_SIZE of them. */
+        void eval(std::vector<TupleIter*>& rows, size_t begin, size_t end, Arena* arena);
+        /* Results of the last eval(), 'row' counting from its 'begin'. */
+        bool isTrue(size_t out, size_t row);
+        Expr* result(size_t out, size_t row, Arena* arena);
+
+    private:
+        static const size_t kNoReg = SIZE_MAX;
+
+        bool compile(Expr* expr, std::vector<TableScope>& scopes, size_t* reg);
+        bool compileOperator(Expr* expr, std::vector<TableScope>& scopes, size_t* reg);
+        bool compileFunction(Expr* expr, std::vector<TableScope>& scopes, size_t* reg);
+        bool compileCase(Expr* expr, std::vector<TableScope>& scopes, size_t* reg);
+        bool compileCast(Expr* expr, std::vector<TableScope>& scopes, size_t* reg);
+        bool compileCompare(Expr* expr, OperatorType op, size_t a, size_t b, size_t* reg);
+        bool compileIntArgs(Expr* expr, size_t a, size_t b);
+        size_t toString(size_t reg);
+
+        size_t emit(EvalOp op, EvalType type, size_t width, size_t a = kNoReg,
+                    size_t b = kNoReg, size_t c = kNoReg, int64_t arg = 0);
+        size_t emitColumn(size_t idx, ColumnDefinition* col_def);
+        void run(EvalInstr& ins, std::vector<TupleIter*>& rows, size_t begin, size_t num,
+                 Arena* arena);
+
+        std::vector<EvalInstr> code_;
+        std::vector<Expr*> consts_;
+        std::vector<size_t> outputs_;
+        std::vector<EvalType> regTypes_;
+        std::vector<size_t> regWidths_;
+        std::vector<std::vector<EvalValue>> regs_;
+        size_t rows_;
+    };
+
+    /* SQL text of an expression, for column headers and EXPLAIN. */
+    std::string ExprToString(Expr* expr);
+
+}
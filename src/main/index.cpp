@@ -0,0 +1,60 @@
+#include "index.h"
+#include "sort.h"
+
+#include <cstring>
+
+using namespace hsql;
+
+namespace mydb {
+
+    void Index::insertEntry(const std::string& key, Tuple* tup) {
+        entries.insert(std::make_pair(key, tup));
+    }
+
+    void Index::eraseEntry(const std::string& key, Tuple* tup) {
+        entries.erase(std::make_pair(key, tup));
+    }
+
+    void Index::moveEntry(const std::string& key, Tuple* from, Tuple* to) {
+        if (entries.erase(std::make_pair(key, from)) != 0) {
+            entries.insert(std::make_pair(key, to));
+        }
+    }
+
+    /* No tuple sorts before nullptr, so this is the first entry of 'key' or of a greater one. */
+    IndexMap::iterator Index::lowerBound(const std::string& key) {
+        return entries.lower_bound(std::make_pair(key, static_cast<Tuple*>(nullptr)));
+    }
+
+    /* The key right after 'key' in byte order is 'key' with a NUL appended. */
+    std::pair<IndexMap::iterator, IndexMap::iterator> Index::equalRange(const std::string& key) {
+        return std::make_pair(lowerBound(key), lowerBound(key + '\0'));
+    }
+
+    /*
+     * Build a lookup key from the values of another row, e.g. the outer side
+     * of a join. Returns true if no tuple can match: a NULL, or a string
+     * longer than the index column.
+     */
+    bool Index::makeKey(std::vector<Expr*>& values, std::vector<size_t>& idxs, std::string* key) {
+        key->clear();
+        for (size_t i = 0; i < columns.size(); i++) {
+            Expr* val = values[idxs[i]];
+            ColumnDefinition* col = columns[i];
+            size_t width = NormalizedWidth(col);
+
+            if (val->type == kExprLiteralNull) {
+                return true;
+            }
+            if (val->type == kExprLiteralString && strlen(val->name) > width - 1) {
+                return true;
+            }
+
+            size_t pos = key->size();
+            key->resize(pos + width);
+            NormalizeValue(val, col, reinterpret_cast<uchar*>(&(*key)[pos]));
+        }
+        return false;
+    }
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "storage.h"
+
+#include "sql/statements.h"
+
+#include <functional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace hsql;
+
+namespace mydb {
+
+    typedef std::pair<std::string, Tuple*> IndexEntry;
+
+    /* Equal keys are ordered by tuple, so one entry is found without walking all of them. */
+    struct IndexEntryLess {
+        bool operator()(const IndexEntry& a, const IndexEntry& b) const {
+            int cmp = a.first.compare(b.first);
+            return cmp < 0 || (cmp == 0 && std::less<Tuple*>()(a.second, b.second));
+        }
+    };
+
+    typedef std::set<IndexEntry, IndexEntryLess> IndexMap;
+
+    /*
+     * Ordered index over one or more columns. Keys are the normalized bytes
+     * of the index columns (see NormalizeValue), so the map order is the
+     * value order and a scan of the map returns tuples sorted by the index.
+     */
+    struct Index {
+        Index() : name(nullptr) {}
+        ~Index() { free(name); }
+
+        void insertEntry(const std::string& key, Tuple* tup);
+        void eraseEntry(const std::string& key, Tuple* tup);
+        /* Point the entry of 'from' at 'to'. */
+        void moveEntry(const std::string& key, Tuple* from, Tuple* to);
+        /* First entry whose key is not less than 'key'. */
+        IndexMap::iterator lowerBound(const std::string& key);
+        /* Entries whose key is 'key'. */
+        std::pair<IndexMap::iterator, IndexMap::iterator> equalRange(const std::string& key);
+        bool makeKey(std::vector<Expr*>& values, std::vector<size_t>& idxs, std::string* key);
+
+        char* name;
+        std::vector<ColumnDefinition*> columns;
+        std::vector<size_t> colIds;
+        IndexMap entries;
+    };
+
+}
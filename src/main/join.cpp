@@ -0,0 +1,193 @@
+#include "join.h"
+#include "bloom.h"
+#include "executor.h"
+#include "metadata.h"
+
+#include <cstring>
+
+using namespace hsql;
+
+namespace mydb {
+
+#define JOIN_EMPTY_SLOT UINT32_MAX
+
+    uint64_t HashKeys(std::vector<Expr*>& values, std::vector<size_t>& keys, bool* has_null) {
+        uint64_t hash = 0;
+        *has_null = false;
+        for (auto idx : keys) {
+            Expr* val = values[idx];
+            uint64_t h = 0;
+            switch (val->type) {
+                case kExprLiteralInt:
+                    h = static_cast<uint64_t>(val->ival);
+                    break;
+                case kExprLiteralFloat:
+                    memcpy(&h, &val->fval, sizeof(uint64_t));
+                    break;
+                case kExprLiteralString:
+                    h = BKDRHash(val->name, strlen(val->name));
+                    break;
+                default:
+                    *has_null = true;
+                    break;
+            }
+            hash = CombineKeyHash(hash, h);
+        }
+        return hash;
+    }
+
+    bool KeysEqual(std::vector<Expr*>& lvalues, std::vector<size_t>& lkeys,
+                   std::vector<Expr*>& rvalues, std::vector<size_t>& rkeys) {
+        for (size_t i = 0; i < lkeys.size(); i++) {
+            Expr* lval = lvalues[lkeys[i]];
+            Expr* rval = rvalues[rkeys[i]];
+            if (lval->type != rval->type) {
+                return false;
+            }
+
+            switch (lval->type) {
+                case kExprLiteralInt:
+                    if (lval->ival != rval->ival) {
+                        return false;
+                    }
+                    break;
+                case kExprLiteralFloat:
+                    if (lval->fval != rval->fval) {
+                        return false;
+                    }
+                    break;
+                case kExprLiteralString:
+                    if (strcmp(lval->name, rval->name) != 0) {
+                        return false;
+                    }
+                    break;
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    /* Order of two non-NULL keys, consistent with the order of an index on them. */
+    int CompareKeys(std::vector<Expr*>& lvalues, std::vector<size_t>& lkeys,
+                    std::vector<Expr*>& rvalues, std::vector<size_t>& rkeys) {
+        for (size_t i = 0; i < lkeys.size(); i++) {
+            Expr* lval = lvalues[lkeys[i]];
+            Expr* rval = rvalues[rkeys[i]];
+            int cmp = 0;
+            if (lval->type == kExprLiteralString && rval->type == kExprLiteralString) {
+                cmp = strcmp(lval->name, rval->name);
+            } else if (lval->ival != rval->ival) {
+                cmp = (lval->ival < rval->ival) ? -1 : 1;
+            }
+
+            if (cmp != 0) {
+                return cmp;
+            }
+        }
+        return 0;
+    }
+
+    bool HasNullKey(std::vector<Expr*>& values, std::vector<size_t>& keys) {
+        for (auto idx : keys) {
+            if (values[idx]->type == kExprLiteralNull) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void JoinHashTable::addRow(TupleIter* row) {
+        bool has_null = false;
+        uint64_t hash = HashKeys(row->values, keys_, &has_null);
+
+        // NULL never equals anything, so such rows can not match.
+        if (has_null) {
+            return;
+        }
+        rows_.push_back(row);
+        hashes_.push_back(hash);
+    }
+
+    void JoinHashTable::build() {
+        size_t row_num = rows_.size();
+        size_t bytes = row_num * (sizeof(TupleIter*) + sizeof(uint64_t) + 3 * sizeof(uint32_t));
+        radixBits_ = 0;
+        while ((bytes >> radixBits_) > JOIN_CACHE_SIZE && radixBits_ < JOIN_MAX_RADIX_BITS) {
+            radixBits_++;
+        }
+
+        // Counting sort the rows by partition so every partition is contiguous.
+        size_t part_num = static_cast<size_t>(1) << radixBits_;
+        partStart_.assign(part_num + 1, 0);
+        if (radixBits_ > 0) {
+            for (auto hash : hashes_) {
+                partStart_[partitionOf(hash) + 1]++;
+            }
+            for (size_t p = 0; p < part_num; p++) {
+                partStart_[p + 1] += partStart_[p];
+            }
+
+            std::vector<size_t> fill(partStart_.begin(), partStart_.end() - 1);
+            std::vector<TupleIter*> rows(row_num);
+            std::vector<uint64_t> hashes(row_num);
+            for (size_t i = 0; i < row_num; i++) {
+                size_t pos = fill[partitionOf(hashes_[i])]++;
+                rows[pos] = rows_[i];
+                hashes[pos] = hashes_[i];
+            }
+            rows_.swap(rows);
+            hashes_.swap(hashes);
+        } else {
+            partStart_[1] = row_num;
+        }
+
+        chain_.assign(row_num, JOIN_EMPTY_SLOT);
+        buckets_.clear();
+        bucketStart_.clear();
+        bucketMask_.clear();
+        for (size_t p = 0; p < part_num; p++) {
+            size_t count = partStart_[p + 1] - partStart_[p];
+            size_t bucket_num = 1;
+            while (bucket_num < count * 2) {
+                bucket_num <<= 1;
+            }
+
+            size_t start = buckets_.size();
+            uint64_t mask = bucket_num - 1;
+            bucketStart_.push_back(start);
+            bucketMask_.push_back(mask);
+            buckets_.resize(start + bucket_num, JOIN_EMPTY_SLOT);
+
+            for (size_t i = partStart_[p]; i < partStart_[p + 1]; i++) {
+                size_t bucket = start + (hashes_[i] & mask);
+                chain_[i] = buckets_[bucket];
+                buckets_[bucket] = static_cast<uint32_t>(i);
+            }
+        }
+    }
+
+    int64_t JoinHashTable::findFirst(uint64_t hash, std::vector<Expr*>& values,
+                                     std::vector<size_t>& keys) {
+        uint32_t part = partitionOf(hash);
+        size_t bucket = bucketStart_[part] + (hash & bucketMask_[part]);
+        return match(buckets_[bucket], hash, values, keys);
+    }
+
+    int64_t JoinHashTable::findNext(int64_t pos, uint64_t hash, std::vector<Expr*>& values,
+                                    std::vector<size_t>& keys) {
+        return match(chain_[pos], hash, values, keys);
+    }
+
+    int64_t JoinHashTable::match(uint32_t pos, uint64_t hash, std::vector<Expr*>& values,
+                                 std::vector<size_t>& keys) {
+        while (pos != JOIN_EMPTY_SLOT) {
+            if (hashes_[pos] == hash && KeysEqual(values, keys, rows_[pos]->values, keys_)) {
+                return pos;
+            }
+            pos = chain_[pos];
+        }
+        return -1;
+    }
+
+}
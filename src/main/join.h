@@ -0,0 +1,76 @@
+#pragma once
+
+#include "storage.h"
+
+#include "sql/statements.h"
+
+#include <cstdint>
+#include <vector>
+
+using namespace hsql;
+
+namespace mydb {
+
+/* Build sides larger than this are radix partitioned so each partition's table fits in cache. */
+#define JOIN_CACHE_SIZE (1024 * 1024)
+#define JOIN_MAX_RADIX_BITS 10
+/* Number of probe rows hashed and looked up together. */
+#define JOIN_PROBE_BATCH 1024
+
+    struct TupleIter;
+
+    uint64_t HashKeys(std::vector<Expr*>& values, std::vector<size_t>& keys, bool* has_null);
+    bool KeysEqual(std::vector<Expr*>& lvalues, std::vector<size_t>& lkeys,
+                   std::vector<Expr*>& rvalues, std::vector<size_t>& rkeys);
+    int CompareKeys(std::vector<Expr*>& lvalues, std::vector<size_t>& lkeys,
+                    std::vector<Expr*>& rvalues, std::vector<size_t>& rkeys);
+    bool HasNullKey(std::vector<Expr*>& values, std::vector<size_t>& keys);
+
+    /*
+     * Hash table over the build side of a join. Rows are kept in insertion
+     * order and the table is a bucket directory of row positions plus one
+     * chain slot per row, so the whole structure is a few flat arrays. When the
+     * build side would not fit in cache, rows are radix partitioned on the high
+     * hash bits and every partition gets its own directory.
+     */
+    class JoinHashTable {
+    public:
+        JoinHashTable(std::vector<size_t>& keys) : keys_(keys), radixBits_(0) {}
+        ~JoinHashTable() {}
+
+        void addRow(TupleIter* row);
+        void build();
+
+        uint32_t partitionOf(uint64_t hash) {
+            return (radixBits_ == 0) ? 0 : static_cast<uint32_t>(hash >> (64 - radixBits_));
+        }
+        size_t partitionCount() { return partStart_.size() - 1; }
+        uint32_t radixBits() { return radixBits_; }
+        size_t size() { return rows_.size(); }
+
+        /* Returns the position of the first/next matching row, or -1. */
+        int64_t findFirst(uint64_t hash, std::vector<Expr*>& values, std::vector<size_t>& keys);
+        int64_t findNext(int64_t pos, uint64_t hash, std::vector<Expr*>& values,
+                         std::vector<size_t>& keys);
+        TupleIter* row(int64_t pos) { return rows_[pos]; }
+        /* Key hashes of the rows, the keys of the runtime filter of the join. */
+        std::vector<uint64_t>& hashes() { return hashes_; }
+
+    private:
+        int64_t match(uint32_t pos, uint64_t hash, std::vector<Expr*>& values,
+                      std::vector<size_t>& keys);
+
+        std::vector<size_t> keys_;
+        uint32_t radixBits_;
+
+        std::vector<TupleIter*> rows_;
+        std::vector<uint64_t> hashes_;
+        std::vector<uint32_t> chain_;
+
+        std::vector<uint32_t> buckets_;
+        std::vector<size_t> partStart_;
+        std::vector<size_t> bucketStart_;
+        std::vector<uint64_t> bucketMask_;
+    };
+
+}
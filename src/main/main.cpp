@@ -1,39 +1,13 @@
-#include "executor.h"
-#include "optimizer.h"
-#include "parser.h"
+#include "compress.h"
+#include "metrics.h"
+#include "session.h"
+#include "storage.h"
 
 #include <stdlib.h>
 #include <iostream>
 #include <string>
 
 using namespace mydb;
-using namespace hsql;
-
-static bool ExecStmt(std::string stmt) {
-    Parser parser;
-    if (parser.parseStatement(stmt)) {
-        return true;
-    }
-
-    SQLParserResult* result = parser.getResult();
-    Optimizer optimizer;
-
-    for (size_t i = 0; i < result->size(); ++i) {
-        const SQLStatement* stmt = result->getStatement(i);
-        Plan* plan = optimizer.createPlanTree(stmt);
-        if (plan == nullptr) {
-            return true;
-        }
-
-        Executor executor(plan);
-        executor.init();
-        if (executor.exec()) {
-            return true;
-        }
-    }
-
-    return false;
-}
 
 int main(int argc, char* argv[]) {
     std::cout << "# Welcome to ByteYoung DB!!!" << std::endl;
@@ -41,6 +15,7 @@ int main(int argc, char* argv[]) {
     std::cout << "# Enter 'exit' or 'q' to quit this program." << std::endl;
 
     std::string cmd;
+    uint64_t stmt_num = 0;
     while (true) {
         std::cout << ">> ";
         std::getline(std::cin, cmd);
@@ -52,12 +27,28 @@ int main(int argc, char* argv[]) {
             break;
         }
 
+        CountMetric(kMetricStatements);
         if (ExecStmt(cmd)) {
+            CountMetric(kMetricFailedStatements);
             std::cout << "[BYDB-Error]  Failed to execute '" << cmd << "'" << std::endl;
         }
         std::cout << std::endl;
+
+        if (++stmt_num % METRICS_DUMP_INTERVAL == 0) {
+            DumpMetricsFile();
+        }
+        if (stmt_num % TTL_EXPIRE_INTERVAL == 0) {
+            ExpireTtlRows();
+        }
+        if (stmt_num % COMPACT_INTERVAL == 0) {
+            CompactTupleGroups();
+        }
+        if (stmt_num % COMPRESS_INTERVAL == 0) {
+            CompressColdGroups();
+        }
     }
 
+    DumpMetricsFile();
     std::cout << "# Farewell~~~ " << std::endl;
     return 0;
 }
\ No newline at end of file
@@ -13,8 +13,8 @@ namespace mydb {
         schema_ = strdup(schema);
         name_ = strdup(name);
         for (auto col_old : *columns) {
-            std::vector<ConstraintType>* column_constraints =
-                    new std::vector<ConstraintType>();
+            std::unordered_set<ConstraintType>* column_constraints =
+                    new std::unordered_set<ConstraintType>();
             *column_constraints = *col_old->column_constraints;
             ColumnDefinition* col = new ColumnDefinition(
                     strdup(col_old->name), col_old->type, column_constraints);
@@ -22,13 +22,18 @@ namespace mydb {
             columns_.push_back(col);
         }
 
-        tableStore_ = new TableStore(&columns_);
+        tableStore_ = new TableStore(&columns_, &indexes_);
+        stats_ = nullptr;
     }
 
     Table::~Table() {
         free(schema_);
         free(name_);
         delete tableStore_;
+        delete stats_;
+        for (auto index : indexes_) {
+            delete index;
+        }
         for (auto col : columns_) {
             delete col;
         }
@@ -54,7 +59,7 @@ namespace mydb {
         }
 
         for (auto index : indexes_) {
-            if (strcmp(name, index->name)) {
+            if (strcmp(name, index->name) == 0) {
                 return index;
             }
         }
@@ -62,6 +67,43 @@ namespace mydb {
         return nullptr;
     }
 
+    /* Resolve the index columns and fill the index from the rows already in the table. */
+    bool Table::addIndex(Index* index) {
+        index->colIds.clear();
+        for (auto col : index->columns) {
+            size_t i;
+            for (i = 0; i < columns_.size(); i++) {
+                if (strcmp(col->name, columns_[i]->name) == 0) {
+                    break;
+                }
+            }
+            if (i == columns_.size()) {
+                return true;
+            }
+            index->colIds.push_back(i);
+            index->columns[index->colIds.size() - 1] = columns_[i];
+        }
+
+        tableStore_->buildIndex(index);
+        indexes_.push_back(index);
+        return false;
+    }
+
+    /* Key-like columns get tuple group Bloom filters for equality scans min/max can not prune. */
+    void Table::analyze() {
+        TableStats* stats = new TableStats();
+        stats->collect(tableStore_, &columns_);
+        delete stats_;
+        stats_ = stats;
+
+        std::vector<bool> bloom_cols(columns_.size(), false);
+        for (size_t i = 0; i < columns_.size(); i++) {
+            bloom_cols[i] = stats->rowCount > 0 &&
+                            stats->columns[i].distinct >= stats->rowCount * BLOOM_DISTINCT_RATIO;
+        }
+        tableStore_->setBloomColumns(bloom_cols);
+    }
+
     bool MetaData::insertTable(Table* table) {
         if (getTable(table->schema(), table->name()) != nullptr) {
             return true;
@@ -74,10 +116,8 @@ namespace mydb {
     }
 
     bool MetaData::dropIndex(char* schema, char* name, char* indexName) {
-        Table* table = getTable(schema, name);
+        Table* table = getIndexTable(schema, name, indexName);
         if (table == nullptr) {
-            std::cout << "[BYDB-Error]  Table " << TableNameToString(schema, name)
-                      << " did not exist!" << std::endl;
             return true;
         }
 
@@ -87,7 +127,9 @@ namespace mydb {
             Index* index = indexes[i];
             if (strcmp(index->name, indexName) == 0) {
                 indexes.erase(indexes.begin() + i);
+                delete index;
                 ret = false;
+                break;
             }
         }
 
@@ -165,11 +207,52 @@ namespace mydb {
         }
     }
 
-    Index* MetaData::getIndex(char* schema, char* name, char* index_name) {
-        Table* table = getTable(schema, name);
+    /* Table whose name is unique across all schemas, used when a statement gives no schema. */
+    Table* MetaData::getTableByName(char* name) {
+        Table* found = nullptr;
+        for (auto iter : table_map_) {
+            if (strcmp(iter.second->name(), name) == 0) {
+                if (found != nullptr) {
+                    std::cout << "[BYDB-Error]  Table " << name
+                              << " exists in several schemas, specify it like 'db.t'."
+                              << std::endl;
+                    return nullptr;
+                }
+                found = iter.second;
+            }
+        }
+        return found;
+    }
+
+    /*
+     * CREATE INDEX only gives a bare table name and DROP INDEX gives none at
+     * all, so the table of an index is resolved from whatever is known.
+     */
+    Table* MetaData::getIndexTable(char* schema, char* name, char* index_name) {
+        Table* table = nullptr;
+        if (name == nullptr) {
+            for (auto iter : table_map_) {
+                if (iter.second->getIndex(index_name) != nullptr) {
+                    return iter.second;
+                }
+            }
+            return nullptr;
+        } else if (schema == nullptr) {
+            table = getTableByName(name);
+        } else {
+            table = getTable(schema, name);
+        }
+
         if (table == nullptr) {
             std::cout << "[BYDB-Error]  Table " << TableNameToString(schema, name)
                       << " did not exist!" << std::endl;
+        }
+        return table;
+    }
+
+    Index* MetaData::getIndex(char* schema, char* name, char* index_name) {
+        Table* table = getIndexTable(schema, name, index_name);
+        if (table == nullptr) {
             return nullptr;
         }
 
@@ -182,4 +265,35 @@ namespace mydb {
         return nullptr;
     }
 
-}
\ No newline at end of file
+    /* Find a column, qualified or not, among the tables of a query; return its index in the row. */
+    bool ResolveColumn(std::vector<TableScope>& scopes, Expr* expr, size_t* idx,
+                       ColumnDefinition** col_def) {
+        bool found = false;
+        for (auto& scope : scopes) {
+            if (expr->table != nullptr && strcmp(expr->table, scope.name) != 0) {
+                continue;
+            }
+
+            std::vector<ColumnDefinition*>* columns = scope.table->columns();
+            for (size_t i = 0; i < columns->size(); i++) {
+                if (strcmp(expr->name, (*columns)[i]->name) != 0) {
+                    continue;
+                }
+                if (found) {
+                    std::cout << "[BYDB-Error]  Column " << expr->name << " is ambiguous."
+                              << std::endl;
+                    return true;
+                }
+                *idx = scope.offset + i;
+                *col_def = (*columns)[i];
+                found = true;
+            }
+        }
+
+        if (!found) {
+            std::cout << "[BYDB-Error]  Can not find column " << expr->name << std::endl;
+            return true;
+        }
+        return false;
+    }
+}
@@ -2,6 +2,8 @@
 
 #include "sql/CreateStatement.h"
 #include "sql/Table.h"
+#include "index.h"
+#include "stats.h"
 #include "storage.h"
 
 #include <string.h>
@@ -40,9 +42,11 @@ namespace std {
 
 namespace mydb {
 
-    struct Index {
-        char* name;
-        std::vector<ColumnDefinition*> columns;
+    /* Rows whose INT or LONG 'column' is 'seconds' or more in the past expire; 0 for no TTL. */
+    struct TableTtl {
+        TableTtl() : column(0), seconds(0) {}
+        size_t column;
+        int64_t seconds;
     };
 
     class Table {
@@ -56,16 +60,34 @@ namespace mydb {
         char* name() { return name_; };
         std::vector<ColumnDefinition*>* columns() { return &columns_; };
         std::vector<Index*>* indexes() { return &indexes_; };
-        void addIndex(Index* index) { indexes_.push_back(index); };
+        bool addIndex(Index* index);
         TableStore* getTableStore() { return tableStore_;}
+        TableStats* stats() { return stats_; }
+        void analyze();
+        TableTtl& ttl() { return ttl_; }
+        void setTtl(TableTtl& ttl) { ttl_ = ttl; }
     private:
         char* schema_;
         char* name_;
         std::vector<ColumnDefinition*> columns_;
         std::vector<Index*> indexes_;
         TableStore* tableStore_;
+        TableStats* stats_;  // Collected by ANALYZE, nullptr before that.
+        TableTtl ttl_;
     };
 
+    /* A table visible to a query under its alias or name, and where its columns start in a joined row. */
+    struct TableScope {
+        TableScope(const char* n, Table* t, size_t o) : name(n), table(t), offset(o) {}
+        const char* name;
+        Table* table;
+        size_t offset;
+    };
+
+    /* Find a column, qualified or not, among the tables of a query; return its index in the row. */
+    bool ResolveColumn(std::vector<TableScope>& scopes, Expr* expr, size_t* idx,
+                       ColumnDefinition** col_def);
+
     class MetaData {
     public:
         MetaData(){};
@@ -74,10 +96,13 @@ namespace mydb {
         bool insertTable(Table* table);
         bool dropTable(char* schema, char* name);
         bool dropSchema(char* schema);
+        bool dropIndex(char* schema, char* name, char* indexName);
         void getAllTables(std::vector<Table*>* tables);
 
         bool findSchema(char* schema);
         Table* getTable(char* schema, char* name);
+        Table* getTableByName(char* name);
+        Table* getIndexTable(char* schema, char* name, char* index_name);
         Index* getIndex(char* schema, char* name, char* index_name);
 
     private:
@@ -0,0 +1,189 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mydb {
+
+    static const char* kCounterNames[kMetricCounterNum] = {
+            "statements",           "failed_statements",     "tuple_groups_allocated",
+            "tuple_group_bytes",    "huge_page_groups",      "string_heap_bytes",
+            "cold_groups",          "cold_group_bytes",      "cold_groups_thawed",
+            "groups_skipped",       "bloom_groups_skipped",  "runtime_filtered_rows",
+            "undo_records",         "rows_scanned",          "rows_returned",
+            "fused_pipelines",      "compacted_groups",      "compacted_rows",
+            "ttl_expired_rows",     "ttl_dropped_groups",    "partition_groups_skipped",
+            "partitions_dropped"};
+
+    static const char* kLatencyNames[kMetricLatencyNum] = {"parse", "check", "plan", "execute",
+                                                           "new_tuple_group"};
+
+    /* Name column of SHOW METRICS, wider than the longest name so values never touch it. */
+    static const int kNameWidth = 28;
+
+    static std::mutex g_shards_mutex;
+    static std::vector<MetricsShard*> g_shards;
+
+    /* Shards are never freed, so the counts of finished threads are kept. */
+    MetricsShard* LocalMetricsShard() {
+        static thread_local MetricsShard* shard = nullptr;
+        if (shard == nullptr) {
+            shard = new MetricsShard();
+            std::lock_guard<std::mutex> guard(g_shards_mutex);
+            g_shards.push_back(shard);
+        }
+        return shard;
+    }
+
+    uint64_t MetricsNow() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+    }
+
+    void RecordLatency(MetricLatency latency, uint64_t nanos) {
+        LatencyHistogram& hist = LocalMetricsShard()->latencies[latency];
+        size_t bucket = 63 - __builtin_clzll(nanos | 1);
+        if (bucket >= METRICS_LATENCY_BUCKETS) {
+            bucket = METRICS_LATENCY_BUCKETS - 1;
+        }
+
+        AddMetric(hist.buckets[bucket], 1);
+        AddMetric(hist.count, 1);
+        AddMetric(hist.sum, nanos);
+        if (nanos > hist.max.load(std::memory_order_relaxed)) {
+            hist.max.store(nanos, std::memory_order_relaxed);
+        }
+    }
+
+    struct LatencySnapshot {
+        uint64_t buckets[METRICS_LATENCY_BUCKETS];
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+    };
+
+    struct MetricsSnapshot {
+        uint64_t counters[kMetricCounterNum];
+        LatencySnapshot latencies[kMetricLatencyNum];
+    };
+
+    static void TakeSnapshot(MetricsSnapshot* snap) {
+        *snap = MetricsSnapshot();
+        std::lock_guard<std::mutex> guard(g_shards_mutex);
+        for (auto shard : g_shards) {
+            for (int i = 0; i < kMetricCounterNum; i++) {
+                snap->counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+            }
+            for (int i = 0; i < kMetricLatencyNum; i++) {
+                LatencyHistogram& hist = shard->latencies[i];
+                LatencySnapshot& lat = snap->latencies[i];
+                for (int b = 0; b < METRICS_LATENCY_BUCKETS; b++) {
+                    lat.buckets[b] += hist.buckets[b].load(std::memory_order_relaxed);
+                }
+                lat.count += hist.count.load(std::memory_order_relaxed);
+                lat.sum += hist.sum.load(std::memory_order_relaxed);
+                lat.max = std::max(lat.max, hist.max.load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    /* Interpolate inside the power of two bucket holding the q-th value. */
+    static double Percentile(LatencySnapshot& lat, double q) {
+        if (lat.count == 0) {
+            return 0;
+        }
+
+        double target = q * lat.count;
+        double seen = 0;
+        for (int b = 0; b < METRICS_LATENCY_BUCKETS; b++) {
+            if (lat.buckets[b] == 0 || seen + lat.buckets[b] < target) {
+                seen += lat.buckets[b];
+                continue;
+            }
+            double low = (b == 0) ? 0 : static_cast<double>(1ULL << b);
+            double high = static_cast<double>(1ULL << (b + 1));
+            double value = low + (high - low) * (target - seen) / lat.buckets[b];
+            return std::min(value, static_cast<double>(lat.max));
+        }
+        return lat.max;
+    }
+
+    void PrintMetrics(std::ostream& os) {
+        MetricsSnapshot snap;
+        TakeSnapshot(&snap);
+
+        os << "# Counters:" << std::endl;
+        for (int i = 0; i < kMetricCounterNum; i++) {
+            os << std::left << std::setw(kNameWidth) << kCounterNames[i] << snap.counters[i]
+               << std::endl;
+        }
+
+        os << "# Latency (us):" << std::endl;
+        os << std::setw(kNameWidth) << "phase" << std::right << std::setw(10) << "count"
+           << std::setw(12) << "avg" << std::setw(12) << "p50" << std::setw(12) << "p99"
+           << std::setw(12) << "max" << std::endl;
+        os << std::fixed << std::setprecision(1);
+        for (int i = 0; i < kMetricLatencyNum; i++) {
+            LatencySnapshot& lat = snap.latencies[i];
+            double avg = (lat.count == 0) ? 0 : static_cast<double>(lat.sum) / lat.count;
+            os << std::left << std::setw(kNameWidth) << kLatencyNames[i] << std::right
+               << std::setw(10) << lat.count << std::setw(12) << avg / 1e3 << std::setw(12)
+               << Percentile(lat, 0.5) / 1e3 << std::setw(12) << Percentile(lat, 0.99) / 1e3
+               << std::setw(12) << lat.max / 1e3 << std::endl;
+        }
+        os.unsetf(std::ios::fixed | std::ios::right | std::ios::left);
+        os << std::setprecision(6);
+    }
+
+    void PrintPrometheusMetrics(std::ostream& os) {
+        MetricsSnapshot snap;
+        TakeSnapshot(&snap);
+
+        for (int i = 0; i < kMetricCounterNum; i++) {
+            std::string name = std::string("mydb_") + kCounterNames[i] + "_total";
+            os << "# TYPE " << name << " counter" << std::endl;
+            os << name << " " << snap.counters[i] << std::endl;
+        }
+
+        for (int i = 0; i < kMetricLatencyNum; i++) {
+            LatencySnapshot& lat = snap.latencies[i];
+            std::string name = std::string("mydb_") + kLatencyNames[i] + "_duration_seconds";
+            os << "# TYPE " << name << " histogram" << std::endl;
+            uint64_t cumulative = 0;
+            for (int b = 0; b < METRICS_LATENCY_BUCKETS; b++) {
+                cumulative += lat.buckets[b];
+                os << name << "_bucket{le=\"" << static_cast<double>(1ULL << (b + 1)) / 1e9
+                   << "\"} " << cumulative << std::endl;
+            }
+            os << name << "_bucket{le=\"+Inf\"} " << lat.count << std::endl;
+            os << name << "_sum " << static_cast<double>(lat.sum) / 1e9 << std::endl;
+            os << name << "_count " << lat.count << std::endl;
+        }
+    }
+
+    /* Written to a temporary file and renamed, so a scraper never reads half a file. */
+    bool DumpMetricsFile() {
+        const char* path = getenv(METRICS_FILE_ENV);
+        if (path == nullptr || path[0] == '\0') {
+            return false;
+        }
+
+        std::string tmp_path = std::string(path) + ".tmp";
+        std::ofstream file(tmp_path.c_str());
+        if (!file) {
+            return true;
+        }
+        PrintPrometheusMetrics(file);
+        file.close();
+        return !file || rename(tmp_path.c_str(), path) != 0;
+    }
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+namespace mydb {
+
+/* Latency histograms have one bucket per power of two nanoseconds. */
+#define METRICS_LATENCY_BUCKETS 40
+/* The Prometheus text file is rewritten every this many statements. */
+#define METRICS_DUMP_INTERVAL 1000
+/* Environment variable naming the Prometheus text file, no file is written if unset. */
+#define METRICS_FILE_ENV "MYDB_METRICS_FILE"
+
+    enum MetricCounter {
+        kMetricStatements,
+        kMetricFailedStatements,
+        kMetricTupleGroups,
+        kMetricTupleGroupBytes,
+        kMetricHugePageGroups,
+        kMetricStringHeapBytes,
+        kMetricColdGroups,
+        kMetricColdGroupBytes,
+        kMetricColdGroupsThawed,
+        kMetricGroupsSkipped,
+        kMetricBloomGroupsSkipped,
+        kMetricRuntimeFilteredRows,
+        kMetricUndoRecords,
+        kMetricRowsScanned,
+        kMetricRowsReturned,
+        kMetricFusedPipelines,
+        kMetricCompactedGroups,
+        kMetricCompactedRows,
+        kMetricTtlExpiredRows,
+        kMetricTtlDroppedGroups,
+        kMetricPartitionGroupsSkipped,
+        kMetricPartitionsDropped,
+        kMetricCounterNum
+    };
+
+    enum MetricLatency {
+        kLatencyParse,
+        kLatencyCheck,
+        kLatencyPlan,
+        kLatencyExecute,
+        kLatencyNewTupleGroup,
+        kMetricLatencyNum
+    };
+
+    /*
+     * Every thread updates its own shard, so the hot path is a relaxed load
+     * and store without any lock or shared cache line. Readers sum all
+     * shards, which may be slightly behind the writers.
+     */
+    struct LatencyHistogram {
+        std::atomic<uint64_t> buckets[METRICS_LATENCY_BUCKETS];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+    };
+
+    struct MetricsShard {
+        std::atomic<uint64_t> counters[kMetricCounterNum];
+        LatencyHistogram latencies[kMetricLatencyNum];
+    };
+
+    MetricsShard* LocalMetricsShard();
+
+    inline void AddMetric(std::atomic<uint64_t>& metric, uint64_t n) {
+        metric.store(metric.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    inline void CountMetric(MetricCounter counter, uint64_t n = 1) {
+        AddMetric(LocalMetricsShard()->counters[counter], n);
+    }
+
+    uint64_t MetricsNow();
+    void RecordLatency(MetricLatency latency, uint64_t nanos);
+
+    /* SHOW METRICS output: counters plus count, average and percentiles of each latency. */
+    void PrintMetrics(std::ostream& os);
+    /* Prometheus text exposition format. */
+    void PrintPrometheusMetrics(std::ostream& os);
+    /* Rewrite the file named by METRICS_FILE_ENV, if any. */
+    bool DumpMetricsFile();
+
+}
@@ -1,22 +1,213 @@
 #include "optimizer.h"
+#include "join.h"
 #include "util.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 using namespace hsql;
 
 namespace mydb {
 
+/* Fraction of rows assumed to pass an equality filter on a column without statistics. */
+#define FILTER_SELECTIVITY 0.1
+
+/* Relative per-row costs used to pick a join algorithm, a sequential scan row costs 1. */
+#define COST_HASH_BUILD 2.0
+#define COST_HASH_PROBE 1.0
+#define COST_INDEX_LEVEL 1.0
+#define COST_INDEX_SCAN 2.0
+#define COST_MERGE 0.5
+
+    /* Number of values in the rows 'plan' produces. */
+    static size_t PlanWidth(Plan* plan) {
+        switch (plan->planType) {
+            case kScan:
+                return static_cast<ScanPlan*>(plan)->table->columns()->size();
+            case kProjection:
+                return static_cast<ProjectionPlan*>(plan)->program.outputs();
+            case kJoin: {
+                JoinPlan* join = static_cast<JoinPlan*>(plan);
+                return join->leftWidth + ((join->kind == kSemiJoin) ? 0 : join->rightWidth);
+            }
+            default:
+                return PlanWidth(plan->next);
+        }
+    }
+
+    /*
+     * Tell the scans below 'plan' which of their columns are read by the
+     * operators above them. 'needed' is indexed by the positions of the rows
+     * of 'plan' and holds what the parent of 'plan' reads.
+     */
+    static void PushDownColumns(Plan* plan, std::vector<bool>& needed) {
+        switch (plan->planType) {
+            case kScan:
+                static_cast<ScanPlan*>(plan)->columns = needed;
+                break;
+            case kFilter: {
+                // A seq scan applies an equality filter to the raw tuples, see TableStore::seqScan.
+                FilterPlan* filter = static_cast<FilterPlan*>(plan);
+                Plan* child = plan->next;
+                if (filter->program != nullptr) {
+                    filter->program->markColumns(needed);
+                } else if (child->planType != kScan ||
+                           static_cast<ScanPlan*>(child)->type != kSeqScan) {
+                    needed[filter->idx] = true;
+                }
+                PushDownColumns(child, needed);
+                break;
+            }
+            case kProjection: {
+                std::vector<bool> input(PlanWidth(plan->next), false);
+                static_cast<ProjectionPlan*>(plan)->program.markColumns(input);
+                PushDownColumns(plan->next, input);
+                break;
+            }
+            case kSort:
+                for (auto& key : static_cast<SortPlan*>(plan)->keys) {
+                    needed[key.idx] = true;
+                }
+                PushDownColumns(plan->next, needed);
+                break;
+            case kJoin: {
+                // A joined row is the left row followed by the right one, a semi join only
+                // outputs the left row.
+                JoinPlan* join = static_cast<JoinPlan*>(plan);
+                std::vector<bool> left(needed.begin(), needed.begin() + join->leftWidth);
+                std::vector<bool> right(join->rightWidth, false);
+                if (join->kind != kSemiJoin) {
+                    std::copy(needed.begin() + join->leftWidth, needed.end(), right.begin());
+                }
+                for (auto idx : join->leftKeys) {
+                    left[idx] = true;
+                }
+                for (auto idx : join->rightKeys) {
+                    right[idx] = true;
+                }
+                PushDownColumns(join->next, left);
+                PushDownColumns(join->right, right);
+                break;
+            }
+            default:
+                PushDownColumns(plan->next, needed);
+                break;
+        }
+    }
+
+    /* Keep only the values from 'lo' to 'hi' in 'bounds'. */
+    static void Narrow(PartitionBounds* bounds, int64_t lo, int64_t hi) {
+        bounds->lo = std::max(bounds->lo, lo);
+        bounds->hi = std::min(bounds->hi, hi);
+    }
+
+    /*
+     * Narrow 'bounds' to the values of column 'idx' of 'table' that can pass
+     * 'where'. Only comparisons with integer literals ANDed together narrow
+     * them, anything else may pass every value.
+     */
+    static void NarrowBounds(Expr* where, Table* table, size_t idx, PartitionBounds* bounds) {
+        if (where == nullptr || where->type != kExprOperator) {
+            return;
+        }
+        if (where->opType == kOpAnd) {
+            NarrowBounds(where->expr, table, idx, bounds);
+            NarrowBounds(where->expr2, table, idx, bounds);
+            return;
+        }
+
+        Expr* col = where->expr;
+        Expr* val = where->expr2;
+        OperatorType op = where->opType;
+        if (col != nullptr && col->type != kExprColumnRef) {
+            // 'literal op column' is 'column op literal' with the comparison turned around.
+            std::swap(col, val);
+            op = (op == kOpLess) ? kOpGreater : (op == kOpGreater) ? kOpLess
+               : (op == kOpLessEq) ? kOpGreaterEq : (op == kOpGreaterEq) ? kOpLessEq : op;
+        }
+        if (col == nullptr || col->type != kExprColumnRef ||
+            strcmp(col->name, (*table->columns())[idx]->name) != 0) {
+            return;
+        }
+
+        if (op == kOpBetween || op == kOpIn) {
+            if (where->select != nullptr || where->exprList == nullptr ||
+                where->exprList->empty()) {
+                return;
+            }
+            int64_t lo = INT64_MAX;
+            int64_t hi = INT64_MIN;
+            for (auto item : *where->exprList) {
+                if (item->type != kExprLiteralInt) {
+                    return;
+                }
+                lo = std::min(lo, item->ival);
+                hi = std::max(hi, item->ival);
+            }
+            Narrow(bounds, (op == kOpBetween) ? (*where->exprList)[0]->ival : lo,
+                   (op == kOpBetween) ? where->exprList->back()->ival : hi);
+            return;
+        }
+
+        if (val == nullptr || val->type != kExprLiteralInt) {
+            return;
+        }
+        int64_t v = val->ival;
+        switch (op) {
+            case kOpEquals:
+                Narrow(bounds, v, v);
+                break;
+            case kOpLess:
+                Narrow(bounds, (v == INT64_MIN) ? INT64_MAX : INT64_MIN, v - (v != INT64_MIN));
+                break;
+            case kOpLessEq:
+                Narrow(bounds, INT64_MIN, v);
+                break;
+            case kOpGreater:
+                Narrow(bounds, v + (v != INT64_MAX), (v == INT64_MAX) ? INT64_MIN : INT64_MAX);
+                break;
+            case kOpGreaterEq:
+                Narrow(bounds, v, INT64_MAX);
+                break;
+            default:
+                break;
+        }
+    }
+
+    /* A seq scan of a partitioned table only reads the partitions the filter right above passes. */
+    static void PrunePartitions(Plan* plan) {
+        for (; plan != nullptr; plan = plan->next) {
+            if (plan->planType == kJoin) {
+                PrunePartitions(static_cast<JoinPlan*>(plan)->right);
+            }
+            if (plan->planType != kFilter || plan->next == nullptr ||
+                plan->next->planType != kScan) {
+                continue;
+            }
+            ScanPlan* scan = static_cast<ScanPlan*>(plan->next);
+            PartitionSpec& spec = scan->table->getTableStore()->partitioning();
+            if (scan->type == kSeqScan && spec.kind != kNoPartitions) {
+                NarrowBounds(static_cast<FilterPlan*>(plan)->where, scan->table, spec.column,
+                             &scan->partitions);
+            }
+        }
+    }
+
     Plan* Optimizer::createPlanTree(const SQLStatement* stmt) {
+        Plan* plan = nullptr;
         switch (stmt->type()) {
             case kStmtSelect:
-                return createSelectPlanTree(static_cast<const SelectStatement*>(stmt));
+                plan = createSelectPlanTree(static_cast<const SelectStatement*>(stmt));
+                break;
             case kStmtInsert:
                 return createInsertPlanTree(static_cast<const InsertStatement*>(stmt));
             case kStmtUpdate:
-                return createUpdatePlanTree(static_cast<const UpdateStatement*>(stmt));
+                plan = createUpdatePlanTree(static_cast<const UpdateStatement*>(stmt));
+                break;
             case kStmtDelete:
-                return createDeletePlanTree(static_cast<const DeleteStatement*>(stmt));
+                plan = createDeletePlanTree(static_cast<const DeleteStatement*>(stmt));
+                break;
             case kStmtCreate:
                 return createCreatePlanTree(static_cast<const CreateStatement*>(stmt));
             case kStmtDrop:
@@ -28,12 +219,49 @@ namespace mydb {
             default:
                 std::cout << "[BYDB-Error]  Statement type " << StmtTypeToString(stmt->type())
                           << " is not supported now." << std::endl;
+                return nullptr;
         }
-        return nullptr;
+
+        if (plan != nullptr) {
+            PrunePartitions(plan);
+            setEstimates(plan);
+        }
+        return plan;
+    }
+
+    /* Record the estimated output rows of every plan node, shown by EXPLAIN. */
+    void Optimizer::setEstimates(Plan* plan) {
+        for (; plan != nullptr; plan = plan->next) {
+            plan->estRows = estimateRows(plan);
+            if (plan->planType == kJoin) {
+                setEstimates(static_cast<JoinPlan*>(plan)->right);
+            }
+        }
+    }
+
+    Plan* Optimizer::createAnalyzePlanTree(std::vector<Table*>& tables) {
+        AnalyzePlan* plan = arena_->create<AnalyzePlan>();
+        plan->tables = tables;
+        return plan;
+    }
+
+    Plan* Optimizer::createMetricsPlanTree() { return arena_->create<MetricsPlan>(); }
+
+    Plan* Optimizer::createTruncatePlanTree(Table* table) {
+        TruncatePlan* plan = arena_->create<TruncatePlan>();
+        plan->table = table;
+        return plan;
+    }
+
+    Plan* Optimizer::createDropPartitionPlanTree(Table* table, Expr* value) {
+        DropPartitionPlan* plan = arena_->create<DropPartitionPlan>();
+        plan->table = table;
+        plan->value = value;
+        return plan;
     }
 
     Plan* Optimizer::createCreatePlanTree(const CreateStatement* stmt) {
-        CreatePlan* plan = new CreatePlan(stmt->type);
+        CreatePlan* plan = arena_->create<CreatePlan>(stmt->type);
         plan->ifNotExists = stmt->ifNotExists;
         plan->type = stmt->type;
         plan->schema = stmt->schema;
@@ -43,21 +271,21 @@ namespace mydb {
         plan->next = nullptr;
 
         if (plan->type == kCreateIndex) {
-            Table* table = g_meta_data.getTable(plan->schema, plan->tableName);
+            Table* table =
+                    g_meta_data.getIndexTable(plan->schema, plan->tableName, plan->indexName);
             if (table == nullptr) {
-                delete plan;
                 return nullptr;
             }
+            plan->schema = table->schema();
+            plan->tableName = table->name();
 
             if (stmt->indexColumns != nullptr) {
-                plan->indexColumns = new std::vector<ColumnDefinition*>;
+                plan->indexColumns = arena_->create<std::vector<ColumnDefinition*>>();
             }
 
             for (auto col_name : *stmt->indexColumns) {
                 ColumnDefinition* col_def = table->getColumn(col_name);
                 if (col_def == nullptr) {
-                    delete plan->indexColumns;
-                    delete plan;
                     return nullptr;
                 }
                 plan->indexColumns->push_back(col_def);
@@ -68,7 +296,7 @@ namespace mydb {
     }
 
     Plan* Optimizer::createDropPlanTree(const DropStatement* stmt) {
-        DropPlan* plan = new DropPlan();
+        DropPlan* plan = arena_->create<DropPlan>();
         plan->type = stmt->type;
         plan->ifExists = stmt->ifExists;
         plan->schema = stmt->schema;
@@ -79,7 +307,7 @@ namespace mydb {
     }
 
     Plan* Optimizer::createInsertPlanTree(const InsertStatement* stmt) {
-        InsertPlan* plan = new InsertPlan();
+        InsertPlan* plan = arena_->create<InsertPlan>();
         plan->type = stmt->type;
         plan->table = g_meta_data.getTable(stmt->schema, stmt->tableName);
         plan->values = stmt->values;
@@ -89,23 +317,29 @@ namespace mydb {
 
     Plan* Optimizer::createUpdatePlanTree(const UpdateStatement* stmt) {
         Table* table = g_meta_data.getTable(stmt->table->schema, stmt->table->name);
+        std::vector<TableScope> scopes(1, TableScope(table->name(), table, 0));
         Plan* plan;
 
-        ScanPlan* scan = new ScanPlan();
+        ScanPlan* scan = arena_->create<ScanPlan>();
         scan->type = kSeqScan;
         scan->table = table;
         plan = scan;
 
         if (stmt->where != nullptr) {
-            Plan* filter = createFilterPlan(table->columns(), stmt->where);
+            Plan* filter = createFilterPlan(scopes, stmt->where);
+            if (filter == nullptr) {
+                return nullptr;
+            }
             filter->next = plan;
             plan = filter;
         }
 
-        UpdatePlan* update = new UpdatePlan();
+        UpdatePlan* update = arena_->create<UpdatePlan>();
         update->table = table;
         update->next = plan;
 
+        ExprProgram* program = arena_->create<ExprProgram>();
+        bool computed = false;
         for (auto upd : *stmt->updates) {
             size_t idx = 0;
             update->values.push_back(upd->value);
@@ -116,75 +350,702 @@ namespace mydb {
                 }
                 idx++;
             }
+
+            if (program->addOutput(upd->value, scopes)) {
+                return nullptr;
+            }
+            size_t out = program->outputs() - 1;
+            DataType col_type = (*table->columns())[idx]->type.data_type;
+            EvalType type = program->type(out);
+            bool is_int = (col_type == DataType::INT || col_type == DataType::LONG);
+            if (type != kEvalNull && (type == kEvalString) == is_int) {
+                std::cout << "[BYDB-Error]  Invalid update value " << ExprToString(upd->value)
+                          << " for column " << upd->column << std::endl;
+                return nullptr;
+            }
+            Expr* val;
+            computed = computed || !program->isConst(out, &val);
         }
 
+        // Tuples are updated in place, so the scan only decodes what the filter and
+        // the SET values read.
+        std::vector<bool> needed(table->columns()->size(), false);
+        if (computed) {
+            update->program = program;
+            program->markColumns(needed);
+        }
+        PushDownColumns(plan, needed);
         return update;
     }
 
     Plan* Optimizer::createDeletePlanTree(const DeleteStatement* stmt) {
         Table* table = g_meta_data.getTable(stmt->schema, stmt->tableName);
+        std::vector<TableScope> scopes(1, TableScope(table->name(), table, 0));
         Plan* plan;
 
-        ScanPlan* scan = new ScanPlan();
+        ScanPlan* scan = arena_->create<ScanPlan>();
         scan->type = kSeqScan;
         scan->table = table;
         plan = scan;
 
         if (stmt->expr != nullptr) {
-            Plan* filter = createFilterPlan(table->columns(), stmt->expr);
+            Plan* filter = createFilterPlan(scopes, stmt->expr);
+            if (filter == nullptr) {
+                return nullptr;
+            }
             filter->next = plan;
             plan = filter;
         }
 
-        DeletePlan* del = new DeletePlan();
+        DeletePlan* del = arena_->create<DeletePlan>();
         del->table = table;
         del->next = plan;
+
+        std::vector<bool> needed(table->columns()->size(), false);
+        PushDownColumns(plan, needed);
         return del;
     }
 
     Plan* Optimizer::createSelectPlanTree(const SelectStatement* stmt) {
-        Table* table = g_meta_data.getTable(stmt->fromTable->schema, stmt->fromTable->name);
-        std::vector<ColumnDefinition*>* columns = table->columns();
-        Plan *plan;
+        std::vector<TableScope> scopes;
+        Expr* where = stmt->whereClause;
+        Plan* plan = createFromPlan(stmt->fromTable, &scopes, &where);
+        if (plan == nullptr) {
+            return nullptr;
+        }
 
-        ScanPlan* scan = new ScanPlan();
-        scan->type = kSeqScan;
-        scan->table = table;
-        plan = scan;
+        // The WHERE clause is consumed when it was pushed down to a table scan.
+        if (where != nullptr) {
+            if (where->type == kExprOperator && where->opType == kOpIn && where->select != nullptr) {
+                plan = createSemiJoinPlan(plan, scopes, where);
+                if (plan == nullptr) {
+                    return nullptr;
+                }
+            } else {
+                Plan* filter = createFilterPlan(scopes, where);
+                if (filter == nullptr) {
+                    return nullptr;
+                }
+                filter->next = plan;
+                plan = filter;
+            }
+        }
 
-        if (stmt->whereClause != nullptr) {
-            Plan* filter = createFilterPlan(columns, stmt->whereClause);
-            filter->next = plan;
-            plan = filter;
+        LimitPlan* limit = nullptr;
+        if (stmt->limit != nullptr) {
+            limit = static_cast<LimitPlan*>(createLimitPlan(stmt->limit));
+            if (limit == nullptr) {
+                return nullptr;
+            }
         }
 
-        SelectPlan* select = new SelectPlan();
-        select->table = table;
+        if (stmt->order != nullptr) {
+            SortPlan* sort = static_cast<SortPlan*>(createSortPlan(scopes, stmt->order));
+            if (sort == nullptr) {
+                return nullptr;
+            }
+
+            // A small ORDER BY ... LIMIT only needs the first offset + limit rows.
+            if (limit != nullptr && limit->limit <= TOPN_MAX_ROWS &&
+                limit->offset <= TOPN_MAX_ROWS - limit->limit) {
+                sort->limit = limit->offset + limit->limit;
+            }
+            sort->next = plan;
+            plan = sort;
+        }
+
+        if (limit != nullptr) {
+            limit->next = plan;
+            plan = limit;
+        }
+
+        SelectPlan* select = arena_->create<SelectPlan>();
+        select->table = scopes[0].table;
+
+        ProjectionPlan* projection = nullptr;
+        for (auto expr : *stmt->selectList) {
+            if (expr->alias != nullptr ||
+                (expr->type != kExprStar && expr->type != kExprColumnRef)) {
+                projection = arena_->create<ProjectionPlan>();
+                projection->next = plan;
+                plan = projection;
+                break;
+            }
+        }
         select->next = plan;
 
         for (auto expr : *stmt->selectList) {
             if (expr->type == kExprStar) {
-                for (size_t i = 0; i < columns->size(); i++) {
-                    ColumnDefinition* col = (*columns)[i];
-                    select->outCols.push_back(col);
-                    select->colIds.push_back(i);
+                for (auto& scope : scopes) {
+                    if (expr->table != nullptr && strcmp(expr->table, scope.name) != 0) {
+                        continue;
+                    }
+                    std::vector<ColumnDefinition*>* columns = scope.table->columns();
+                    for (size_t i = 0; i < columns->size(); i++) {
+                        select->outCols.push_back((*columns)[i]);
+                        select->colIds.push_back(scope.offset + i);
+                        if (projection != nullptr) {
+                            projection->program.addColumn(scope.offset + i, (*columns)[i]);
+                            projection->names.push_back((*columns)[i]->name);
+                        }
+                    }
+                }
+            } else if (projection != nullptr) {
+                if (addProjection(projection, scopes, expr, select)) {
+                    return nullptr;
                 }
             } else {
-                for (size_t i = 0; i < columns->size(); i++) {
-                    ColumnDefinition* col = (*columns)[i];
-                    if (strcmp(expr->name, col->name) == 0) {
-                        select->outCols.push_back(col);
-                        select->colIds.push_back(i);
-                    }
+                size_t idx;
+                ColumnDefinition* col_def;
+                if (ResolveColumn(scopes, expr, &idx, &col_def)) {
+                    return nullptr;
                 }
+                select->outCols.push_back(col_def);
+                select->colIds.push_back(idx);
             }
         }
 
+        // The projection outputs exactly the select list.
+        if (projection != nullptr) {
+            for (size_t i = 0; i < select->colIds.size(); i++) {
+                select->colIds[i] = i;
+            }
+        }
+
+        std::vector<bool> needed(PlanWidth(plan), false);
+        for (auto idx : select->colIds) {
+            needed[idx] = true;
+        }
+        PushDownColumns(plan, needed);
         return select;
     }
 
-    Plan* Optimizer::createFilterPlan(std::vector<ColumnDefinition*>* columns, Expr* where) {
-        FilterPlan* filter = new FilterPlan();
+    /*
+     * Compile one item of the select list into the projection. Plain columns
+     * keep their definition, computed ones are shown as LONG or VARCHAR
+     * under their alias or text.
+     */
+    bool Optimizer::addProjection(ProjectionPlan* projection, std::vector<TableScope>& scopes,
+                                  Expr* expr, SelectPlan* select) {
+        ExprProgram& program = projection->program;
+        if (program.addOutput(expr, scopes)) {
+            return true;
+        }
+
+        size_t out = program.outputs() - 1;
+        std::string text = ExprToString(expr);
+        projection->names.push_back((expr->alias != nullptr) ? text + " AS " + expr->alias
+                                                             : text);
+
+        size_t idx;
+        ColumnDefinition* col_def = nullptr;
+        if (program.isColumn(out, &idx) && ResolveColumn(scopes, expr, &idx, &col_def)) {
+            return true;
+        }
+        if (col_def != nullptr && expr->alias == nullptr) {
+            select->outCols.push_back(col_def);
+        } else {
+            ColumnType type = (col_def != nullptr) ? col_def->type : ColumnType(DataType::LONG);
+            if (col_def == nullptr && program.type(out) == kEvalString) {
+                type = ColumnType(DataType::VARCHAR, program.width(out));
+            }
+            const char* name = (expr->alias != nullptr) ? expr->alias : text.c_str();
+            select->outCols.push_back(arena_->create<ColumnDefinition>(
+                    strdup(name), type, new std::unordered_set<ConstraintType>()));
+        }
+        select->colIds.push_back(out);
+        return false;
+    }
+
+    /* Number of columns the tables scopes[begin, end) contribute to a joined row. */
+    static size_t ScopeWidth(std::vector<TableScope>& scopes, size_t begin, size_t end) {
+        size_t width = 0;
+        for (size_t i = begin; i < end; i++) {
+            width += scopes[i].table->columns()->size();
+        }
+        return width;
+    }
+
+    /* First column of scopes[begin, end), whose order in the row may differ after join reordering. */
+    static size_t ScopeBase(std::vector<TableScope>& scopes, size_t begin, size_t end) {
+        size_t base = scopes[begin].offset;
+        for (size_t i = begin + 1; i < end; i++) {
+            base = std::min(base, scopes[i].offset);
+        }
+        return base;
+    }
+
+    /* Normalized index key of a literal; true if it can never equal a value of the column. */
+    static bool LiteralKey(Expr* val, ColumnDefinition* col, std::string* key) {
+        bool is_int = (col->type.data_type == DataType::INT ||
+                       col->type.data_type == DataType::LONG);
+        bool is_str = (col->type.data_type == DataType::CHAR ||
+                       col->type.data_type == DataType::VARCHAR);
+        size_t width = NormalizedWidth(col);
+        if (!(is_int && val->type == kExprLiteralInt) &&
+            !(is_str && val->type == kExprLiteralString)) {
+            return true;
+        }
+        if (is_str && strlen(val->name) > width - 1) {
+            return true;
+        }
+
+        key->resize(width);
+        NormalizeValue(val, col, reinterpret_cast<uchar*>(&(*key)[0]));
+        return false;
+    }
+
+    /* 'column = literal' in either order, other conditions are compiled into an ExprProgram. */
+    static bool IsColumnEquals(Expr* where) {
+        if (where->type != kExprOperator || where->opType != kOpEquals) {
+            return false;
+        }
+
+        Expr* col = (where->expr->type == kExprColumnRef) ? where->expr : where->expr2;
+        Expr* val = (col == where->expr) ? where->expr2 : where->expr;
+        return col->type == kExprColumnRef && val->isLiteral();
+    }
+
+    /* A 'column = literal' predicate can be evaluated directly on top of the table's scan. */
+    static bool IsPushableFilter(Expr* where, const char* name, Table* table) {
+        if (!IsColumnEquals(where)) {
+            return false;
+        }
+
+        Expr* col = (where->expr->type == kExprColumnRef) ? where->expr : where->expr2;
+        if (col->table != nullptr && strcmp(col->table, name) != 0) {
+            return false;
+        }
+        return table->getColumn(col->name) != nullptr;
+    }
+
+    Plan* Optimizer::createFromPlan(TableRef* table_ref, std::vector<TableScope>* scopes,
+                                    Expr** where) {
+        switch (table_ref->type) {
+            case kTableName: {
+                Table* table = g_meta_data.getTable(table_ref->schema, table_ref->name);
+                if (table == nullptr) {
+                    return nullptr;
+                }
+
+                size_t offset = ScopeWidth(*scopes, 0, scopes->size());
+                scopes->push_back(TableScope(table_ref->getName(), table, offset));
+
+                ScanPlan* scan = arena_->create<ScanPlan>();
+                scan->type = kSeqScan;
+                scan->table = table;
+
+                if (where != nullptr && *where != nullptr &&
+                    IsPushableFilter(*where, table_ref->getName(), table)) {
+                    std::vector<TableScope> local(1, TableScope(table_ref->getName(), table, 0));
+                    Plan* filter = createFilterPlan(local, *where);
+                    if (filter == nullptr) {
+                        return nullptr;
+                    }
+                    filter->next = scan;
+                    chooseScanType(static_cast<FilterPlan*>(filter));
+                    *where = nullptr;
+                    return filter;
+                }
+                return scan;
+            }
+            case kTableJoin:
+                return createJoinPlan(table_ref->join, scopes, where);
+            default:
+                std::cout << "[BYDB-Error]  Only support ordinary table and join." << std::endl;
+                return nullptr;
+        }
+    }
+
+    /*
+     * Columns of a joined row are the left row followed by the right row.
+     * Join keys are stored relative to the row of the child that produces them.
+     */
+    Plan* Optimizer::createJoinPlan(JoinDefinition* join, std::vector<TableScope>* scopes,
+                                    Expr** where) {
+        if (join->type != kJoinInner && join->type != kJoinLeft) {
+            std::cout << "[BYDB-Error]  Only support inner join and left join." << std::endl;
+            return nullptr;
+        }
+
+        // Only the outer side of a left join may filter its rows before the join.
+        Expr** right_where = (join->type == kJoinLeft) ? nullptr : where;
+        size_t left_begin = scopes->size();
+        Plan* left = createFromPlan(join->left, scopes, where);
+        if (left == nullptr) {
+            return nullptr;
+        }
+
+        size_t right_begin = scopes->size();
+        Plan* right = createFromPlan(join->right, scopes, right_where);
+        if (right == nullptr) {
+            return nullptr;
+        }
+        size_t right_end = scopes->size();
+
+        JoinPlan* plan = arena_->create<JoinPlan>();
+        plan->kind = (join->type == kJoinLeft) ? kLeftJoin : kInnerJoin;
+        plan->algo = kHashJoin;
+        plan->next = left;
+        plan->right = right;
+        plan->leftWidth = ScopeWidth(*scopes, left_begin, right_begin);
+        plan->rightWidth = ScopeWidth(*scopes, right_begin, right_end);
+
+        if (join->condition == nullptr ||
+            collectJoinKeys(join->condition, *scopes, left_begin, right_begin, right_end, plan)) {
+            std::cout << "[BYDB-Error]  Only support equal join conditions on columns."
+                      << std::endl;
+            return nullptr;
+        }
+
+        bool swapped = false;
+        chooseJoinAlgo(plan, &swapped);
+        if (swapped) {
+            // The right input now comes first in the joined row.
+            for (size_t i = left_begin; i < right_begin; i++) {
+                (*scopes)[i].offset += plan->leftWidth;
+            }
+            for (size_t i = right_begin; i < right_end; i++) {
+                (*scopes)[i].offset -= plan->rightWidth;
+            }
+        }
+        return plan;
+    }
+
+    /*
+     * Cost of the cheapest algorithm joining 'left' (outer) with 'right' (inner):
+     * - hash join scans both sides and builds a table over the right one,
+     * - index nested-loop join probes an index on the right table per left row,
+     * - sort-merge join walks indexes on both join keys and merges in order.
+     */
+    double Optimizer::costJoin(Plan* left, Plan* right, std::vector<size_t>& left_keys,
+                               std::vector<size_t>& right_keys, JoinAlgo* algo) {
+        double left_rows = estimateRows(left);
+        double right_rows = estimateRows(right);
+        double hash_factor = 1.0;
+        if (right_rows * 32 > JOIN_CACHE_SIZE) {
+            hash_factor = 2.0;
+        }
+
+        double best = left_rows + right_rows + right_rows * COST_HASH_BUILD * hash_factor +
+                      left_rows * COST_HASH_PROBE * hash_factor;
+        *algo = kHashJoin;
+
+        Index* right_index = findIndex(right, right_keys);
+        if (right_index != nullptr) {
+            double cost = left_rows + left_rows * COST_INDEX_LEVEL * std::log2(right_rows + 2);
+            if (cost < best) {
+                best = cost;
+                *algo = kIndexJoin;
+            }
+        }
+
+        if (right_index != nullptr && findIndex(left, left_keys) != nullptr) {
+            double cost = (left_rows + right_rows) * (COST_INDEX_SCAN + COST_MERGE);
+            if (cost < best) {
+                best = cost;
+                *algo = kMergeJoin;
+            }
+        }
+        return best;
+    }
+
+    /*
+     * Pick the join algorithm and, for an inner join, which input is the
+     * outer one: e.g. the smaller side becomes the hash build side, or the
+     * side with an index on the join keys is probed.
+     */
+    void Optimizer::chooseJoinAlgo(JoinPlan* join, bool* swapped) {
+        JoinAlgo algo;
+        double cost = costJoin(join->next, join->right, join->leftKeys, join->rightKeys, &algo);
+        *swapped = false;
+
+        if (join->kind == kInnerJoin) {
+            JoinAlgo swap_algo;
+            double swap_cost =
+                    costJoin(join->right, join->next, join->rightKeys, join->leftKeys, &swap_algo);
+            if (swap_cost < cost) {
+                std::swap(join->next, join->right);
+                std::swap(join->leftKeys, join->rightKeys);
+                std::swap(join->leftWidth, join->rightWidth);
+                algo = swap_algo;
+                *swapped = true;
+            }
+        }
+
+        join->algo = algo;
+        if (algo == kIndexJoin) {
+            join->index = findIndex(join->right, join->rightKeys);
+        } else if (algo == kMergeJoin) {
+            ScanPlan* left_scan = static_cast<ScanPlan*>(join->next);
+            ScanPlan* right_scan = static_cast<ScanPlan*>(join->right);
+            left_scan->type = kIndexScan;
+            left_scan->index = findIndex(join->next, join->leftKeys);
+            right_scan->type = kIndexScan;
+            right_scan->index = findIndex(join->right, join->rightKeys);
+        }
+
+        // Probe rows without a match are dropped by inner and semi joins, so
+        // a seq scan of the probe side may drop them before anything else.
+        if (algo == kHashJoin && join->kind != kLeftJoin) {
+            Plan* probe = (join->next->planType == kFilter) ? join->next->next : join->next;
+            if (probe->planType == kScan && static_cast<ScanPlan*>(probe)->type == kSeqScan) {
+                join->probeScan = static_cast<ScanPlan*>(probe);
+            }
+        }
+    }
+
+    /*
+     * An equality filter right above a table scan reads only the matching
+     * index entries when that is cheaper than scanning the whole table.
+     */
+    void Optimizer::chooseScanType(FilterPlan* filter) {
+        ScanPlan* scan = static_cast<ScanPlan*>(filter->next);
+        ColumnDefinition* col_def = (*scan->table->columns())[filter->idx];
+        std::string key;
+        if (LiteralKey(filter->val, col_def, &key)) {
+            return;
+        }
+
+        std::vector<size_t> keys(1, filter->idx);
+        Index* index = findIndex(scan, keys);
+        if (index == nullptr) {
+            return;
+        }
+
+        double rows = estimateRows(scan);
+        double cost = COST_INDEX_LEVEL * std::log2(rows + 2) +
+                      rows * filterSelectivity(filter) * COST_INDEX_SCAN;
+        if (cost < rows) {
+            scan->type = kIndexScan;
+            scan->index = index;
+            scan->lookup = true;
+            scan->key = key;
+        }
+    }
+
+    /* Find the table column that produces position 'idx' of the rows of 'plan'. */
+    bool Optimizer::traceColumn(Plan* plan, size_t idx, Table** table, size_t* col_id) {
+        switch (plan->planType) {
+            case kScan:
+                *table = static_cast<ScanPlan*>(plan)->table;
+                *col_id = idx;
+                return false;
+            case kFilter:
+            case kSort:
+            case kLimit:
+                return traceColumn(plan->next, idx, table, col_id);
+            case kJoin: {
+                JoinPlan* join = static_cast<JoinPlan*>(plan);
+                if (idx < join->leftWidth || join->kind == kSemiJoin) {
+                    return traceColumn(join->next, idx, table, col_id);
+                }
+                return traceColumn(join->right, idx - join->leftWidth, table, col_id);
+            }
+            default:
+                return true;
+        }
+    }
+
+    ColumnStats* Optimizer::getColumnStats(Plan* plan, size_t idx, TableStats** table_stats) {
+        Table* table;
+        size_t col_id;
+        if (traceColumn(plan, idx, &table, &col_id) || table->stats() == nullptr) {
+            return nullptr;
+        }
+        *table_stats = table->stats();
+        return &(*table_stats)->columns[col_id];
+    }
+
+    double Optimizer::filterSelectivity(FilterPlan* filter) {
+        Table* table;
+        size_t col_id;
+        if (filter->program != nullptr ||
+            traceColumn(filter->next, filter->idx, &table, &col_id) ||
+            table->stats() == nullptr) {
+            return FILTER_SELECTIVITY;
+        }
+
+        std::string key;
+        if (LiteralKey(filter->val, (*table->columns())[col_id], &key)) {
+            return 0;
+        }
+        TableStats* stats = table->stats();
+        return stats->columns[col_id].eqSelectivity(key, stats->rowCount);
+    }
+
+    /* Distinct values of the join keys on one side, or 0 if unknown. */
+    double Optimizer::distinctKeys(Plan* plan, std::vector<size_t>& keys) {
+        double rows = estimateRows(plan);
+        double distinct = 1;
+        for (auto idx : keys) {
+            TableStats* table_stats;
+            ColumnStats* col_stats = getColumnStats(plan, idx, &table_stats);
+            if (col_stats == nullptr) {
+                return 0;
+            }
+            distinct *= std::max(col_stats->distinct, 1.0);
+        }
+        return std::min(distinct, std::max(rows, 1.0));
+    }
+
+    double Optimizer::estimateRows(Plan* plan) {
+        switch (plan->planType) {
+            case kScan:
+                return static_cast<ScanPlan*>(plan)->table->getTableStore()->rowCount();
+            case kFilter: {
+                FilterPlan* filter = static_cast<FilterPlan*>(plan);
+                return estimateRows(filter->next) * filterSelectivity(filter);
+            }
+            case kJoin: {
+                // Every left key finds its matches among the distinct right keys.
+                JoinPlan* join = static_cast<JoinPlan*>(plan);
+                double left_rows = estimateRows(join->next);
+                double right_rows = estimateRows(join->right);
+                double distinct = std::max(distinctKeys(join->next, join->leftKeys),
+                                           distinctKeys(join->right, join->rightKeys));
+                if (distinct == 0) {
+                    distinct = std::max(left_rows, right_rows);
+                }
+                double rows = left_rows * right_rows / std::max(distinct, 1.0);
+                if (join->kind == kLeftJoin) {
+                    rows = std::max(rows, left_rows);
+                } else if (join->kind == kSemiJoin) {
+                    rows = std::min(rows, left_rows);
+                }
+                return rows;
+            }
+            case kSort: {
+                SortPlan* sort = static_cast<SortPlan*>(plan);
+                double rows = estimateRows(sort->next);
+                return (sort->limit > 0) ? std::min(rows, static_cast<double>(sort->limit)) : rows;
+            }
+            case kLimit: {
+                LimitPlan* limit = static_cast<LimitPlan*>(plan);
+                double rows = std::max(estimateRows(limit->next) - limit->offset, 0.0);
+                return std::min(rows, static_cast<double>(limit->limit));
+            }
+            default:
+                return (plan->next == nullptr) ? 0 : estimateRows(plan->next);
+        }
+    }
+
+    /* An index usable for a join must be on exactly the join keys of a plain table scan. */
+    Index* Optimizer::findIndex(Plan* plan, std::vector<size_t>& keys) {
+        if (plan->planType != kScan) {
+            return nullptr;
+        }
+
+        ScanPlan* scan = static_cast<ScanPlan*>(plan);
+        for (auto index : *scan->table->indexes()) {
+            if (index->colIds == keys) {
+                return index;
+            }
+        }
+        return nullptr;
+    }
+
+    bool Optimizer::collectJoinKeys(Expr* cond, std::vector<TableScope>& scopes, size_t left_begin,
+                                    size_t right_begin, size_t right_end, JoinPlan* join) {
+        if (cond->type != kExprOperator) {
+            return true;
+        }
+
+        if (cond->opType == kOpAnd) {
+            return collectJoinKeys(cond->expr, scopes, left_begin, right_begin, right_end, join) ||
+                   collectJoinKeys(cond->expr2, scopes, left_begin, right_begin, right_end, join);
+        }
+
+        if (cond->opType != kOpEquals || cond->expr->type != kExprColumnRef ||
+            cond->expr2->type != kExprColumnRef) {
+            return true;
+        }
+
+        size_t idx1, idx2;
+        ColumnDefinition* col_def;
+        if (ResolveColumn(scopes, cond->expr, &idx1, &col_def) ||
+            ResolveColumn(scopes, cond->expr2, &idx2, &col_def)) {
+            return true;
+        }
+
+        size_t left_base = ScopeBase(scopes, left_begin, right_begin);
+        size_t right_base = ScopeBase(scopes, right_begin, right_end);
+        size_t right_limit = right_base + ScopeWidth(scopes, right_begin, right_end);
+        if (idx1 >= right_base && idx1 < right_limit) {
+            std::swap(idx1, idx2);
+        }
+        if (idx1 < left_base || idx1 >= right_base || idx2 < right_base || idx2 >= right_limit) {
+            return true;
+        }
+
+        join->leftKeys.push_back(idx1 - left_base);
+        join->rightKeys.push_back(idx2 - right_base);
+        return false;
+    }
+
+    /* 'col IN (SELECT col2 FROM ...)' is executed as a hash semi join against the subquery. */
+    Plan* Optimizer::createSemiJoinPlan(Plan* plan, std::vector<TableScope>& scopes, Expr* in) {
+        SelectStatement* sub = in->select;
+        std::vector<TableScope> sub_scopes;
+        size_t left_idx, right_idx;
+        ColumnDefinition* col_def;
+
+        if (in->expr->type != kExprColumnRef || sub->selectList->size() != 1 ||
+            (*sub->selectList)[0]->type != kExprColumnRef) {
+            std::cout << "[BYDB-Error]  Only support 'column IN (SELECT column ...)'." << std::endl;
+            return nullptr;
+        }
+
+        Plan* build = createFromPlan(sub->fromTable, &sub_scopes, nullptr);
+        if (build == nullptr) {
+            return nullptr;
+        }
+
+        if (sub->whereClause != nullptr) {
+            Plan* filter = createFilterPlan(sub_scopes, sub->whereClause);
+            if (filter == nullptr) {
+                return nullptr;
+            }
+            filter->next = build;
+            build = filter;
+        }
+
+        if (ResolveColumn(scopes, in->expr, &left_idx, &col_def) ||
+            ResolveColumn(sub_scopes, (*sub->selectList)[0], &right_idx, &col_def)) {
+            return nullptr;
+        }
+
+        JoinPlan* join = arena_->create<JoinPlan>();
+        join->kind = kSemiJoin;
+        join->algo = kHashJoin;
+        join->next = plan;
+        join->right = build;
+        join->leftWidth = ScopeWidth(scopes, 0, scopes.size());
+        join->rightWidth = ScopeWidth(sub_scopes, 0, sub_scopes.size());
+        join->leftKeys.push_back(left_idx);
+        join->rightKeys.push_back(right_idx);
+        bool swapped;
+        chooseJoinAlgo(join, &swapped);
+        return join;
+    }
+
+    Plan* Optimizer::createFilterPlan(std::vector<TableScope>& scopes, Expr* where) {
+        FilterPlan* filter = arena_->create<FilterPlan>();
+        filter->where = where;
+        if (!IsColumnEquals(where)) {
+            filter->program = arena_->create<ExprProgram>();
+            if (filter->program->addOutput(where, scopes)) {
+                return nullptr;
+            }
+            EvalType type = filter->program->type(0);
+            if (type != kEvalBool && type != kEvalNull) {
+                std::cout << "[BYDB-Error]  WHERE clause " << ExprToString(where)
+                          << " is not a condition." << std::endl;
+                return nullptr;
+            }
+            return filter;
+        }
+
         Expr* col = nullptr;
         Expr* val = nullptr;
         if (where->expr->type == kExprColumnRef) {
@@ -195,25 +1056,67 @@ namespace mydb {
             val = where->expr;
         }
 
-        for (size_t i = 0 ; i < columns->size(); i++) {
-            ColumnDefinition* col_def = (*columns)[i];
-            if (strcmp(col->name, col_def->name) == 0) {
-                filter->idx = i;
-            }
+        if (ResolveColumn(scopes, col, &filter->idx, &filter->col)) {
+            return nullptr;
         }
         filter->val = val;
 
         return filter;
     }
 
+    Plan* Optimizer::createSortPlan(std::vector<TableScope>& scopes,
+                                    std::vector<OrderDescription*>* order) {
+        SortPlan* sort = arena_->create<SortPlan>();
+        sort->table = scopes[0].table;
+        sort->order = order;
+
+        for (auto desc : *order) {
+            Expr* expr = desc->expr;
+            if (expr->type != kExprColumnRef) {
+                std::cout << "[BYDB-Error]  Only support 'Order By' on columns." << std::endl;
+                return nullptr;
+            }
+
+            size_t idx;
+            ColumnDefinition* col_def;
+            if (ResolveColumn(scopes, expr, &idx, &col_def)) {
+                return nullptr;
+            }
+            sort->keys.push_back(SortKey(col_def, idx, desc->type == kOrderAsc));
+        }
+
+        return sort;
+    }
+
+    Plan* Optimizer::createLimitPlan(LimitDescription* desc) {
+        LimitPlan* limit = arena_->create<LimitPlan>();
+        if (desc->limit != nullptr) {
+            if (desc->limit->type != kExprLiteralInt || desc->limit->ival < 0) {
+                std::cout << "[BYDB-Error]  Invalid 'Limit' value." << std::endl;
+                return nullptr;
+            }
+            limit->limit = desc->limit->ival;
+        }
+
+        if (desc->offset != nullptr) {
+            if (desc->offset->type != kExprLiteralInt || desc->offset->ival < 0) {
+                std::cout << "[BYDB-Error]  Invalid 'Offset' value." << std::endl;
+                return nullptr;
+            }
+            limit->offset = desc->offset->ival;
+        }
+
+        return limit;
+    }
+
     Plan* Optimizer::createTrxPlanTree(const TransactionStatement* stmt) {
-        TrxPlan* plan = new TrxPlan();
+        TrxPlan* plan = arena_->create<TrxPlan>();
         plan->command = stmt->command;
         return plan;
     }
 
     Plan* Optimizer::createShowPlanTree(const ShowStatement* stmt) {
-        ShowPlan* plan = new ShowPlan();
+        ShowPlan* plan = arena_->create<ShowPlan>();
         plan->type = stmt->type;
         plan->schema = stmt->schema;
         plan->name = stmt->name;
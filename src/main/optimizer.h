@@ -1,4 +1,8 @@
+#pragma once
+
+#include "expression.h"
 #include "metadata.h"
+#include "sort.h"
 
 #include "sql/statements.h"
 
@@ -17,19 +21,22 @@ namespace mydb {
         kFilter,
         kSort,
         kLimit,
+        kJoin,
         kTrx,
-        kShow
+        kShow,
+        kAnalyze,
+        kMetrics,
+        kTruncate,
+        kDropPartition
     };
 
+    /* Plan nodes are allocated in the arena of the statement and never deleted on their own. */
     struct Plan {
-        Plan(PlanType t) : planType(t), next(nullptr) {}
-        ~Plan() {
-            delete next;
-            next = nullptr;
-        }
+        Plan(PlanType t) : planType(t), next(nullptr), estRows(0) {}
 
         PlanType planType;
         Plan* next;
+        double estRows;  // Output rows estimated by the optimizer.
     };
 
     struct CreatePlan : public Plan {
@@ -41,6 +48,8 @@ namespace mydb {
         char* indexName;
         std::vector<ColumnDefinition*>* indexColumns;
         std::vector<ColumnDefinition*>* columns;
+        TableTtl ttl;  // From 'WITH (ttl_column = ..., ttl = ...)'.
+        PartitionSpec partitions;
     };
 
     struct DropPlan : public Plan {
@@ -60,10 +69,11 @@ namespace mydb {
     };
 
     struct UpdatePlan : public Plan {
-        UpdatePlan() : Plan(kUpdate) {}
+        UpdatePlan() : Plan(kUpdate), program(nullptr) {}
         Table* table;
         std::vector<Expr*> values;
         std::vector<size_t> idxs;
+        ExprProgram* program;  // Computes the values per row, nullptr if they are all literals.
     };
 
     struct DeletePlan : public Plan {
@@ -72,8 +82,9 @@ namespace mydb {
     };
 
     struct SelectPlan : public Plan {
-        SelectPlan() : Plan(kSelect) {}
+        SelectPlan() : Plan(kSelect), discard(false) {}
         Table* table;
+        bool discard;  // Run the query without printing its rows, for EXPLAIN ANALYZE.
         std::vector<ColumnDefinition*> outCols;
         std::vector<size_t> colIds;
     };
@@ -81,29 +92,72 @@ namespace mydb {
     enum ScanType { kSeqScan, kIndexScan };
 
     struct ScanPlan : public Plan {
-        ScanPlan() : Plan(kScan) {}
+        ScanPlan() : Plan(kScan), index(nullptr), lookup(false), runtimeFilter(nullptr) {}
         ScanType type;
         Table* table;
+        Index* index;     // Index walked in key order by kIndexScan.
+        bool lookup;      // Only read the index entries equal to 'key'.
+        std::string key;
+        /* Columns read above the scan, the others are never decoded. Empty for all of them. */
+        std::vector<bool> columns;
+        /* Build keys of the hash join probing this scan, set once its build side is read. */
+        BloomFilter* runtimeFilter;
+        std::vector<size_t> runtimeKeys;
+        /* Partition column values the filter right above lets through, for a seq scan. */
+        PartitionBounds partitions;
     };
 
+    /* 'col = val', or any other condition 'where' evaluated by 'program'. */
     struct FilterPlan : public Plan {
-        FilterPlan() : Plan(kFilter), idx(0), val(nullptr) {}
+        FilterPlan() : Plan(kFilter), idx(0), col(nullptr), val(nullptr), where(nullptr),
+                       program(nullptr) {}
         size_t idx;
+        ColumnDefinition* col;
         Expr* val;
+        Expr* where;
+        ExprProgram* program;
+    };
+
+    /* Computes the select list when it is more than plain columns. */
+    struct ProjectionPlan : public Plan {
+        ProjectionPlan() : Plan(kProjection) {}
+        ExprProgram program;
+        std::vector<std::string> names;  // Text of the outputs, for EXPLAIN.
     };
 
     struct SortPlan : public Plan {
-        SortPlan() : Plan(kSort) {}
+        SortPlan() : Plan(kSort), limit(0) {}
         Table* table;
         std::vector<OrderDescription*>* order;
+        std::vector<SortKey> keys;
+        uint64_t limit;  // Keep only the first 'limit' rows (Top-N), 0 for a full sort.
     };
 
     struct LimitPlan : public Plan {
-        LimitPlan() : Plan(kLimit) {}
+        LimitPlan() : Plan(kLimit), offset(0), limit(UINT64_MAX) {}
         uint64_t offset;
         uint64_t limit;
     };
 
+    enum JoinKind { kInnerJoin, kLeftJoin, kSemiJoin };
+
+    enum JoinAlgo { kHashJoin, kIndexJoin, kMergeJoin };
+
+    struct JoinPlan : public Plan {
+        JoinPlan() : Plan(kJoin), algo(kHashJoin), right(nullptr), index(nullptr),
+                     probeScan(nullptr), leftWidth(0), rightWidth(0) {}
+
+        JoinKind kind;
+        JoinAlgo algo;
+        Plan* right;           // Build side, 'next' is the probe side.
+        Index* index;          // Index of the right table probed by kIndexJoin.
+        ScanPlan* probeScan;   // Seq scan of the probe side given the runtime filter of kHashJoin.
+        std::vector<size_t> leftKeys;
+        std::vector<size_t> rightKeys;
+        size_t leftWidth;
+        size_t rightWidth;
+    };
+
     struct TrxPlan : public Plan {
         TrxPlan() : Plan(kTrx) {}
         TransactionCommand command;
@@ -116,12 +170,40 @@ namespace mydb {
         char* name;
     };
 
+    struct AnalyzePlan : public Plan {
+        AnalyzePlan() : Plan(kAnalyze) {}
+        std::vector<Table*> tables;
+    };
+
+    struct MetricsPlan : public Plan {
+        MetricsPlan() : Plan(kMetrics) {}
+    };
+
+    struct TruncatePlan : public Plan {
+        TruncatePlan() : Plan(kTruncate), table(nullptr) {}
+        Table* table;
+    };
+
+    struct DropPartitionPlan : public Plan {
+        DropPartitionPlan() : Plan(kDropPartition), table(nullptr), value(nullptr) {}
+        Table* table;
+        Expr* value;  // Of the partition column, NULL for the partition of NULLs.
+    };
+
     class Optimizer {
     public:
-        Optimizer() {}
+        Optimizer(Arena* arena) : arena_(arena) {}
 
         Plan* createPlanTree(const SQLStatement* stmt);
 
+        Plan* createAnalyzePlanTree(std::vector<Table*>& tables);
+
+        Plan* createMetricsPlanTree();
+
+        Plan* createTruncatePlanTree(Table* table);
+
+        Plan* createDropPartitionPlanTree(Table* table, Expr* value);
+
     private:
         Plan* createCreatePlanTree(const CreateStatement* stmt);
 
@@ -135,11 +217,50 @@ namespace mydb {
 
         Plan* createSelectPlanTree(const SelectStatement* stmt);
 
-        Plan* createFilterPlan(std::vector<ColumnDefinition*>* columns, Expr* where);
+        bool addProjection(ProjectionPlan* projection, std::vector<TableScope>& scopes, Expr* expr,
+                           SelectPlan* select);
+
+        Plan* createFromPlan(TableRef* table_ref, std::vector<TableScope>* scopes, Expr** where);
+
+        Plan* createJoinPlan(JoinDefinition* join, std::vector<TableScope>* scopes, Expr** where);
+
+        double costJoin(Plan* left, Plan* right, std::vector<size_t>& left_keys,
+                        std::vector<size_t>& right_keys, JoinAlgo* algo);
+
+        void chooseJoinAlgo(JoinPlan* join, bool* swapped);
+
+        void chooseScanType(FilterPlan* filter);
+
+        bool traceColumn(Plan* plan, size_t idx, Table** table, size_t* col_id);
+
+        ColumnStats* getColumnStats(Plan* plan, size_t idx, TableStats** table_stats);
+
+        double filterSelectivity(FilterPlan* filter);
+
+        double distinctKeys(Plan* plan, std::vector<size_t>& keys);
+
+        double estimateRows(Plan* plan);
+
+        void setEstimates(Plan* plan);
+
+        Index* findIndex(Plan* plan, std::vector<size_t>& keys);
+
+        Plan* createSemiJoinPlan(Plan* plan, std::vector<TableScope>& scopes, Expr* in);
+
+        Plan* createFilterPlan(std::vector<TableScope>& scopes, Expr* where);
+
+        Plan* createSortPlan(std::vector<TableScope>& scopes, std::vector<OrderDescription*>* order);
+
+        Plan* createLimitPlan(LimitDescription* limit);
 
         Plan* createTrxPlanTree(const TransactionStatement* stmt);
 
         Plan* createShowPlanTree(const ShowStatement* stmt);
+
+        bool collectJoinKeys(Expr* cond, std::vector<TableScope>& scopes, size_t left_begin,
+                             size_t right_begin, size_t right_end, JoinPlan* join);
+
+        Arena* arena_;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "pages.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace mydb {
+
+/* From <numaif.h>, which needs libnuma headers we do not otherwise depend on. */
+#define NUMA_MPOL_BIND 2
+
+    static bool NumaBindEnabled() {
+        static int enabled = -1;
+        if (enabled < 0) {
+            const char* env = getenv(NUMA_BIND_ENV);
+            enabled = (env != nullptr && strcmp(env, "1") == 0) ? 1 : 0;
+        }
+        return enabled == 1;
+    }
+
+    /*
+     * Pages are placed on first touch anyway, binding only matters when a
+     * group is filled by a thread on another node. Failures are ignored, the
+     * memory is still usable.
+     */
+    static void BindToLocalNode(void* addr, size_t size) {
+#if defined(SYS_getcpu) && defined(SYS_mbind)
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0 || node >= 64) {
+            return;
+        }
+        unsigned long mask = 1UL << node;
+        syscall(SYS_mbind, addr, size, NUMA_MPOL_BIND, &mask, 64, 0);
+#endif
+    }
+
+    static void* MapAligned(size_t size, bool* huge) {
+#ifdef MAP_HUGETLB
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED) {
+            *huge = true;
+            return addr;
+        }
+#endif
+
+        // Over-map by one huge page and trim both ends to get an aligned range.
+        size_t map_size = size + HUGE_PAGE_SIZE;
+        char* raw = static_cast<char*>(mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (raw == MAP_FAILED) {
+            return nullptr;
+        }
+        uintptr_t begin = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t aligned =
+                (begin + HUGE_PAGE_SIZE - 1) & ~static_cast<uintptr_t>(HUGE_PAGE_SIZE - 1);
+        if (aligned > begin) {
+            munmap(raw, aligned - begin);
+        }
+        if (begin + map_size > aligned + size) {
+            munmap(reinterpret_cast<void*>(aligned + size), begin + map_size - aligned - size);
+        }
+
+#ifdef MADV_HUGEPAGE
+        *huge = (madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE) == 0);
+#endif
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    bool AllocPages(size_t size, PageRange* range) {
+        range->size = size;
+        range->huge = false;
+        if (size < HUGE_PAGE_SIZE) {
+            range->addr = calloc(1, size);
+            range->mapped = false;
+            return range->addr == nullptr;
+        }
+
+        range->addr = MapAligned(size, &range->huge);
+        range->mapped = true;
+        if (range->addr == nullptr) {
+            return true;
+        }
+        if (NumaBindEnabled()) {
+            BindToLocalNode(range->addr, size);
+        }
+        return false;
+    }
+
+    void FreePages(PageRange& range) {
+        if (range.mapped) {
+            munmap(range.addr, range.size);
+        } else {
+            free(range.addr);
+        }
+        range.addr = nullptr;
+    }
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+namespace mydb {
+
+/* Huge page size on x86-64 and aarch64, also the size tuple groups grow up to. */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+/* Environment variable, "1" binds tuple groups to the NUMA node of the allocating thread. */
+#define NUMA_BIND_ENV "MYDB_NUMA_BIND"
+
+    /* Memory of one tuple group, zero filled when allocated. */
+    struct PageRange {
+        PageRange() : addr(nullptr), size(0), mapped(false), huge(false) {}
+        void* addr;
+        size_t size;
+        bool mapped;  // From mmap rather than the heap.
+        bool huge;    // Backed by, or advised to use, huge pages.
+    };
+
+    /*
+     * Sizes below HUGE_PAGE_SIZE come from the heap. Larger ones are mapped
+     * with explicit huge pages when the system has some reserved, otherwise
+     * as huge page aligned memory advised for transparent huge pages.
+     * Returns true on error.
+     */
+    bool AllocPages(size_t size, PageRange* range);
+    void FreePages(PageRange& range);
+
+}
@@ -1,27 +1,177 @@
 #include "parser.h"
 #include "metadata.h"
+#include "metrics.h"
 #include "util.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <strings.h>
 
 using namespace hsql;
 
 namespace mydb {
 
-    Parser::Parser() { result_ = nullptr; }
+    Parser::Parser() {
+        result_ = nullptr;
+        isAnalyze_ = false;
+        isExplain_ = false;
+        isExplainAnalyze_ = false;
+        isShowMetrics_ = false;
+        truncateTable_ = nullptr;
+        dropPartitionTable_ = nullptr;
+        dropPartitionValue_ = nullptr;
+    }
 
     Parser::~Parser() {
         delete result_;
+        delete dropPartitionValue_;
         result_ = nullptr;
     }
 
+    /* Match a leading keyword case-insensitively and return the rest of the query in args. */
+    static bool MatchKeyword(std::string& query, const char* keyword, std::string* args) {
+        size_t start = query.find_first_not_of(" \t");
+        size_t len = strlen(keyword);
+        if (start == std::string::npos || query.size() < start + len ||
+            strncasecmp(query.c_str() + start, keyword, len) != 0) {
+            return false;
+        }
+        if (query.size() > start + len && !isspace(query[start + len]) &&
+            query[start + len] != ';') {
+            return false;
+        }
+
+        *args = query.substr(start + len);
+        size_t end = args->find_last_not_of(" \t;");
+        args->erase((end == std::string::npos) ? 0 : end + 1);
+        args->erase(0, args->find_first_not_of(" \t"));
+        return true;
+    }
+
+    static std::string TrimSpaces(const std::string& str) {
+        size_t start = str.find_first_not_of(" \t");
+        if (start == std::string::npos) {
+            return "";
+        }
+        return str.substr(start, str.find_last_not_of(" \t") + 1 - start);
+    }
+
+    /* Cut the 'WITH ...' following the column list of a CREATE TABLE off 'query' into 'options'. */
+    static bool SplitTableOptions(std::string* query, std::string* options) {
+        const char* str = query->c_str();
+        int depth = 0;
+        char quote = 0;
+        for (size_t i = 0; i < query->size(); i++) {
+            char c = str[i];
+            if (quote != 0) {
+                quote = (c == quote) ? 0 : quote;
+            } else if (c == '\'' || c == '"') {
+                quote = c;
+            } else if (c == '(') {
+                depth++;
+            } else if (c == ')') {
+                depth--;
+            } else if (depth == 0 && i > 0 && (isspace(str[i - 1]) || str[i - 1] == ')') &&
+                       strncasecmp(str + i, "WITH", 4) == 0 &&
+                       (isspace(str[i + 4]) || str[i + 4] == '(')) {
+                *options = query->substr(i + 4);
+                query->erase(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* '30 days', '12 hours', '90 minutes', '3600 seconds' or just '3600'; true on error. */
+    static bool ParseDuration(const std::string& text, int64_t* seconds) {
+        static const struct {
+            const char* name;
+            int64_t seconds;
+        } kUnits[] = {{"second", 1}, {"minute", 60}, {"hour", 3600}, {"day", 86400},
+                      {"week", 7 * 86400}};
+
+        char* end = nullptr;
+        errno = 0;
+        long long num = strtoll(text.c_str(), &end, 10);
+        if (end == text.c_str() || num <= 0 || errno == ERANGE) {
+            return true;
+        }
+        std::string unit = TrimSpaces(end);
+        if (unit.empty()) {
+            *seconds = num;
+            return false;
+        }
+        if (unit.back() == 's' || unit.back() == 'S') {
+            unit.pop_back();
+        }
+        for (auto& u : kUnits) {
+            if (strcasecmp(unit.c_str(), u.name) == 0 && num <= INT64_MAX / u.seconds) {
+                *seconds = num * u.seconds;
+                return false;
+            }
+        }
+        return true;
+    }
+
     bool Parser::parseStatement(std::string query) {
+        std::string args;
+        if (MatchKeyword(query, "ANALYZE", &args)) {
+            isAnalyze_ = true;
+            return parseAnalyzeStmt(args);
+        }
+
+        if (MatchKeyword(query, "SHOW", &args) && strcasecmp(args.c_str(), "METRICS") == 0) {
+            isShowMetrics_ = true;
+            return false;
+        }
+
+        // 'EXPLAIN [ANALYZE] statement' parses the statement as usual.
+        if (MatchKeyword(query, "EXPLAIN", &args)) {
+            std::string stmt;
+            isExplain_ = true;
+            if (MatchKeyword(args, "ANALYZE", &stmt)) {
+                isExplainAnalyze_ = true;
+                args = stmt;
+            }
+            if (args.empty()) {
+                std::cout << "[BYDB-Error]  Usage: EXPLAIN [ANALYZE] statement" << std::endl;
+                return true;
+            }
+            query = args;
+        }
+
+        // The sql parser reads 'TRUNCATE t' as a DELETE without WHERE.
+        if (MatchKeyword(query, "TRUNCATE", &args)) {
+            return parseTruncateStmt(args);
+        }
+
+        std::string rest;
+        if (MatchKeyword(query, "ALTER", &args) && MatchKeyword(args, "TABLE", &rest)) {
+            return parseAlterTableStmt(rest);
+        }
+
+        if (MatchKeyword(query, "CREATE", &args) && MatchKeyword(args, "TABLE", &rest)) {
+            std::string options;
+            if (SplitTableOptions(&query, &options) && parseTableOptions(options)) {
+                return true;
+            }
+        }
+
         result_ = new SQLParserResult;
+        uint64_t start = MetricsNow();
         SQLParser::parse(query, result_);
+        RecordLatency(kLatencyParse, MetricsNow() - start);
 
         if (result_->isValid()) {
-            return checkStmtsMeta();
+            start = MetricsNow();
+            bool ret = checkStmtsMeta();
+            RecordLatency(kLatencyCheck, MetricsNow() - start);
+            return ret;
         } else {
             std::cout << "[BYDB-Error]  Failed to parse sql statement." << std::endl;
         }
@@ -29,6 +179,148 @@ namespace mydb {
         return true;
     }
 
+    /* Table named 'schema.table' by 'args', nullptr after printing 'usage' or why not. */
+    static Table* LookupTable(std::string& args, const char* usage) {
+        size_t dot = args.find('.');
+        if (dot == std::string::npos || dot == 0 || dot == args.size() - 1 ||
+            args.find_first_of(" \t,", 0) != std::string::npos) {
+            std::cout << "[BYDB-Error]  Usage: " << usage << std::endl;
+            return nullptr;
+        }
+
+        std::string schema = args.substr(0, dot);
+        std::string name = args.substr(dot + 1);
+        Table* table = g_meta_data.getTable(&schema[0], &name[0]);
+        if (table == nullptr) {
+            std::cout << "[BYDB-Error]  Table " << args << " did not exist!" << std::endl;
+        }
+        return table;
+    }
+
+    /* 'ANALYZE' collects statistics of every table, 'ANALYZE db.t' of one table. */
+    bool Parser::parseAnalyzeStmt(std::string args) {
+        if (args.empty()) {
+            g_meta_data.getAllTables(&analyzeTables_);
+            return false;
+        }
+
+        Table* table = LookupTable(args, "ANALYZE [schema.table]");
+        if (table == nullptr) {
+            return true;
+        }
+        analyzeTables_.push_back(table);
+        return false;
+    }
+
+    /*
+     * '(ttl_column = ts, ttl = '30 days')' after the WITH of a CREATE TABLE,
+     * '(partition_column = ts, partition_range = '1 day')' or
+     * '(partition_column = id, partition_hash = 16)'.
+     */
+    bool Parser::parseTableOptions(std::string options) {
+        options = TrimSpaces(options.substr(0, options.find_last_not_of(" \t;") + 1));
+        if (options.size() < 2 || options.front() != '(' || options.back() != ')') {
+            std::cout << "[BYDB-Error]  Usage: CREATE TABLE ... WITH (ttl_column = column, "
+                         "ttl = 'N days', partition_column = column, "
+                         "partition_range = 'N days' | partition_hash = N)" << std::endl;
+            return true;
+        }
+
+        options = options.substr(1, options.size() - 2);
+        size_t pos = 0;
+        while (pos <= options.size()) {
+            size_t comma = std::min(options.find(',', pos), options.size());
+            std::string option = TrimSpaces(options.substr(pos, comma - pos));
+            pos = comma + 1;
+            size_t eq = option.find('=');
+            std::string key = TrimSpaces(option.substr(0, eq));
+            std::string val = (eq == std::string::npos) ? "" : TrimSpaces(option.substr(eq + 1));
+            if (val.size() >= 2 && (val[0] == '\'' || val[0] == '"') && val.back() == val[0]) {
+                val = val.substr(1, val.size() - 2);
+            }
+
+            bool invalid = val.empty();
+            if (strcasecmp(key.c_str(), "ttl_column") == 0) {
+                ttlColumn_ = val;
+            } else if (strcasecmp(key.c_str(), "ttl") == 0) {
+                invalid = invalid || ParseDuration(val, &tableTtl_.seconds);
+            } else if (strcasecmp(key.c_str(), "partition_column") == 0) {
+                partitionColumn_ = val;
+            } else if (strcasecmp(key.c_str(), "partition_range") == 0 &&
+                       partitionSpec_.kind == kNoPartitions) {
+                partitionSpec_.kind = kRangePartitions;
+                invalid = invalid || ParseDuration(val, &partitionSpec_.width);
+            } else if (strcasecmp(key.c_str(), "partition_hash") == 0 &&
+                       partitionSpec_.kind == kNoPartitions) {
+                char* end = nullptr;
+                partitionSpec_.kind = kHashPartitions;
+                partitionSpec_.width = strtoll(val.c_str(), &end, 10);
+                invalid = invalid || *end != '\0' || partitionSpec_.width <= 0 ||
+                          partitionSpec_.width > PARTITION_HASH_MAX;
+            } else {
+                invalid = true;
+            }
+            if (invalid) {
+                std::cout << "[BYDB-Error]  Invalid table option '" << option << "'" << std::endl;
+                return true;
+            }
+        }
+
+        if (ttlColumn_.empty() != (tableTtl_.seconds == 0)) {
+            std::cout << "[BYDB-Error]  Table option ttl_column needs ttl and the other way round."
+                      << std::endl;
+            return true;
+        }
+        if (partitionColumn_.empty() != (partitionSpec_.kind == kNoPartitions)) {
+            std::cout << "[BYDB-Error]  Table option partition_column needs partition_range or "
+                         "partition_hash and the other way round." << std::endl;
+            return true;
+        }
+        return false;
+    }
+
+    /* 'ALTER TABLE db.t DROP PARTITION value', the partition of the rows with that value. */
+    bool Parser::parseAlterTableStmt(std::string args) {
+        const char* usage = "ALTER TABLE schema.table DROP PARTITION value";
+        size_t space = args.find_first_of(" \t");
+        std::string name = args.substr(0, space);
+        std::string rest = (space == std::string::npos) ? "" : args.substr(space);
+        std::string partition;
+        std::string value;
+        if (!MatchKeyword(rest, "DROP", &partition) ||
+            !MatchKeyword(partition, "PARTITION", &value) || value.empty()) {
+            std::cout << "[BYDB-Error]  Usage: " << usage << std::endl;
+            return true;
+        }
+
+        dropPartitionTable_ = LookupTable(name, usage);
+        if (dropPartitionTable_ == nullptr) {
+            return true;
+        }
+        char* end = nullptr;
+        errno = 0;
+        long long val = strtoll(value.c_str(), &end, 10);
+        if (strcasecmp(value.c_str(), "NULL") == 0) {
+            dropPartitionValue_ = Expr::makeNullLiteral();
+        } else if (*end == '\0' && errno != ERANGE) {
+            dropPartitionValue_ = Expr::makeLiteral(static_cast<int64_t>(val));
+        } else {
+            std::cout << "[BYDB-Error]  Usage: " << usage << std::endl;
+            return true;
+        }
+        return false;
+    }
+
+    /* 'TRUNCATE [TABLE] db.t' */
+    bool Parser::parseTruncateStmt(std::string args) {
+        std::string name;
+        if (MatchKeyword(args, "TABLE", &name)) {
+            args = name;
+        }
+        truncateTable_ = LookupTable(args, "TRUNCATE [TABLE] schema.table");
+        return truncateTable_ == nullptr;
+    }
+
     bool Parser::checkStmtsMeta() {
         for (size_t i = 0; i < result_->size(); ++i) {
             const SQLStatement* stmt = result_->getStatement(i);
@@ -67,12 +359,8 @@ namespace mydb {
     }
 
     bool Parser::checkSelectStmt(const SelectStatement* stmt) {
-        TableRef* table_ref = stmt->fromTable;
-        Table* table = getTable(table_ref);
-        if (table == nullptr) {
-            std::cout << "[BYDB-Error]  Can not find table "
-                      << TableNameToString(table_ref->schema, table_ref->name)
-                      << std::endl;
+        std::vector<TableScope> scopes;
+        if (checkTableRef(stmt->fromTable, &scopes)) {
             return true;
         }
 
@@ -100,31 +388,31 @@ namespace mydb {
 
         if (stmt->selectList != nullptr) {
             for (auto expr : *stmt->selectList) {
-                if (checkExpr(table, expr)) {
+                if (checkExpr(scopes, expr)) {
                     return true;
                 }
             }
         }
 
         if (stmt->whereClause != nullptr) {
-            if (checkExpr(table, stmt->whereClause)) {
+            if (checkExpr(scopes, stmt->whereClause)) {
                 return true;
             }
         }
 
         if (stmt->order != nullptr) {
             for (auto order : *stmt->order) {
-                if (checkExpr(table, order->expr)) {
+                if (checkExpr(scopes, order->expr)) {
                     return true;
                 }
             }
         }
 
         if (stmt->limit != nullptr) {
-            if (checkExpr(table, stmt->limit->limit)) {
+            if (stmt->limit->limit != nullptr && checkExpr(scopes, stmt->limit->limit)) {
                 return true;
             }
-            if (checkExpr(table, stmt->limit->offset)) {
+            if (stmt->limit->offset != nullptr && checkExpr(scopes, stmt->limit->offset)) {
                 return true;
             }
         }
@@ -200,18 +488,27 @@ namespace mydb {
             return true;
         }
 
+        std::vector<TableScope> scopes(1, TableScope(table->name(), table, 0));
+        PartitionSpec& spec = table->getTableStore()->partitioning();
         if (stmt->updates != nullptr) {
             for (auto update : *stmt->updates) {
                 if (checkColumn(table, update->column)) {
                     return true;
                 }
-                if (checkExpr(table, update->value)) {
+                // Rows stay in the tuple groups of their partition.
+                if (spec.kind != kNoPartitions &&
+                    strcmp((*table->columns())[spec.column]->name, update->column) == 0) {
+                    std::cout << "[BYDB-Error]  Can not update " << update->column
+                              << ", the partition column of the table." << std::endl;
+                    return true;
+                }
+                if (checkExpr(scopes, update->value)) {
                     return true;
                 }
             }
         }
 
-        if (checkExpr(table, stmt->where)) {
+        if (checkExpr(scopes, stmt->where)) {
             return true;
         }
 
@@ -226,7 +523,8 @@ namespace mydb {
             return true;
         }
 
-        if (checkExpr(table, stmt->expr)) {
+        std::vector<TableScope> scopes(1, TableScope(table->name(), table, 0));
+        if (checkExpr(scopes, stmt->expr)) {
             return true;
         }
 
@@ -250,6 +548,37 @@ namespace mydb {
         return table;
     }
 
+    bool Parser::checkTableRef(TableRef* table_ref, std::vector<TableScope>* scopes) {
+        switch (table_ref->type) {
+            case kTableName: {
+                Table* table = getTable(table_ref);
+                if (table == nullptr) {
+                    return true;
+                }
+                scopes->push_back(TableScope(table_ref->getName(), table, 0));
+                return false;
+            }
+            case kTableJoin: {
+                JoinDefinition* join = table_ref->join;
+                if (join->type != kJoinInner && join->type != kJoinLeft) {
+                    std::cout << "[BYDB-Error]  Only support inner join and left join." << std::endl;
+                    return true;
+                }
+                if (join->condition == nullptr) {
+                    std::cout << "[BYDB-Error]  Join condition should be specified." << std::endl;
+                    return true;
+                }
+                if (checkTableRef(join->left, scopes) || checkTableRef(join->right, scopes)) {
+                    return true;
+                }
+                return checkExpr(*scopes, join->condition);
+            }
+            default:
+                std::cout << "[BYDB-Error]  Only support ordinary table and join." << std::endl;
+                return true;
+        }
+    }
+
     bool Parser::checkColumn(Table* table, char* col_name) {
         for (auto col_def : *table->columns()) {
             if (strcmp(col_name, col_def->name) == 0) {
@@ -262,26 +591,66 @@ namespace mydb {
         return true;
     }
 
-    bool Parser::checkExpr(Table* table, Expr* expr) {
+    bool Parser::checkColumnRef(std::vector<TableScope>& scopes, Expr* expr) {
+        int found = 0;
+        for (auto& scope : scopes) {
+            if (expr->table != nullptr && strcmp(expr->table, scope.name) != 0) {
+                continue;
+            }
+            if (scope.table->getColumn(expr->name) != nullptr) {
+                found++;
+            }
+        }
+
+        if (found == 0) {
+            std::cout << "[BYDB-Error]  Can not find column " << expr->name << std::endl;
+            return true;
+        }
+        if (found > 1) {
+            std::cout << "[BYDB-Error]  Column " << expr->name << " is ambiguous." << std::endl;
+            return true;
+        }
+        return false;
+    }
+
+    bool Parser::checkExpr(std::vector<TableScope>& scopes, Expr* expr) {
+        if (expr == nullptr) {
+            return false;
+        }
+
         switch (expr->type) {
             case kExprLiteralFloat:
             case kExprLiteralString:
             case kExprLiteralInt:
+            case kExprLiteralNull:
             case kExprStar:
                 return false;
             case kExprSelect:
-                return checkExpr(table, expr->expr);
-            case kExprOperator: {
-                if (expr->expr != nullptr && checkExpr(table, expr->expr)) {
+                return checkExpr(scopes, expr->expr);
+            case kExprOperator:
+            case kExprFunctionRef:
+            case kExprCast: {
+                if (expr->expr != nullptr && checkExpr(scopes, expr->expr)) {
                     return true;
                 }
-                if (expr->expr2 != nullptr && checkExpr(table, expr->expr2)) {
+                if (expr->expr2 != nullptr && checkExpr(scopes, expr->expr2)) {
+                    return true;
+                }
+                if (expr->exprList != nullptr) {
+                    for (auto arg : *expr->exprList) {
+                        if (checkExpr(scopes, arg)) {
+                            return true;
+                        }
+                    }
+                }
+                if (expr->opType == kOpIn && expr->select != nullptr &&
+                    checkSelectStmt(expr->select)) {
                     return true;
                 }
                 break;
             }
             case kExprColumnRef: {
-                if (checkColumn(table, expr->name)) {
+                if (checkColumnRef(scopes, expr)) {
                     return true;
                 }
                 break;
@@ -348,14 +717,37 @@ namespace mydb {
                     return true;
                 }
                 break;
+            case kCreateIndex:
+                if (checkCreateIndexStmt(stmt)) {
+                    return true;
+                }
+                break;
             default:
-                std::cout << "[BYDB-Error]  Only support 'Create Table'." << std::endl;
+                std::cout << "[BYDB-Error]  Only support 'Create Table' and 'Create Index'."
+                          << std::endl;
                 return true;
         }
 
         return false;
     }
 
+    /* Position of the INT or LONG column 'name' of a new table; true if there is none. */
+    static bool FindIntColumn(const CreateStatement* stmt, std::string& name, const char* what,
+                              size_t* idx) {
+        for (size_t i = 0; i < stmt->columns->size(); i++) {
+            ColumnDefinition* col_def = (*stmt->columns)[i];
+            if (strcmp(col_def->name, name.c_str()) == 0 &&
+                (col_def->type.data_type == DataType::INT ||
+                 col_def->type.data_type == DataType::LONG)) {
+                *idx = i;
+                return false;
+            }
+        }
+        std::cout << "[BYDB-Error]  " << what << " column " << name
+                  << " should be an INT or LONG column of the table." << std::endl;
+        return true;
+    }
+
     bool Parser::checkCreateTableStmt(const CreateStatement* stmt) {
         if (stmt->schema == nullptr || stmt->tableName == nullptr) {
             std::cout << "[BYDB-Error]: Schema and table name should be specified in "
@@ -396,6 +788,15 @@ namespace mydb {
             }
         }
 
+        // The TTL column holds seconds since the epoch.
+        if (!ttlColumn_.empty() && FindIntColumn(stmt, ttlColumn_, "TTL", &tableTtl_.column)) {
+            return true;
+        }
+        if (!partitionColumn_.empty() &&
+            FindIntColumn(stmt, partitionColumn_, "Partition", &partitionSpec_.column)) {
+            return true;
+        }
+
         return false;
     }
 
@@ -410,7 +811,11 @@ namespace mydb {
         }
 
         // Check if each column of this index existed.
-        Table* table = g_meta_data.getTable(stmt->schema, stmt->tableName);
+        Table* table =
+                g_meta_data.getIndexTable(stmt->schema, stmt->tableName, stmt->indexName);
+        if (table == nullptr) {
+            return true;
+        }
         for (auto idx_col : *stmt->indexColumns) {
             if (checkColumn(table, idx_col)) {
                 return true;
@@ -444,8 +849,7 @@ namespace mydb {
                 if (g_meta_data.getIndex(stmt->schema, stmt->name, stmt->indexName) ==
                     nullptr &&
                     !stmt->ifExists) {
-                    std::cout << "[BYDB-Error]  Index " << stmt->indexName << " of "
-                              << TableNameToString(stmt->schema, stmt->name)
+                    std::cout << "[BYDB-Error]  Index " << stmt->indexName
                               << " did not exist!" << std::endl;
                     return true;
                 }
@@ -1,4 +1,6 @@
 #pragma once
+#include "metadata.h"
+
 #include "SQLParser.h"
 #include "SQLParserResult.h"
 #include "util/sqlhelper.h"
@@ -15,7 +17,30 @@ namespace mydb {
 
         SQLParserResult* getResult() { return result_; }
 
+        /* Statements the sql parser does not know are recognized before calling it. */
+        bool isAnalyze() { return isAnalyze_; }
+        std::vector<Table*>& analyzeTables() { return analyzeTables_; }
+        bool isExplain() { return isExplain_; }
+        bool isExplainAnalyze() { return isExplainAnalyze_; }
+        bool isShowMetrics() { return isShowMetrics_; }
+        bool isTruncate() { return truncateTable_ != nullptr; }
+        Table* truncateTable() { return truncateTable_; }
+        bool isDropPartition() { return dropPartitionTable_ != nullptr; }
+        Table* dropPartitionTable() { return dropPartitionTable_; }
+        Expr* dropPartitionValue() { return dropPartitionValue_; }
+        /* Options of CREATE TABLE, which the sql parser sees without its WITH clause. */
+        TableTtl& tableTtl() { return tableTtl_; }
+        PartitionSpec& partitionSpec() { return partitionSpec_; }
+
     private:
+        bool parseAnalyzeStmt(std::string args);
+
+        bool parseTruncateStmt(std::string args);
+
+        bool parseAlterTableStmt(std::string args);
+
+        bool parseTableOptions(std::string options);
+
         bool checkStmtsMeta();
 
         bool checkMeta(const SQLStatement* stmt);
@@ -38,13 +63,29 @@ namespace mydb {
 
         Table* getTable(TableRef* table_ref);
 
+        bool checkTableRef(TableRef* table_ref, std::vector<TableScope>* scopes);
+
         bool checkColumn(Table* table, char* col_name);
 
-        bool checkExpr(Table* table, Expr* expr);
+        bool checkColumnRef(std::vector<TableScope>& scopes, Expr* expr);
+
+        bool checkExpr(std::vector<TableScope>& scopes, Expr* expr);
 
         bool checkValues(std::vector<ColumnDefinition*>* columns, std::vector<Expr*>* values);
 
         SQLParserResult* result_;
+        bool isAnalyze_;
+        std::vector<Table*> analyzeTables_;
+        bool isExplain_;
+        bool isExplainAnalyze_;
+        bool isShowMetrics_;
+        Table* truncateTable_;
+        Table* dropPartitionTable_;
+        Expr* dropPartitionValue_;
+        TableTtl tableTtl_;
+        std::string ttlColumn_;
+        PartitionSpec partitionSpec_;
+        std::string partitionColumn_;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,7 @@
+#include "profile.h"
+
+namespace mydb {
+
+    thread_local ProfileCounters g_profile_counters = {false, 0, 0, 0};
+
+}
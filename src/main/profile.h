@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mydb {
+
+    /*
+     * Counters of the current thread that EXPLAIN ANALYZE reads before and
+     * after every operator call. Allocations are counted where the engine
+     * makes them (the statement arena, tuple groups and the string heap),
+     * only while a profiled operator runs; bytes read by the operators that
+     * parse stored tuples.
+     */
+    struct ProfileCounters {
+        bool active;
+        uint64_t allocs;
+        uint64_t allocBytes;
+        uint64_t bytesRead;
+    };
+
+    extern thread_local ProfileCounters g_profile_counters;
+
+    static inline void CountAlloc(size_t size) {
+        if (g_profile_counters.active) {
+            g_profile_counters.allocs++;
+            g_profile_counters.allocBytes += size;
+        }
+    }
+
+    /* What one operator did during EXPLAIN ANALYZE, including its inputs. */
+    struct OperatorProfile {
+        OperatorProfile() : calls(0), rows(0), nanos(0), allocs(0), allocBytes(0), bytesRead(0) {}
+        uint64_t calls;
+        uint64_t rows;
+        uint64_t nanos;
+        uint64_t allocs;
+        uint64_t allocBytes;
+        uint64_t bytesRead;
+    };
+
+}
@@ -0,0 +1,78 @@
+#include "session.h"
+#include "executor.h"
+#include "metrics.h"
+#include "optimizer.h"
+#include "parser.h"
+
+using namespace hsql;
+
+namespace mydb {
+
+    /* Reused by every statement of the thread, so its first block is only allocated once. */
+    static thread_local Arena g_stmt_arena;
+
+    bool ExecStmt(std::string stmt) {
+        ArenaScope arena_scope(&g_stmt_arena);
+        Parser parser;
+        if (parser.parseStatement(stmt)) {
+            return true;
+        }
+
+        Optimizer optimizer(&g_stmt_arena);
+        if (parser.isAnalyze() || parser.isShowMetrics() || parser.isTruncate() ||
+            parser.isDropPartition()) {
+            Plan* plan = nullptr;
+            if (parser.isAnalyze()) {
+                plan = optimizer.createAnalyzePlanTree(parser.analyzeTables());
+            } else if (parser.isShowMetrics()) {
+                plan = optimizer.createMetricsPlanTree();
+            } else if (parser.isTruncate()) {
+                plan = optimizer.createTruncatePlanTree(parser.truncateTable());
+            } else {
+                plan = optimizer.createDropPartitionPlanTree(parser.dropPartitionTable(),
+                                                             parser.dropPartitionValue());
+            }
+            Executor executor(plan, &g_stmt_arena);
+            if (parser.isExplain()) {
+                return executor.explain(parser.isExplainAnalyze());
+            }
+            executor.init();
+            return executor.exec();
+        }
+
+        SQLParserResult* result = parser.getResult();
+
+        for (size_t i = 0; i < result->size(); ++i) {
+            const SQLStatement* stmt = result->getStatement(i);
+            uint64_t start = MetricsNow();
+            Plan* plan = optimizer.createPlanTree(stmt);
+            RecordLatency(kLatencyPlan, MetricsNow() - start);
+            if (plan == nullptr) {
+                return true;
+            }
+            if (plan->planType == kCreate) {
+                static_cast<CreatePlan*>(plan)->ttl = parser.tableTtl();
+                static_cast<CreatePlan*>(plan)->partitions = parser.partitionSpec();
+            }
+
+            Executor executor(plan, &g_stmt_arena);
+            if (parser.isExplain()) {
+                if (executor.explain(parser.isExplainAnalyze())) {
+                    return true;
+                }
+                continue;
+            }
+
+            start = MetricsNow();
+            executor.init();
+            bool ret = executor.exec();
+            RecordLatency(kLatencyExecute, MetricsNow() - start);
+            if (ret) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+}
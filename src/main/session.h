@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+namespace mydb {
+
+    /* Parse, plan and execute one line of SQL. Returns true on error. */
+    bool ExecStmt(std::string stmt);
+
+}
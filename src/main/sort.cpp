@@ -0,0 +1,431 @@
+#include "sort.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+using namespace hsql;
+
+namespace mydb {
+
+/* Every row blob starts with its total length. */
+#define SORT_BLOB_HEADER_SIZE sizeof(uint32_t)
+
+    enum SortValueTag { kSortNull, kSortInt, kSortFloat, kSortString };
+
+    static inline uint32_t BlobSize(uchar* blob) {
+        return *reinterpret_cast<uint32_t*>(blob);
+    }
+
+    static inline uchar* BlobKey(uchar* blob) {
+        return blob + SORT_BLOB_HEADER_SIZE;
+    }
+
+    size_t NormalizedWidth(ColumnDefinition* col) {
+        switch (col->type.data_type) {
+            case DataType::INT:
+            case DataType::LONG:
+                return 1 + sizeof(int64_t);
+            case DataType::CHAR:
+            case DataType::VARCHAR:
+                return 1 + col->type.length;
+            default:
+                return 1;
+        }
+    }
+
+    /*
+     * Normalized values compare with memcmp in the value order: a leading byte
+     * that is 0 for NULL, integers big-endian with the sign bit flipped and
+     * strings zero padded to the column length.
+     */
+    void NormalizeInt(int64_t val, uchar* ptr) {
+        uint64_t v = static_cast<uint64_t>(val) ^ (1ULL << 63);
+        ptr[0] = 1;
+        for (size_t j = 0; j < sizeof(uint64_t); j++) {
+            ptr[1 + j] = static_cast<uchar>(v >> (56 - 8 * j));
+        }
+    }
+
+    void NormalizeString(const char* val, size_t len, size_t width, uchar* ptr) {
+        ptr[0] = 1;
+        memcpy(ptr + 1, val, len);
+        memset(ptr + 1 + len, 0, width - len);
+    }
+
+    void NormalizeValue(Expr* val, ColumnDefinition* col, uchar* ptr) {
+        size_t width = NormalizedWidth(col);
+        if (val->type == kExprLiteralInt) {
+            NormalizeInt(val->ival, ptr);
+        } else if (val->type == kExprLiteralString) {
+            NormalizeString(val->name, strnlen(val->name, width - 1), width - 1, ptr);
+        } else {
+            memset(ptr, 0, width);
+        }
+    }
+
+    static inline bool KeyLess(uchar* a, uchar* b, size_t key_size) {
+        return memcmp(BlobKey(a), BlobKey(b), key_size) < 0;
+    }
+
+    Sorter::Sorter(std::vector<SortKey>& keys, size_t memLimit, uint64_t limit)
+            : keys_(keys), keySize_(0), intKeys_(true), memLimit_(memLimit), memUsed_(0),
+              limit_(limit), pos_(0) {
+        // Each key column takes a null byte plus its fixed width.
+        for (auto& key : keys_) {
+            keyOffset_.push_back(keySize_);
+            keySize_ += NormalizedWidth(key.col);
+            if (key.col->type.data_type != DataType::INT &&
+                key.col->type.data_type != DataType::LONG) {
+                intKeys_ = false;
+            }
+        }
+        keyBuf_.resize(keySize_);
+    }
+
+    Sorter::~Sorter() {
+        for (size_t i = pos_; i < rows_.size(); i++) {
+            free(rows_[i]);
+        }
+        for (auto& run : runs_) {
+            free(run.cur);
+            fclose(run.file);
+        }
+    }
+
+    bool Sorter::addRow(std::vector<Expr*>& values) {
+        if (limit_ > 0) {
+            return addTopRow(values);
+        }
+
+        size_t size = SORT_BLOB_HEADER_SIZE + keySize_ + payloadSize(values);
+        uchar* blob = static_cast<uchar*>(malloc(size));
+        if (blob == nullptr) {
+            std::cout << "[BYDB-Error]  Failed to malloc " << size << " bytes" << std::endl;
+            return true;
+        }
+
+        *reinterpret_cast<uint32_t*>(blob) = static_cast<uint32_t>(size);
+        encodeKey(values, BlobKey(blob));
+        encodePayload(values, BlobKey(blob) + keySize_);
+        rows_.push_back(blob);
+
+        memUsed_ += size + sizeof(uchar*);
+        if (memUsed_ > memLimit_) {
+            return spillRun();
+        }
+        return false;
+    }
+
+    bool Sorter::finish() {
+        if (limit_ > 0) {
+            size_t key_size = keySize_;
+            std::sort_heap(rows_.begin(), rows_.end(), [key_size](uchar* a, uchar* b) {
+                return KeyLess(a, b, key_size);
+            });
+            pos_ = 0;
+            return false;
+        }
+
+        if (runs_.empty()) {
+            sortRows();
+            pos_ = 0;
+            return false;
+        }
+
+        if (!rows_.empty() && spillRun()) {
+            return true;
+        }
+
+        for (size_t i = 0; i < runs_.size(); i++) {
+            if (readBlob(runs_[i])) {
+                return true;
+            }
+            if (runs_[i].cur != nullptr) {
+                heap_.push_back(i);
+            }
+        }
+
+        auto cmp = [this](size_t a, size_t b) {
+            return memcmp(BlobKey(runs_[a].cur), BlobKey(runs_[b].cur), keySize_) > 0;
+        };
+        std::make_heap(heap_.begin(), heap_.end(), cmp);
+        return false;
+    }
+
+    bool Sorter::getNext(std::vector<Expr*>& values, bool* eof, Arena* arena) {
+        *eof = false;
+        if (runs_.empty()) {
+            if (pos_ >= rows_.size()) {
+                *eof = true;
+                return false;
+            }
+            uchar* blob = rows_[pos_++];
+            decodePayload(blob, values, arena);
+            free(blob);
+            return false;
+        }
+
+        if (heap_.empty()) {
+            *eof = true;
+            return false;
+        }
+
+        auto cmp = [this](size_t a, size_t b) {
+            return memcmp(BlobKey(runs_[a].cur), BlobKey(runs_[b].cur), keySize_) > 0;
+        };
+        std::pop_heap(heap_.begin(), heap_.end(), cmp);
+        Run& run = runs_[heap_.back()];
+        decodePayload(run.cur, values, arena);
+        free(run.cur);
+        run.cur = nullptr;
+
+        if (readBlob(run)) {
+            return true;
+        }
+        if (run.cur == nullptr) {
+            heap_.pop_back();
+        } else {
+            std::push_heap(heap_.begin(), heap_.end(), cmp);
+        }
+        return false;
+    }
+
+    /* Build the memcmp-able key of a row, with DESC columns bit inverted. */
+    void Sorter::encodeKey(std::vector<Expr*>& values, uchar* key) {
+        for (size_t i = 0; i < keys_.size(); i++) {
+            SortKey& sort_key = keys_[i];
+            uchar* ptr = key + keyOffset_[i];
+            NormalizeValue(values[sort_key.idx], sort_key.col, ptr);
+
+            if (!sort_key.isAsc) {
+                size_t width = NormalizedWidth(sort_key.col);
+                for (size_t j = 0; j < width; j++) {
+                    ptr[j] = ~ptr[j];
+                }
+            }
+        }
+    }
+
+    size_t Sorter::payloadSize(std::vector<Expr*>& values) {
+        size_t size = 0;
+        for (auto val : values) {
+            size += 1;
+            switch (val->type) {
+                case kExprLiteralInt:
+                    size += sizeof(int64_t);
+                    break;
+                case kExprLiteralFloat:
+                    size += sizeof(double);
+                    break;
+                case kExprLiteralString:
+                    size += sizeof(uint32_t) + strlen(val->name);
+                    break;
+                default:
+                    break;
+            }
+        }
+        return size;
+    }
+
+    void Sorter::encodePayload(std::vector<Expr*>& values, uchar* ptr) {
+        for (auto val : values) {
+            switch (val->type) {
+                case kExprLiteralInt:
+                    *ptr++ = kSortInt;
+                    memcpy(ptr, &val->ival, sizeof(int64_t));
+                    ptr += sizeof(int64_t);
+                    break;
+                case kExprLiteralFloat:
+                    *ptr++ = kSortFloat;
+                    memcpy(ptr, &val->fval, sizeof(double));
+                    ptr += sizeof(double);
+                    break;
+                case kExprLiteralString: {
+                    uint32_t len = strlen(val->name);
+                    *ptr++ = kSortString;
+                    memcpy(ptr, &len, sizeof(uint32_t));
+                    ptr += sizeof(uint32_t);
+                    memcpy(ptr, val->name, len);
+                    ptr += len;
+                    break;
+                }
+                default:
+                    *ptr++ = kSortNull;
+                    break;
+            }
+        }
+    }
+
+    void Sorter::decodePayload(uchar* blob, std::vector<Expr*>& values, Arena* arena) {
+        uchar* ptr = BlobKey(blob) + keySize_;
+        uchar* end = blob + BlobSize(blob);
+        while (ptr < end) {
+            Expr* e = nullptr;
+            switch (*ptr++) {
+                case kSortInt: {
+                    int64_t val;
+                    memcpy(&val, ptr, sizeof(int64_t));
+                    ptr += sizeof(int64_t);
+                    e = (arena != nullptr) ? arena->makeLiteral(val) : Expr::makeLiteral(val);
+                    break;
+                }
+                case kSortFloat: {
+                    double val;
+                    memcpy(&val, ptr, sizeof(double));
+                    ptr += sizeof(double);
+                    e = (arena != nullptr) ? arena->makeLiteral(val) : Expr::makeLiteral(val);
+                    break;
+                }
+                case kSortString: {
+                    uint32_t len;
+                    memcpy(&len, ptr, sizeof(uint32_t));
+                    ptr += sizeof(uint32_t);
+                    if (arena != nullptr) {
+                        e = arena->makeLiteral(reinterpret_cast<char*>(ptr), len);
+                        ptr += len;
+                        break;
+                    }
+                    char* val = static_cast<char*>(malloc(len + 1));
+                    memcpy(val, ptr, len);
+                    val[len] = '\0';
+                    ptr += len;
+                    e = Expr::makeLiteral(val);
+                    break;
+                }
+                default:
+                    e = (arena != nullptr) ? arena->makeNullLiteral() : Expr::makeNullLiteral();
+                    break;
+            }
+            values.push_back(e);
+        }
+    }
+
+    /*
+     * Keep the smallest `limit_` rows in a max-heap. The key is encoded into a
+     * scratch buffer first so rows that lose against the heap top are never
+     * copied.
+     */
+    bool Sorter::addTopRow(std::vector<Expr*>& values) {
+        size_t key_size = keySize_;
+        auto cmp = [key_size](uchar* a, uchar* b) { return KeyLess(a, b, key_size); };
+
+        uchar* key = keyBuf_.data();
+        encodeKey(values, key);
+        if (rows_.size() >= limit_ && memcmp(key, BlobKey(rows_.front()), keySize_) >= 0) {
+            return false;
+        }
+
+        size_t size = SORT_BLOB_HEADER_SIZE + keySize_ + payloadSize(values);
+        uchar* blob = static_cast<uchar*>(malloc(size));
+        if (blob == nullptr) {
+            std::cout << "[BYDB-Error]  Failed to malloc " << size << " bytes" << std::endl;
+            return true;
+        }
+        *reinterpret_cast<uint32_t*>(blob) = static_cast<uint32_t>(size);
+        memcpy(BlobKey(blob), key, keySize_);
+        encodePayload(values, BlobKey(blob) + keySize_);
+
+        if (rows_.size() >= limit_) {
+            std::pop_heap(rows_.begin(), rows_.end(), cmp);
+            free(rows_.back());
+            rows_.pop_back();
+        }
+        rows_.push_back(blob);
+        std::push_heap(rows_.begin(), rows_.end(), cmp);
+        return false;
+    }
+
+    void Sorter::sortRows() {
+        if (intKeys_) {
+            radixSort();
+            return;
+        }
+
+        size_t key_size = keySize_;
+        std::stable_sort(rows_.begin(), rows_.end(), [key_size](uchar* a, uchar* b) {
+            return KeyLess(a, b, key_size);
+        });
+    }
+
+    /* LSD radix sort on the normalized key, skipping bytes that never differ. */
+    void Sorter::radixSort() {
+        std::vector<uchar*> tmp(rows_.size());
+        size_t count[256];
+
+        for (size_t b = keySize_; b-- > 0;) {
+            memset(count, 0, sizeof(count));
+            for (auto row : rows_) {
+                count[BlobKey(row)[b]]++;
+            }
+            if (rows_.empty() || count[BlobKey(rows_[0])[b]] == rows_.size()) {
+                continue;
+            }
+
+            size_t sum = 0;
+            for (size_t i = 0; i < 256; i++) {
+                size_t c = count[i];
+                count[i] = sum;
+                sum += c;
+            }
+            for (auto row : rows_) {
+                tmp[count[BlobKey(row)[b]]++] = row;
+            }
+            rows_.swap(tmp);
+        }
+    }
+
+    bool Sorter::spillRun() {
+        sortRows();
+
+        FILE* file = tmpfile();
+        if (file == nullptr) {
+            std::cout << "[BYDB-Error]  Failed to create temp file for sort run" << std::endl;
+            return true;
+        }
+
+        bool ret = false;
+        for (auto blob : rows_) {
+            if (!ret && fwrite(blob, BlobSize(blob), 1, file) != 1) {
+                std::cout << "[BYDB-Error]  Failed to write sort run" << std::endl;
+                ret = true;
+            }
+            free(blob);
+        }
+        rows_.clear();
+        memUsed_ = 0;
+
+        rewind(file);
+        Run run;
+        run.file = file;
+        run.cur = nullptr;
+        runs_.push_back(run);
+        return ret;
+    }
+
+    bool Sorter::readBlob(Run& run) {
+        uint32_t size;
+        run.cur = nullptr;
+        if (fread(&size, sizeof(uint32_t), 1, run.file) != 1) {
+            return false;
+        }
+
+        uchar* blob = static_cast<uchar*>(malloc(size));
+        if (blob == nullptr) {
+            std::cout << "[BYDB-Error]  Failed to malloc " << size << " bytes" << std::endl;
+            return true;
+        }
+        *reinterpret_cast<uint32_t*>(blob) = size;
+        size_t body = size - SORT_BLOB_HEADER_SIZE;
+        if (fread(blob + SORT_BLOB_HEADER_SIZE, 1, body, run.file) != body) {
+            std::cout << "[BYDB-Error]  Failed to read sort run" << std::endl;
+            free(blob);
+            return true;
+        }
+
+        run.cur = blob;
+        return false;
+    }
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "storage.h"
+
+#include "sql/statements.h"
+
+#include <cstdio>
+#include <vector>
+
+using namespace hsql;
+
+namespace mydb {
+
+/* Memory a single sort may hold before spilling sorted runs to temp files. */
+#define SORT_MEMORY_LIMIT (64 * 1024 * 1024)
+/* Largest ORDER BY ... LIMIT that is answered with a bounded heap. */
+#define TOPN_MAX_ROWS 10000
+
+    size_t NormalizedWidth(ColumnDefinition* col);
+    void NormalizeInt(int64_t val, uchar* ptr);
+    void NormalizeString(const char* val, size_t len, size_t width, uchar* ptr);
+    void NormalizeValue(Expr* val, ColumnDefinition* col, uchar* ptr);
+
+    struct SortKey {
+        SortKey(ColumnDefinition* c, size_t i, bool asc) : col(c), idx(i), isAsc(asc) {}
+        ColumnDefinition* col;
+        size_t idx;
+        bool isAsc;
+    };
+
+    /*
+     * Sorts rows by a list of keys. Each row is stored as one blob:
+     *   [normalized key][serialized values]
+     * The key is fixed-width and memcmp-able, so the in-memory sort never
+     * looks at Expr. When the buffered rows exceed the memory limit, they are
+     * sorted and written out as a run, and the runs are k-way merged at the end.
+     * With a limit, only the first `limit` rows are kept in a bounded max-heap
+     * and nothing is ever spilled.
+     */
+    class Sorter {
+    public:
+        Sorter(std::vector<SortKey>& keys, size_t memLimit = SORT_MEMORY_LIMIT, uint64_t limit = 0);
+        ~Sorter();
+
+        bool addRow(std::vector<Expr*>& values);
+        bool finish();
+        /* Values are made in 'arena' when given, as parseTuple does. */
+        bool getNext(std::vector<Expr*>& values, bool* eof, Arena* arena = nullptr);
+
+        size_t runCount() { return runs_.size(); }
+
+    private:
+        struct Run {
+            FILE* file;
+            uchar* cur;
+        };
+
+        void encodeKey(std::vector<Expr*>& values, uchar* key);
+        size_t payloadSize(std::vector<Expr*>& values);
+        void encodePayload(std::vector<Expr*>& values, uchar* ptr);
+        void decodePayload(uchar* blob, std::vector<Expr*>& values, Arena* arena);
+
+        bool addTopRow(std::vector<Expr*>& values);
+        void sortRows();
+        void radixSort();
+        bool spillRun();
+        bool readBlob(Run& run);
+
+        std::vector<SortKey> keys_;
+        std::vector<size_t> keyOffset_;
+        size_t keySize_;
+        bool intKeys_;
+        size_t memLimit_;
+        size_t memUsed_;
+        uint64_t limit_;
+        std::vector<uchar> keyBuf_;
+
+        std::vector<uchar*> rows_;
+        size_t pos_;
+
+        std::vector<Run> runs_;
+        std::vector<size_t> heap_;
+    };
+
+}
@@ -0,0 +1,169 @@
+#include "stats.h"
+#include "sort.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace hsql;
+
+namespace mydb {
+
+    static inline uint64_t HashBytes(const std::string& bytes) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (auto c : bytes) {
+            h = (h ^ static_cast<uchar>(c)) * 0x100000001b3ULL;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /* The low bits pick the register, the rank is the position of the first 1 bit in the rest. */
+    void HyperLogLog::add(uint64_t hash) {
+        size_t reg = hash & ((1 << HLL_PRECISION) - 1);
+        uint64_t rest = hash >> HLL_PRECISION;
+        uint8_t rank = 1;
+        while (rank <= 64 - HLL_PRECISION && (rest & 1) == 0) {
+            rank++;
+            rest >>= 1;
+        }
+        registers_[reg] = std::max(registers_[reg], rank);
+    }
+
+    double HyperLogLog::estimate() {
+        double m = registers_.size();
+        double sum = 0;
+        size_t zeros = 0;
+        for (auto reg : registers_) {
+            sum += std::ldexp(1.0, -reg);
+            if (reg == 0) {
+                zeros++;
+            }
+        }
+
+        double alpha = 0.7213 / (1 + 1.079 / m);
+        double est = alpha * m * m / sum;
+        // Small cardinalities are more accurate with linear counting.
+        if (est <= 2.5 * m && zeros > 0) {
+            est = m * std::log(m / zeros);
+        }
+        return est;
+    }
+
+    /*
+     * Fraction of rows equal to key. The distinct count gives the average
+     * case; a value that spans several histogram buckets is frequent and
+     * gets at least the share of the buckets it fills.
+     */
+    double ColumnStats::eqSelectivity(const std::string& key, uint64_t row_count) {
+        if (row_count == 0 || min.empty() || key < min || key > max) {
+            return 0;
+        }
+
+        double non_null = static_cast<double>(row_count - nullCount) / row_count;
+        double sel = non_null / std::max(distinct, 1.0);
+        if (!bounds.empty()) {
+            auto range = std::equal_range(bounds.begin(), bounds.end(), key);
+            size_t spans = range.second - range.first;
+            if (spans > 1) {
+                sel = std::max(sel, non_null * (spans - 1) / bounds.size());
+            }
+        }
+        return sel;
+    }
+
+    /*
+     * One pass over the table: exact null counts and min/max, a HyperLogLog
+     * per column and a reservoir sample of rows for the histograms.
+     */
+    void TableStats::collect(TableStore* table_store, std::vector<ColumnDefinition*>* col_defs) {
+        size_t col_num = col_defs->size();
+        std::vector<HyperLogLog> sketches(col_num);
+        std::vector<std::vector<std::string>> samples(col_num);
+        uint64_t seed = 0x2545f4914f6cdd1dULL;
+
+        rowCount = 0;
+        columns.assign(col_num, ColumnStats());
+        std::vector<std::string> keys(col_num);
+        auto add_row = [&]() {
+            rowCount++;
+
+            // Reservoir sampling: later rows replace a random sampled row.
+            size_t slot = samples[0].size();
+            if (rowCount > STATS_SAMPLE_ROWS) {
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                slot = seed % rowCount;
+            }
+
+            for (size_t i = 0; i < col_num; i++) {
+                ColumnStats& stats = columns[i];
+                std::string& key = keys[i];
+                if (key[0] == 0) {
+                    stats.nullCount++;
+                } else {
+                    sketches[i].add(HashBytes(key));
+                    if (stats.min.empty() || key < stats.min) {
+                        stats.min = key;
+                    }
+                    if (stats.max.empty() || key > stats.max) {
+                        stats.max = key;
+                    }
+                }
+
+                if (slot == samples[i].size()) {
+                    samples[i].push_back(key);
+                } else if (slot < samples[i].size()) {
+                    samples[i][slot] = key;
+                }
+            }
+        };
+
+        for (Tuple* tup = table_store->seqScan(nullptr); tup != nullptr;
+             tup = table_store->seqScan(tup)) {
+            for (size_t i = 0; i < col_num; i++) {
+                keys[i].clear();
+                table_store->appendColumnKey(tup, i, &keys[i]);
+            }
+            add_row();
+        }
+
+        Arena arena;
+        std::vector<Expr*> values;
+        for (auto group : table_store->coldGroups()) {
+            for (size_t row = 0; row < group->rows(); row++) {
+                values.clear();
+                group->decodeRow(row, values, &arena);
+                for (size_t i = 0; i < col_num; i++) {
+                    keys[i].resize(NormalizedWidth((*col_defs)[i]));
+                    uchar* ptr = reinterpret_cast<uchar*>(&keys[i][0]);
+                    NormalizeValue(values[i], (*col_defs)[i], ptr);
+                }
+                add_row();
+            }
+            arena.reset();
+        }
+
+        for (size_t i = 0; i < col_num; i++) {
+            ColumnStats& stats = columns[i];
+            stats.distinct = std::min(sketches[i].estimate(),
+                                      static_cast<double>(rowCount - stats.nullCount));
+
+            std::vector<std::string>& sample = samples[i];
+            sample.erase(std::remove_if(sample.begin(), sample.end(),
+                                        [](const std::string& k) { return k[0] == 0; }),
+                         sample.end());
+            if (sample.empty()) {
+                continue;
+            }
+            std::sort(sample.begin(), sample.end());
+            size_t bucket_num = std::min(sample.size(), static_cast<size_t>(HISTOGRAM_BUCKETS));
+            for (size_t b = 1; b <= bucket_num; b++) {
+                stats.bounds.push_back(sample[b * sample.size() / bucket_num - 1]);
+            }
+        }
+    }
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "storage.h"
+
+#include "sql/statements.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace hsql;
+
+namespace mydb {
+
+/* 2^HLL_PRECISION registers, about 1.6% standard error for the distinct count. */
+#define HLL_PRECISION 12
+#define HISTOGRAM_BUCKETS 64
+/* Histograms are built from a reservoir sample of at most this many rows. */
+#define STATS_SAMPLE_ROWS 30000
+
+    /* Distinct-count sketch fed with 64-bit hashes. */
+    class HyperLogLog {
+    public:
+        HyperLogLog() : registers_(1 << HLL_PRECISION, 0) {}
+
+        void add(uint64_t hash);
+        double estimate();
+
+    private:
+        std::vector<uint8_t> registers_;
+    };
+
+    /*
+     * Statistics of one column. Values are kept in the normalized form of
+     * NormalizeValue, so min/max and the histogram bounds compare with memcmp
+     * whatever the column type is. The histogram is equi-depth: every bucket
+     * holds the same number of sampled values and bounds[i] is the largest
+     * value of bucket i.
+     */
+    struct ColumnStats {
+        ColumnStats() : nullCount(0), distinct(0) {}
+
+        double eqSelectivity(const std::string& key, uint64_t row_count);
+
+        uint64_t nullCount;
+        double distinct;
+        std::string min;
+        std::string max;
+        std::vector<std::string> bounds;
+    };
+
+    struct TableStats {
+        TableStats() : rowCount(0) {}
+
+        void collect(TableStore* table_store, std::vector<ColumnDefinition*>* col_defs);
+
+        uint64_t rowCount;
+        std::vector<ColumnStats> columns;
+    };
+
+}
@@ -1,26 +1,42 @@
 #include "storage.h"
+#include "bloom.h"
+#include "expression.h"
+#include "index.h"
+#include "metadata.h"
+#include "metrics.h"
+#include "profile.h"
+#include "sort.h"
 #include "trx.h"
 #include "util.h"
 
 #include "sql/ColumnType.h"
 #include "sql/Expr.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
+#include <ctime>
 #include <iostream>
 
 using namespace hsql;
 
 namespace mydb {
 
-    TableStore::TableStore(std::vector<ColumnDefinition*>* columns)
-            : colNum_(columns->size()), tupleSize_(0), columns_(columns) {
+    TableStore::TableStore(std::vector<ColumnDefinition*>* columns, std::vector<Index*>* indexes)
+            : colNum_(columns->size()), tupleSize_(0), rowCount_(0), hasVarString_(false),
+              modCount_(0), passModCount_(0), columns_(columns), indexes_(indexes),
+              bloomCols_(columns->size(), false), nullPartition_(nullptr),
+              lastPartition_(nullptr) {
         colOffset_.push_back(0);
 
         // Add space for each columns
         for (auto col : *columns) {
             tupleSize_ += ColumnTypeSize(col->type);
             colOffset_.push_back(tupleSize_);
+            colTypes_.push_back(col->type.data_type);
+            if (col->type.data_type == DataType::VARCHAR) {
+                hasVarString_ = true;
+            }
         }
 
         // Add space for null map
@@ -28,90 +44,499 @@ namespace mydb {
 
         // Add space for header
         tupleSize_ += TUPLE_HEADER_SIZE;
+        codec_ = FindTupleCodec(colTypes_);
     }
 
     TableStore::~TableStore() {
-        for (auto tuple_group : tupleGroups_) {
-            free(tuple_group);
+        for (auto group : tupleGroups_) {
+            // Strings above the largest heap size class are malloc'ed one by one.
+            for (Tuple* tup = group->tuples.getHead(); tup != nullptr && hasVarString_;
+                 tup = group->tuples.getNext(tup)) {
+                freeStrings(tup);
+            }
+            FreePages(group->range);
+            delete group;
+        }
+        for (auto group : coldGroups_) {
+            delete group;
+        }
+        for (auto& entry : partitions_) {
+            delete entry.second;
         }
+        delete nullPartition_;
     }
 
     bool TableStore::insertTuple(std::vector<Expr*>* values) {
-        if (freeList_.isEmpty()) {
-            if (newTupleGroup()) {
-                return true;
+        Tuple* tup = placeTuple(values);
+        if (tup == nullptr) {
+            return true;
+        }
+        rowCount_++;
+
+        if (g_transaction.inTransaction()) {
+            g_transaction.addInsertUndo(this, tup);
+        }
+
+        return false;
+    }
+
+    /* Put a row into a free slot and the indexes, without counting or logging it. */
+    Tuple* TableStore::placeTuple(std::vector<Expr*>* values) {
+        Partition* part = partitionOf(values);
+        if (part->freeList.isEmpty()) {
+            if (newTupleGroup(part)) {
+                return nullptr;
+            }
+        }
+
+        Tuple* tup = part->freeList.popHead();
+        if (codec_.store == nullptr || values->size() != static_cast<size_t>(colNum_) ||
+            codec_.store(tup->data, *values)) {
+            int idx = 0;
+            for (auto expr : *values) {
+                setColValue(tup, idx, expr);
+                idx++;
             }
         }
+        linkTuple(tup);
+        insertIndexes(tup);
+        return tup;
+    }
 
-        Tuple* tup = freeList_.popHead();
-        dataList_.addHead(tup);
+    void TableStore::linkTuple(Tuple* tup) {
+        TupleGroup* group = tup->group;
+        group->tuples.addHead(tup);
+        group->live++;
+        zoneAdd(tup);
+    }
 
-        int idx = 0;
-        for (auto expr : *values) {
-            setColValue(tup, idx, expr);
-            idx++;
+    void TableStore::unlinkTuple(Tuple* tup) {
+        TupleGroup* group = tup->group;
+        group->tuples.delTuple(tup);
+        zoneRemove(tup);
+        unlinkRows(group, 1);
+    }
+
+    /* 'rows' tuples were taken out of 'group' one after the other. */
+    void TableStore::unlinkRows(TupleGroup* group, size_t rows) {
+        group->live -= rows;
+        if (group->live == 0) {
+            group->zone.reset();
+        }
+    }
+
+    void TableStore::zoneAdd(Tuple* tup) {
+        if (codec_.zoneAdd != nullptr) {
+            codec_.zoneAdd(tup->data, tup->group->zone);
+            return;
         }
+        for (int i = 0; i < colNum_; i++) {
+            zoneAdd(tup, i);
+        }
+    }
 
-        if (g_transaction.inTransaction()) {
-            g_transaction.addInsertUndo(this, tup);
+    /* Widen the zone map of the group of 'tup' to the value of column 'idx'. */
+    void TableStore::zoneAdd(Tuple* tup, int idx) {
+        ZoneMap& zone = tup->group->zone;
+        bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
+        if (is_null[idx]) {
+            zone.addNull(idx);
+            return;
         }
 
-        return false;
+        uchar* ptr = tup->data + colNum_ + colOffset_[idx];
+        switch (colTypes_[idx]) {
+            case DataType::INT:
+                zone.addInt(idx, *reinterpret_cast<int32_t*>(ptr));
+                break;
+            case DataType::LONG:
+                zone.addInt(idx, *reinterpret_cast<int64_t*>(ptr));
+                break;
+            case DataType::CHAR: {
+                char* str = reinterpret_cast<char*>(ptr);
+                zone.addString(idx, str, strnlen(str, colOffset_[idx + 1] - colOffset_[idx]));
+                break;
+            }
+            case DataType::VARCHAR: {
+                VarString str;
+                LoadVarString(ptr, &str);
+                zone.addString(idx, str.data(), str.len);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    /* Only the NULL counts go down, min/max are kept until the group is empty. */
+    void TableStore::zoneRemove(Tuple* tup) {
+        bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
+        for (int i = 0; i < colNum_; i++) {
+            if (is_null[i]) {
+                tup->group->zone.removeNull(i);
+            }
+        }
     }
 
     bool TableStore::deleteTuple(Tuple* tup) {
-        dataList_.delTuple(tup);
-        freeList_.addHead(tup);
+        modCount_++;
+        eraseIndexes(tup);
+        rowCount_--;
+        unlinkTuple(tup);
+
+        // Inside a transaction the tuple is kept for rollback and freed at commit.
         if (g_transaction.inTransaction()) {
             g_transaction.addDeleteUndo(this, tup);
+        } else {
+            freeStrings(tup);
+            releaseSlot(tup);
         }
 
-        return true;
+        return false;
+    }
+
+    bool TableStore::deleteTuples(std::vector<Tuple*>& tups) {
+        bool in_trx = g_transaction.inTransaction();
+        modCount_ += tups.size();
+        rowCount_ -= tups.size();
+
+        // A scan returns the tuples group by group, the live count of a group changes once per run.
+        TupleGroup* group = nullptr;
+        size_t run = 0;
+        for (auto tup : tups) {
+            eraseIndexes(tup);
+            if (tup->group != group) {
+                if (group != nullptr) {
+                    unlinkRows(group, run);
+                }
+                group = tup->group;
+                run = 0;
+            }
+            group->tuples.delTuple(tup);
+            zoneRemove(tup);
+            run++;
+            if (!in_trx) {
+                freeStrings(tup);
+                releaseSlot(tup);
+            }
+        }
+        if (group != nullptr) {
+            unlinkRows(group, run);
+        }
+
+        if (in_trx) {
+            g_transaction.addDeleteUndo(this, tups);
+        }
+        return false;
     }
 
     void TableStore::removeTuple(Tuple* tup) {
-        dataList_.delTuple(tup);
-        freeList_.addHead(tup);
+        eraseIndexes(tup);
+        rowCount_--;
+        unlinkTuple(tup);
+        freeStrings(tup);
+        releaseSlot(tup);
     }
 
     void TableStore::recoverTuple(Tuple *tup) {
-        dataList_.addHead(tup);
+        linkTuple(tup);
+        insertIndexes(tup);
+        rowCount_++;
     }
 
     void TableStore::freeTuple(Tuple* tup) {
-        freeList_.addHead(tup);
+        freeStrings(tup);
+        releaseSlot(tup);
     }
 
-    bool TableStore::updateTuple(Tuple* tup, std::vector<size_t>& idxs, std::vector<Expr*>& values) {
+    /* Give the slot of a tuple that is gone back to the free list of its partition. */
+    void TableStore::releaseSlot(Tuple* tup) {
+        tup->group->partition->freeList.addHead(tup);
+    }
+
+    /* The rows of a table taken out by TRUNCATE, or the empty table it put in their place. */
+    struct TruncatedData {
+        TruncatedData() : nullPartition(nullptr), rowCount(0) {}
+        ~TruncatedData() {
+            for (auto group : tupleGroups) {
+                FreePages(group->range);
+                delete group;
+            }
+            for (auto group : coldGroups) {
+                delete group;
+            }
+            for (auto& entry : partitions) {
+                delete entry.second;
+            }
+            delete nullPartition;
+        }
+
+        std::vector<TupleGroup*> tupleGroups;
+        std::vector<ColdGroup*> coldGroups;
+        std::map<int64_t, Partition*> partitions;
+        Partition* nullPartition;
+        StringHeap strings;
+        std::vector<IndexMap> indexEntries;
+        uint64_t rowCount;
+    };
+
+    void TableStore::truncate() {
+        modCount_++;
+        TruncatedData* data = new TruncatedData();
+        swapContents(data);
         if (g_transaction.inTransaction()) {
-            g_transaction.addUpdateUndo(this, tup);
+            g_transaction.addTruncateUndo(this, data);
+        } else {
+            freeTruncated(data);
         }
+    }
 
+    void TableStore::swapContents(TruncatedData* data) {
+        tupleGroups_.swap(data->tupleGroups);
+        coldGroups_.swap(data->coldGroups);
+        partitions_.swap(data->partitions);
+        std::swap(nullPartition_, data->nullPartition);
+        lastPartition_ = nullptr;
+        strings_.swap(data->strings);
+        data->indexEntries.resize(indexes_->size());
+        for (size_t i = 0; i < indexes_->size(); i++) {
+            (*indexes_)[i]->entries.swap(data->indexEntries[i]);
+        }
+        std::swap(rowCount_, data->rowCount);
+    }
+
+    void TableStore::freeTruncated(TruncatedData* data) {
+        // Strings above the largest heap size class are malloc'ed, see ~TableStore.
+        bool long_strings = false;
+        for (auto col : *columns_) {
+            long_strings |= col->type.data_type == DataType::VARCHAR &&
+                            static_cast<size_t>(col->type.length) > STRING_HEAP_MAX_CLASS;
+        }
+        if (long_strings) {
+            swapContents(data);
+            for (auto group : tupleGroups_) {
+                for (Tuple* tup = group->tuples.getHead(); tup != nullptr;
+                     tup = group->tuples.getNext(tup)) {
+                    freeStrings(tup);
+                }
+            }
+            swapContents(data);
+        }
+        delete data;
+    }
+
+    /* Each column is saved as its index, its NULL flag and its bytes in the tuple. */
+    size_t TableStore::saveColumns(Tuple* tup, std::vector<size_t>& idxs,
+                                   std::vector<uchar>* image) {
+        size_t saved = 0;
+        for (size_t i = 0; i < idxs.size(); i++) {
+            size_t idx = idxs[i];
+            // A column set twice keeps its value from before the first time only.
+            if (std::find(idxs.begin(), idxs.begin() + i, idx) != idxs.begin() + i) {
+                continue;
+            }
+            size_t pos = image->size();
+            image->resize(pos + savedSize(idx));
+            uchar* entry = image->data() + pos;
+            memcpy(entry, &idx, sizeof(idx));
+            entry[sizeof(idx)] = tup->data[idx];
+            memcpy(entry + sizeof(idx) + 1, tup->data + colNum_ + colOffset_[idx],
+                   colOffset_[idx + 1] - colOffset_[idx]);
+            saved++;
+        }
+        return saved;
+    }
+
+    void TableStore::restoreColumns(Tuple* tup, const uchar* image, size_t columns) {
+        std::vector<size_t> idxs(columns);
+        for (size_t i = 0, pos = 0; i < columns; i++) {
+            memcpy(&idxs[i], image + pos, sizeof(size_t));
+            pos += savedSize(idxs[i]);
+        }
+
+        eraseIndexes(tup, &idxs);
+        bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
+        for (size_t i = 0; i < columns; i++) {
+            size_t idx = idxs[i];
+            VarString str;
+            VarString saved;
+            if (heapString(tup, idx, &str) &&
+                !(savedHeapString(image, idx, &saved) && saved.ptr == str.ptr)) {
+                strings_.free(str.ptr, str.len);
+            }
+            if (is_null[idx]) {
+                tup->group->zone.removeNull(idx);
+            }
+            is_null[idx] = image[sizeof(idx)];
+            memcpy(tup->data + colNum_ + colOffset_[idx], image + sizeof(idx) + 1,
+                   colOffset_[idx + 1] - colOffset_[idx]);
+            zoneAdd(tup, idx);
+            image += savedSize(idx);
+        }
+        insertIndexes(tup, &idxs);
+    }
+
+    void TableStore::freeOldColumns(Tuple* tup, const uchar* image, size_t columns) {
+        for (size_t i = 0; i < columns; i++) {
+            size_t idx;
+            memcpy(&idx, image, sizeof(idx));
+            VarString str;
+            VarString saved;
+            if (savedHeapString(image, idx, &saved) &&
+                !(heapString(tup, idx, &str) && str.ptr == saved.ptr)) {
+                strings_.free(saved.ptr, saved.len);
+            }
+            image += savedSize(idx);
+        }
+    }
+
+    bool TableStore::updateTuple(Tuple* tup, std::vector<size_t>& idxs, std::vector<Expr*>& values) {
+        modCount_++;
+        bool in_trx = g_transaction.inTransaction();
+        if (in_trx) {
+            g_transaction.addUpdateUndo(this, tup, idxs);
+        }
+
+        eraseIndexes(tup, &idxs);
+        bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
         for (size_t i = 0; i < idxs.size(); i++) {
             size_t idx = idxs[i];
             Expr* expr = values[i];
+            // Inside a transaction the old string belongs to the undo copy until commit.
+            VarString str;
+            if (!in_trx && heapString(tup, idx, &str)) {
+                strings_.free(str.ptr, str.len);
+            }
+            if (is_null[idx]) {
+                tup->group->zone.removeNull(idx);
+            }
             setColValue(tup, idx, expr);
+            zoneAdd(tup, idx);
         }
+        insertIndexes(tup, &idxs);
 
         return false;
     }
 
-    Tuple* TableStore::seqScan(Tuple* tup) {
-        if (tup == nullptr) {
-            return dataList_.getHead();
-        } else {
-            return dataList_.getNext(tup);
+    /* Group by group, the newest tuple of a group first. */
+    Tuple* TableStore::seqScan(Tuple* tup, ScanPredicate* pred, PartitionBounds* bounds) {
+        size_t next_group = 0;
+        Tuple* next = nullptr;
+        if (tup != nullptr) {
+            next = tup->group->tuples.getNext(tup);
+            next_group = tup->group->id + 1;
+        }
+
+        while (true) {
+            for (; next != nullptr; next = next->group->tuples.getNext(next)) {
+                if (pred == nullptr || matchPredicate(next, *pred)) {
+                    return next;
+                }
+            }
+
+            // Move on to the next group with live tuples that may match.
+            for (; next_group < tupleGroups_.size(); next_group++) {
+                TupleGroup* group = tupleGroups_[next_group];
+                if (bounds != nullptr && !partitionMayMatch(group->partition, *bounds)) {
+                    CountMetric(kMetricPartitionGroupsSkipped);
+                    continue;
+                }
+                if (group->live > 0 && (pred == nullptr || groupMayMatch(group, *pred))) {
+                    break;
+                }
+            }
+            if (next_group == tupleGroups_.size()) {
+                return nullptr;
+            }
+            next = tupleGroups_[next_group++]->tuples.getHead();
         }
     }
 
-    void TableStore::parseTuple(Tuple* tup, std::vector<Expr*>& values) {
+    bool TableStore::groupMayMatch(TupleGroup* group, ScanPredicate& pred) {
+        if (pred.never || !group->zone.mayEqual(pred.idx, pred.val)) {
+            CountMetric(kMetricGroupsSkipped);
+            return false;
+        }
+        if (!group->zone.bloomMayEqual(pred.idx, pred.val)) {
+            CountMetric(kMetricGroupsSkipped);
+            CountMetric(kMetricBloomGroupsSkipped);
+            return false;
+        }
+        return true;
+    }
+
+    /* Same rules as columnEquals, only checked once instead of for every tuple. */
+    void TableStore::compilePredicate(size_t idx, Expr* val, ScanPredicate* pred) {
+        pred->idx = idx;
+        pred->val = val;
+        pred->type = colTypes_[idx];
+        pred->offset = colNum_ + colOffset_[idx];
+        pred->width = colOffset_[idx + 1] - colOffset_[idx];
+        pred->never = true;
+        switch (pred->type) {
+            case DataType::INT:
+                pred->never = val->type != kExprLiteralInt || val->ival < INT32_MIN ||
+                              val->ival > INT32_MAX;
+                pred->ival = val->ival;
+                break;
+            case DataType::LONG:
+                pred->never = val->type != kExprLiteralInt;
+                pred->ival = val->ival;
+                break;
+            case DataType::CHAR:
+            case DataType::VARCHAR:
+                if (val->type == kExprLiteralString) {
+                    pred->len = strlen(val->name);
+                    // A CHAR value always ends within its width.
+                    pred->never = pred->type == DataType::CHAR && pred->len >= pred->width;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    bool TableStore::matchPredicate(Tuple* tup, ScanPredicate& pred) {
+        bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
+        if (pred.never || is_null[pred.idx]) {
+            return false;
+        }
+
+        uchar* ptr = tup->data + pred.offset;
+        switch (pred.type) {
+            case DataType::INT:
+                return *reinterpret_cast<int32_t*>(ptr) == pred.ival;
+            case DataType::LONG:
+                return *reinterpret_cast<int64_t*>(ptr) == pred.ival;
+            case DataType::CHAR:
+                return memcmp(ptr, pred.val->name, pred.len + 1) == 0;
+            case DataType::VARCHAR: {
+                VarString str;
+                LoadVarString(ptr, &str);
+                return VarStringEquals(str, pred.val->name, pred.len);
+            }
+            default:
+                return false;
+        }
+    }
+
+    void TableStore::parseTuple(Tuple* tup, std::vector<Expr*>& values, Arena* arena,
+                                std::vector<bool>* cols, Expr* skipped) {
+        if (codec_.parse != nullptr) {
+            codec_.parse(tup->data, values, arena, cols, skipped);
+            return;
+        }
         bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
         uchar* data = tup->data + columns_->size();
 
         for (size_t i = 0; i < columns_->size(); i++) {
             Expr* e = nullptr;
+            if (cols != nullptr && !(*cols)[i]) {
+                values.push_back(skipped);
+                continue;
+            }
             if (is_null[i]) {
-                e = Expr::makeNullLiteral();
+                e = (arena != nullptr) ? arena->makeNullLiteral() : Expr::makeNullLiteral();
                 values.push_back(e);
                 continue;
             }
@@ -122,18 +547,35 @@ namespace mydb {
             switch (col->type.data_type) {
                 case DataType::INT: {
                     int64_t val = *reinterpret_cast<int32_t*>(data + offset);
-                    e = Expr::makeLiteral(val);
+                    e = (arena != nullptr) ? arena->makeLiteral(val) : Expr::makeLiteral(val);
                     break;
                 }
                 case DataType::LONG: {
                     int64_t val = *reinterpret_cast<int64_t*>(data + offset);
-                    e = Expr::makeLiteral(val);
+                    e = (arena != nullptr) ? arena->makeLiteral(val) : Expr::makeLiteral(val);
                     break;
                 }
-                case DataType::CHAR:
                 case DataType::VARCHAR: {
+                    VarString str;
+                    LoadVarString(data + offset, &str);
+                    if (arena != nullptr) {
+                        e = arena->makeLiteral(str.data(), str.len);
+                        break;
+                    }
+                    char* val = static_cast<char*>(malloc(str.len + 1));
+                    memcpy(val, str.data(), str.len);
+                    val[str.len] = '\0';
+                    e = Expr::makeLiteral(val);
+                    break;
+                }
+                case DataType::CHAR: {
+                    char* str = reinterpret_cast<char*>(data + offset);
+                    if (arena != nullptr) {
+                        e = arena->makeLiteral(str, strnlen(str, size));
+                        break;
+                    }
                     char* val = static_cast<char*>(malloc(size));
-                    memcpy(val, (data + offset), size);
+                    memcpy(val, str, size);
                     e = Expr::makeLiteral(val);
                     break;
                 }
@@ -144,27 +586,686 @@ namespace mydb {
         }
     }
 
-    bool TableStore::newTupleGroup() {
-        Tuple* tuple_group =
-                static_cast<Tuple*>(malloc(tupleSize_ * TUPLE_GROUP_SIZE));
-        memset(tuple_group, 0, (tupleSize_ * TUPLE_GROUP_SIZE));
-        if (tuple_group == nullptr) {
-            std::cout << "[BYDB-Error]  Failed to malloc " << tupleSize_ * TUPLE_GROUP_SIZE
-                      << " bytes";
+    /* Same result as comparing the Expr of parseTuple, as FilterOperator used to. */
+    bool TableStore::columnEquals(Tuple* tup, size_t idx, Expr* val) {
+        bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
+        if (is_null[idx]) {
+            return false;
+        }
+
+        uchar* ptr = tup->data + colNum_ + colOffset_[idx];
+        switch ((*columns_)[idx]->type.data_type) {
+            case DataType::INT:
+                return val->type == kExprLiteralInt &&
+                       *reinterpret_cast<int32_t*>(ptr) == val->ival;
+            case DataType::LONG:
+                return val->type == kExprLiteralInt &&
+                       *reinterpret_cast<int64_t*>(ptr) == val->ival;
+            case DataType::CHAR: {
+                size_t width = colOffset_[idx + 1] - colOffset_[idx];
+                return val->type == kExprLiteralString &&
+                       strncmp(reinterpret_cast<char*>(ptr), val->name, width) == 0;
+            }
+            case DataType::VARCHAR: {
+                if (val->type != kExprLiteralString) {
+                    return false;
+                }
+                VarString str;
+                LoadVarString(ptr, &str);
+                return VarStringEquals(str, val->name, strlen(val->name));
+            }
+            default:
+                return false;
+        }
+    }
+
+    void TableStore::compress() {
+        // Index entries and undo records point at tuples, which compression moves.
+        // Cold groups belong to no partition, scans could not prune them.
+        if (!indexes_->empty() || g_transaction.inTransaction() ||
+            spec_.kind != kNoPartitions) {
+            return;
+        }
+        // Wait for a pass without updates and deletes, the table is not cold before.
+        if (modCount_ != passModCount_) {
+            passModCount_ = modCount_;
+            return;
+        }
+
+        // A full group has no slot on the free list, so all of it can go.
+        size_t kept = 0;
+        for (auto group : tupleGroups_) {
+            if (group->live == group->rows) {
+                compressGroup(group);
+            } else {
+                group->id = kept;
+                tupleGroups_[kept++] = group;
+            }
+        }
+        tupleGroups_.resize(kept);
+    }
+
+    /* Move every tuple of a full group into a new ColdGroup and free the group. */
+    void TableStore::compressGroup(TupleGroup* group) {
+        Arena arena;
+        std::vector<std::vector<Expr*>> values(group->rows);
+        size_t row = 0;
+        for (Tuple* tup = group->tuples.getHead(); tup != nullptr;
+             tup = group->tuples.getNext(tup)) {
+            parseTuple(tup, values[row++], &arena);
+            freeStrings(tup);
+        }
+
+        ColdGroup* cold = new ColdGroup(columns_, values);
+        coldGroups_.push_back(cold);
+        FreePages(group->range);
+        delete group;
+
+        CountMetric(kMetricColdGroups);
+        CountMetric(kMetricColdGroupBytes, cold->bytes());
+    }
+
+    void TableStore::thaw() {
+        if (coldGroups_.empty()) {
+            return;
+        }
+
+        Arena arena;
+        for (auto group : coldGroups_) {
+            thawGroup(group, &arena);
+            arena.reset();
+        }
+        coldGroups_.clear();
+    }
+
+    /* Put the rows of a cold group back into tuple groups and delete it. */
+    void TableStore::thawGroup(ColdGroup* group, Arena* arena) {
+        std::vector<Expr*> values;
+        for (size_t row = 0; row < group->rows(); row++) {
+            values.clear();
+            group->decodeRow(row, values, arena);
+            placeTuple(&values);
+        }
+        delete group;
+        CountMetric(kMetricColdGroupsThawed);
+    }
+
+    void TableStore::compact() {
+        if (g_transaction.inTransaction()) {
+            return;
+        }
+
+        // Sparsest groups first, they free the most memory per moved row.
+        std::vector<TupleGroup*> groups(tupleGroups_);
+        std::sort(groups.begin(), groups.end(), [](TupleGroup* a, TupleGroup* b) {
+            return a->live * b->rows < b->live * a->rows;
+        });
+
+        // Every row of a group to empty needs a free slot in a group of its partition that stays.
+        std::unordered_map<Partition*, size_t> free_slots;
+        std::unordered_map<Partition*, size_t> part_moved;
+        for (auto group : groups) {
+            free_slots[group->partition] += group->rows - group->live;
+        }
+        size_t moved = 0;
+        std::vector<TupleGroup*> victims;
+        for (auto group : groups) {
+            if (group->live >= group->rows * COMPACT_MAX_LIVE_RATIO) {
+                break;
+            }
+            size_t& part_free = free_slots[group->partition];
+            size_t slots = part_free - (group->rows - group->live);
+            if (part_moved[group->partition] + group->live <= slots) {
+                part_free = slots;
+                part_moved[group->partition] += group->live;
+                moved += group->live;
+                victims.push_back(group);
+            }
+        }
+        if (victims.empty()) {
+            return;
+        }
+
+        // Rows of one victim must not land in another.
+        for (auto group : victims) {
+            unlistFreeSlots(group);
+        }
+        for (auto group : victims) {
+            evacuateGroup(group);
+        }
+        removeFreedGroups();
+
+        CountMetric(kMetricCompactedGroups, victims.size());
+        CountMetric(kMetricCompactedRows, moved);
+    }
+
+    /* Take the slots of 'group' that hold no row off the free list. */
+    void TableStore::unlistFreeSlots(TupleGroup* group) {
+        std::vector<bool> live(group->rows, false);
+        uchar* base = static_cast<uchar*>(group->range.addr);
+        for (Tuple* tup = group->tuples.getHead(); tup != nullptr;
+             tup = group->tuples.getNext(tup)) {
+            live[(reinterpret_cast<uchar*>(tup) - base) / tupleSize_] = true;
+        }
+        for (size_t i = 0; i < group->rows; i++) {
+            if (!live[i]) {
+                group->partition->freeList.delTuple(
+                        reinterpret_cast<Tuple*>(base + i * tupleSize_));
+            }
+        }
+    }
+
+    /*
+     * Copy the rows of 'group' into free slots of other groups and free its
+     * pages. Heap strings stay where they are, the copies point at them.
+     */
+    void TableStore::evacuateGroup(TupleGroup* group) {
+        std::string key;
+        for (Tuple* tup = group->tuples.getHead(); tup != nullptr;
+             tup = group->tuples.getNext(tup)) {
+            Tuple* copy = group->partition->freeList.popHead();
+            memcpy(copy->data, tup->data, tupleSize_ - TUPLE_HEADER_SIZE);
+            linkTuple(copy);
+            for (auto index : *indexes_) {
+                getIndexKey(tup, index, &key);
+                index->moveEntry(key, tup, copy);
+            }
+        }
+        FreePages(group->range);
+    }
+
+    /* Forget the groups whose pages were freed, and the partitions left without groups. */
+    void TableStore::removeFreedGroups() {
+        size_t kept = 0;
+        for (auto group : tupleGroups_) {
+            if (group->range.addr != nullptr) {
+                group->id = kept;
+                tupleGroups_[kept++] = group;
+                continue;
+            }
+
+            Partition* part = group->partition;
+            delete group;
+            if (--part->groups > 0) {
+                continue;
+            }
+            if (part == nullPartition_) {
+                nullPartition_ = nullptr;
+            } else {
+                partitions_.erase(part->key);
+            }
+            lastPartition_ = nullptr;
+            delete part;
+        }
+        tupleGroups_.resize(kept);
+    }
+
+    size_t TableStore::expire(size_t idx, int64_t cutoff, size_t max_rows) {
+        if (g_transaction.inTransaction()) {
+            return 0;
+        }
+
+        size_t dropped = 0;
+        size_t removed = expireColdGroups(idx, cutoff, &dropped);
+        std::vector<Tuple*> expired;
+        for (auto group : tupleGroups_) {
+            if (removed >= max_rows) {
+                break;
+            }
+            ColumnZone& zone = group->zone.zone(idx);
+            if (group->live == 0 || !zone.hasValue || zone.minInt > cutoff) {
+                continue;
+            }
+            if (zone.nullCount == 0 && zone.maxInt <= cutoff) {
+                removed += dropGroup(group);
+                dropped++;
+                continue;
+            }
+
+            expired.clear();
+            for (Tuple* tup = group->tuples.getHead(); tup != nullptr;
+                 tup = group->tuples.getNext(tup)) {
+                uchar* ptr = tup->data + colNum_ + colOffset_[idx];
+                int64_t val = (colTypes_[idx] == DataType::INT)
+                                      ? *reinterpret_cast<int32_t*>(ptr)
+                                      : *reinterpret_cast<int64_t*>(ptr);
+                if (!tup->data[idx] && val <= cutoff) {
+                    expired.push_back(tup);
+                }
+            }
+            if (!expired.empty()) {
+                deleteTuples(expired);
+                removed += expired.size();
+            }
+
+            // Min/max only widen on their own, narrow them to the rows left.
+            group->zone.reset();
+            for (Tuple* tup = group->tuples.getHead(); tup != nullptr;
+                 tup = group->tuples.getNext(tup)) {
+                zoneAdd(tup);
+            }
+        }
+        if (dropped > 0) {
+            removeFreedGroups();
+        }
+
+        CountMetric(kMetricTtlExpiredRows, removed);
+        CountMetric(kMetricTtlDroppedGroups, dropped);
+        return removed;
+    }
+
+    /* Remove every row of 'group' and free its pages; returns the rows removed. */
+    size_t TableStore::dropGroup(TupleGroup* group) {
+        if (!indexes_->empty() || hasVarString_) {
+            for (Tuple* tup = group->tuples.getHead(); tup != nullptr;
+                 tup = group->tuples.getNext(tup)) {
+                eraseIndexes(tup);
+                freeStrings(tup);
+            }
+        }
+
+        size_t rows = group->live;
+        modCount_ += rows;
+        rowCount_ -= rows;
+        unlistFreeSlots(group);
+        FreePages(group->range);
+        return rows;
+    }
+
+    /* Cold groups have no zone map, their TTL column is decoded instead. */
+    size_t TableStore::expireColdGroups(size_t idx, int64_t cutoff, size_t* dropped) {
+        Arena arena;
+        std::vector<Expr*> values;
+        std::vector<bool> cols(colNum_, false);
+        cols[idx] = true;
+        size_t removed = 0;
+        size_t kept = 0;
+        for (auto group : coldGroups_) {
+            size_t expired = 0;
+            for (size_t row = 0; row < group->rows(); row++) {
+                values.clear();
+                group->decodeRow(row, values, &arena, &cols);
+                expired += (values[idx]->type == kExprLiteralInt && values[idx]->ival <= cutoff);
+            }
+            arena.reset();
+
+            if (expired == 0) {
+                coldGroups_[kept++] = group;
+                continue;
+            }
+            if (expired == group->rows()) {
+                modCount_ += expired;
+                rowCount_ -= expired;
+                removed += expired;
+                (*dropped)++;
+                delete group;
+                continue;
+            }
+            // The tuple groups the rows go back to are expired next.
+            thawGroup(group, &arena);
+            arena.reset();
+        }
+        coldGroups_.resize(kept);
+        return removed;
+    }
+
+    int64_t TableStore::partitionKey(int64_t val) {
+        if (spec_.kind == kHashPartitions) {
+            return static_cast<int64_t>(MixHash(static_cast<uint64_t>(val)) %
+                                        static_cast<uint64_t>(spec_.width));
+        }
+        if (spec_.kind == kRangePartitions) {
+            // Rounded down, so -1 is in the range before 0.
+            return val / spec_.width - (val % spec_.width < 0 ? 1 : 0);
+        }
+        return 0;
+    }
+
+    Partition* TableStore::findPartition(int64_t key, bool null) {
+        if (null) {
+            return nullPartition_;
+        }
+        auto iter = partitions_.find(key);
+        return (iter == partitions_.end()) ? nullptr : iter->second;
+    }
+
+    /* Partition a row goes to, created if it is the first row there. */
+    Partition* TableStore::partitionOf(std::vector<Expr*>* values) {
+        bool null = false;
+        int64_t key = 0;
+        if (spec_.kind != kNoPartitions) {
+            Expr* val = (spec_.column < values->size()) ? (*values)[spec_.column] : nullptr;
+            null = (val == nullptr || val->type != kExprLiteralInt);
+            key = null ? 0 : partitionKey(val->ival);
+        }
+        if (lastPartition_ != nullptr && lastPartition_->null == null &&
+            lastPartition_->key == key) {
+            return lastPartition_;
+        }
+
+        Partition* part = findPartition(key, null);
+        if (part == nullptr) {
+            part = new Partition(key, null);
+            if (null) {
+                nullPartition_ = part;
+            } else {
+                partitions_[key] = part;
+            }
+        }
+        lastPartition_ = part;
+        return part;
+    }
+
+    /* No NULL is within bounds set by a condition on the column. */
+    bool TableStore::partitionMayMatch(Partition* part, PartitionBounds& bounds) {
+        if (bounds.lo > bounds.hi) {
+            return false;
+        }
+        if (part->null) {
+            return bounds.all();
+        }
+        switch (spec_.kind) {
+            case kRangePartitions:
+                return partitionKey(bounds.lo) <= part->key && part->key <= partitionKey(bounds.hi);
+            case kHashPartitions:
+                return bounds.lo != bounds.hi || partitionKey(bounds.lo) == part->key;
+            default:
+                return true;
+        }
+    }
+
+    size_t TableStore::partitionCount(PartitionBounds* bounds) {
+        size_t count = 0;
+        for (auto& entry : partitions_) {
+            count += (bounds == nullptr || partitionMayMatch(entry.second, *bounds));
+        }
+        if (nullPartition_ != nullptr) {
+            count += (bounds == nullptr || partitionMayMatch(nullPartition_, *bounds));
+        }
+        return count;
+    }
+
+    /* The rows are only visited for their index entries and heap strings, if there are any. */
+    bool TableStore::dropPartition(Expr* value, uint64_t* rows) {
+        bool null = (value->type == kExprLiteralNull);
+        if (spec_.kind == kNoPartitions || (!null && value->type != kExprLiteralInt)) {
+            std::cout << "[BYDB-Error]  Table has no partition for " << ExprToString(value)
+                      << std::endl;
+            return true;
+        }
+        Partition* part = findPartition(null ? 0 : partitionKey(value->ival), null);
+        if (part == nullptr) {
+            std::cout << "[BYDB-Error]  Table has no partition for " << ExprToString(value)
+                      << std::endl;
+            return true;
+        }
+
+        *rows = 0;
+        for (auto group : tupleGroups_) {
+            if (group->partition != part) {
+                continue;
+            }
+            if (!indexes_->empty() || hasVarString_) {
+                for (Tuple* tup = group->tuples.getHead(); tup != nullptr;
+                     tup = group->tuples.getNext(tup)) {
+                    eraseIndexes(tup);
+                    freeStrings(tup);
+                }
+            }
+            *rows += group->live;
+            FreePages(group->range);
+        }
+        modCount_ += *rows;
+        rowCount_ -= *rows;
+        removeFreedGroups();
+
+        CountMetric(kMetricPartitionsDropped);
+        return false;
+    }
+
+    void TableStore::buildIndex(Index* index) {
+        thaw();
+        std::string key;
+        for (Tuple* tup = seqScan(nullptr); tup != nullptr; tup = seqScan(tup)) {
+            getIndexKey(tup, index, &key);
+            index->insertEntry(key, tup);
+        }
+    }
+
+    /* Normalize the index columns straight from the tuple, without building Expr. */
+    void TableStore::getIndexKey(Tuple* tup, Index* index, std::string* key) {
+        key->clear();
+        for (auto idx : index->colIds) {
+            appendColumnKey(tup, idx, key);
+        }
+    }
+
+    /* Append the normalized value of one column; a NULL is all zero bytes. */
+    void TableStore::appendColumnKey(Tuple* tup, size_t idx, std::string* key) {
+        bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
+        uchar* data = tup->data + colNum_;
+        ColumnDefinition* col = (*columns_)[idx];
+        size_t width = NormalizedWidth(col);
+        size_t pos = key->size();
+        key->resize(pos + width);
+        uchar* ptr = reinterpret_cast<uchar*>(&(*key)[pos]);
+        if (is_null[idx]) {
+            memset(ptr, 0, width);
+            return;
+        }
+
+        uchar* val = data + colOffset_[idx];
+        switch (col->type.data_type) {
+            case DataType::INT:
+                NormalizeInt(*reinterpret_cast<int32_t*>(val), ptr);
+                break;
+            case DataType::LONG:
+                NormalizeInt(*reinterpret_cast<int64_t*>(val), ptr);
+                break;
+            case DataType::CHAR: {
+                char* str = reinterpret_cast<char*>(val);
+                NormalizeString(str, strnlen(str, width - 1), width - 1, ptr);
+                break;
+            }
+            case DataType::VARCHAR: {
+                VarString str;
+                LoadVarString(val, &str);
+                NormalizeString(str.data(), std::min<size_t>(str.len, width - 1), width - 1, ptr);
+                break;
+            }
+            default:
+                memset(ptr, 0, width);
+                break;
+        }
+    }
+
+    /* Whether 'index' is over one of the columns 'changed', or any column without it. */
+    static bool IndexChanged(Index* index, std::vector<size_t>* changed) {
+        if (changed == nullptr) {
+            return true;
+        }
+        for (auto idx : index->colIds) {
+            if (std::find(changed->begin(), changed->end(), idx) != changed->end()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void TableStore::insertIndexes(Tuple* tup, std::vector<size_t>* changed) {
+        std::string key;
+        for (auto index : *indexes_) {
+            if (IndexChanged(index, changed)) {
+                getIndexKey(tup, index, &key);
+                index->insertEntry(key, tup);
+            }
+        }
+    }
+
+    void TableStore::eraseIndexes(Tuple* tup, std::vector<size_t>* changed) {
+        std::string key;
+        for (auto index : *indexes_) {
+            if (IndexChanged(index, changed)) {
+                getIndexKey(tup, index, &key);
+                index->eraseEntry(key, tup);
+            }
+        }
+    }
+
+    /* Whether column 'idx' of 'tup' is a VARCHAR whose value lives in the string heap. */
+    bool TableStore::heapString(Tuple* tup, size_t idx, VarString* str) {
+        bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
+        if ((*columns_)[idx]->type.data_type != DataType::VARCHAR || is_null[idx]) {
+            return false;
+        }
+        LoadVarString(tup->data + colNum_ + colOffset_[idx], str);
+        return !str->isInline();
+    }
+
+    size_t TableStore::savedSize(size_t idx) {
+        return sizeof(idx) + 1 + colOffset_[idx + 1] - colOffset_[idx];
+    }
+
+    /* Same for a column saved by saveColumns at 'entry'. */
+    bool TableStore::savedHeapString(const uchar* entry, size_t idx, VarString* str) {
+        if (colTypes_[idx] != DataType::VARCHAR || entry[sizeof(idx)]) {
+            return false;
+        }
+        LoadVarString(entry + sizeof(idx) + 1, str);
+        return !str->isInline();
+    }
+
+    /* Free the heap strings of 'tup' that 'keep', another version of the row, does not share. */
+    void TableStore::freeStrings(Tuple* tup, Tuple* keep) {
+        if (!hasVarString_) {
+            return;
+        }
+
+        for (int i = 0; i < colNum_; i++) {
+            VarString str;
+            VarString kept;
+            if (!heapString(tup, i, &str)) {
+                continue;
+            }
+            if (keep != nullptr && heapString(keep, i, &kept) && kept.ptr == str.ptr) {
+                continue;
+            }
+            strings_.free(str.ptr, str.len);
+        }
+    }
+
+    bool TableStore::newTupleGroup(Partition* part) {
+        uint64_t start = MetricsNow();
+        size_t rows = part->groupRows;
+        size_t bytes = rows * tupleSize_;
+        if (bytes >= HUGE_PAGE_SIZE) {
+            // Whole huge pages, at least one tuple.
+            bytes = (tupleSize_ + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+            rows = bytes / tupleSize_;
+        } else {
+            part->groupRows *= 2;
+        }
+
+        CountAlloc(bytes);
+        TupleGroup* group = new TupleGroup(columns_);
+        if (AllocPages(bytes, &group->range)) {
+            std::cout << "[BYDB-Error]  Failed to allocate " << bytes << " bytes" << std::endl;
+            delete group;
             return true;
         }
 
-        tupleGroups_.push_back(tuple_group);
-        uchar* ptr = reinterpret_cast<uchar*>(tuple_group);
-        for (int i = 0; i < TUPLE_GROUP_SIZE; i++) {
+        group->rows = rows;
+        group->id = tupleGroups_.size();
+        group->partition = part;
+        part->groups++;
+        for (int i = 0; i < colNum_; i++) {
+            if (bloomCols_[i]) {
+                group->zone.setBloom(i, rows);
+            }
+        }
+        tupleGroups_.push_back(group);
+        uchar* ptr = static_cast<uchar*>(group->range.addr);
+        for (size_t i = 0; i < rows; i++) {
             Tuple* tup = reinterpret_cast<Tuple*>(ptr);
-            freeList_.addHead(tup);
+            tup->group = group;
+            part->freeList.addHead(tup);
             ptr += tupleSize_;
         }
 
+        CountMetric(kMetricTupleGroups);
+        CountMetric(kMetricTupleGroupBytes, bytes);
+        if (group->range.huge) {
+            CountMetric(kMetricHugePageGroups);
+        }
+        RecordLatency(kLatencyNewTupleGroup, MetricsNow() - start);
         return false;
     }
 
+    void TableStore::setBloomColumns(std::vector<bool>& cols) {
+        for (int i = 0; i < colNum_; i++) {
+            if (cols[i] == bloomCols_[i]) {
+                continue;
+            }
+            bloomCols_[i] = cols[i];
+
+            for (auto group : tupleGroups_) {
+                group->zone.setBloom(i, cols[i] ? group->rows : 0);
+                if (!cols[i]) {
+                    continue;
+                }
+                // Min/max already cover these values, only the filter is new.
+                for (Tuple* tup = group->tuples.getHead(); tup != nullptr;
+                     tup = group->tuples.getNext(tup)) {
+                    bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
+                    if (!is_null[i]) {
+                        zoneAdd(tup, i);
+                    }
+                }
+            }
+        }
+    }
+
+    uint64_t TableStore::keyHash(Tuple* tup, std::vector<size_t>& idxs, bool* has_null) {
+        bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
+        uint64_t hash = 0;
+        *has_null = false;
+        for (auto idx : idxs) {
+            if (is_null[idx]) {
+                *has_null = true;
+                return 0;
+            }
+
+            uchar* ptr = tup->data + colNum_ + colOffset_[idx];
+            uint64_t h = 0;
+            switch (colTypes_[idx]) {
+                case DataType::INT: {
+                    int64_t val = *reinterpret_cast<int32_t*>(ptr);
+                    h = static_cast<uint64_t>(val);
+                    break;
+                }
+                case DataType::LONG:
+                    h = static_cast<uint64_t>(*reinterpret_cast<int64_t*>(ptr));
+                    break;
+                case DataType::CHAR: {
+                    char* str = reinterpret_cast<char*>(ptr);
+                    h = BKDRHash(str, strnlen(str, colOffset_[idx + 1] - colOffset_[idx]));
+                    break;
+                }
+                case DataType::VARCHAR: {
+                    VarString str;
+                    LoadVarString(ptr, &str);
+                    h = BKDRHash(str.data(), str.len);
+                    break;
+                }
+                default:
+                    *has_null = true;
+                    return 0;
+            }
+            hash = CombineKeyHash(hash, h);
+        }
+        return hash;
+    }
+
     void TableStore::setColValue(Tuple* tup, int idx, Expr* expr) {
         bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
         uchar* data = tup->data + colNum_;
@@ -191,9 +1292,30 @@ namespace mydb {
                 break;
             }
             case kExprLiteralString: {
-                int len = strlen(expr->name);
-                memcpy(ptr, expr->name, len);
-                ptr[len] = '\0';
+                size_t len = strlen(expr->name);
+                if ((*columns_)[idx]->type.data_type != DataType::VARCHAR) {
+                    memcpy(ptr, expr->name, len);
+                    ptr[len] = '\0';
+                    break;
+                }
+
+                VarString str;
+                memset(&str, 0, sizeof(str));
+                str.len = static_cast<uint32_t>(len);
+                if (str.isInline()) {
+                    memcpy(str.prefix, expr->name, len);
+                } else {
+                    memcpy(str.prefix, expr->name, VARSTRING_PREFIX_SIZE);
+                    str.ptr = strings_.allocate(len);
+                    if (str.ptr == nullptr) {
+                        std::cout << "[BYDB-Error]  Failed to allocate " << len
+                                  << " bytes for a string" << std::endl;
+                        is_null[idx] = true;
+                        break;
+                    }
+                    memcpy(str.ptr, expr->name, len);
+                }
+                StoreVarString(str, ptr);
                 break;
             }
             case kExprLiteralNull:
@@ -204,4 +1326,32 @@ namespace mydb {
         }
     }
 
+    void CompactTupleGroups() {
+        if (g_transaction.inTransaction()) {
+            return;
+        }
+
+        std::vector<Table*> tables;
+        g_meta_data.getAllTables(&tables);
+        for (auto table : tables) {
+            table->getTableStore()->compact();
+        }
+    }
+
+    void ExpireTtlRows() {
+        if (g_transaction.inTransaction()) {
+            return;
+        }
+
+        int64_t now = time(nullptr);
+        std::vector<Table*> tables;
+        g_meta_data.getAllTables(&tables);
+        for (auto table : tables) {
+            TableTtl& ttl = table->ttl();
+            if (ttl.seconds != 0) {
+                table->getTableStore()->expire(ttl.column, now - ttl.seconds, TTL_EXPIRE_ROWS);
+            }
+        }
+    }
+
 }
\ No newline at end of file
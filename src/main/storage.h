@@ -1,22 +1,53 @@
+#pragma once
+
+#include "arena.h"
+#include "compress.h"
+#include "pages.h"
+#include "tuplecodec.h"
+#include "varstring.h"
+#include "zonemap.h"
+
 #include "sql/statements.h"
 
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <map>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 using namespace hsql;
 
 namespace mydb {
 
+/*
+ * Rows of the first tuple group of a table. Each following group is twice as
+ * large until a group fills a huge page, so small tables stay small and large
+ * ones are backed by huge pages.
+ */
 #define TUPLE_GROUP_SIZE 100
+#define TUPLE_HEADER_SIZE sizeof(Tuple)
+/* The shell runs a compaction pass every this many statements. */
+#define COMPACT_INTERVAL 1000
+/* Compaction empties tuple groups with less than this share of live rows. */
+#define COMPACT_MAX_LIVE_RATIO 0.5
+/* Most partitions a table can be hashed into. */
+#define PARTITION_HASH_MAX 1024
+/* The shell runs a TTL expiry pass every this many statements. */
+#define TTL_EXPIRE_INTERVAL 100
+/* An expiry pass removes about this many rows of a table at most, the rest wait for the next. */
+#define TTL_EXPIRE_ROWS (64 * 1024)
 
     typedef unsigned char uchar;
 
+    struct TupleGroup;
+
     struct Tuple {
         Tuple* prev;
         Tuple* next;
+        TupleGroup* group;
         uchar data[];
     };
 
@@ -31,6 +62,11 @@ namespace mydb {
             tail_->next = nullptr;
         }
 
+        ~TupleList() {
+            free(head_);
+            free(tail_);
+        }
+
         void addHead(Tuple* tup) {
             Tuple* ntup = head_->next;
             ntup->prev = tup;
@@ -73,36 +109,246 @@ namespace mydb {
             return (head_->next == tail_);
         }
 
+        void swap(TupleList& other) {
+            std::swap(head_, other.head_);
+            std::swap(tail_, other.tail_);
+        }
+
     private:
         Tuple* head_;
         Tuple* tail_;
     };
 
+    enum PartitionKind { kNoPartitions, kRangePartitions, kHashPartitions };
+
+    /* How rows are split into partitions by CREATE TABLE ... WITH (partition_column = ...). */
+    struct PartitionSpec {
+        PartitionSpec() : kind(kNoPartitions), column(0), width(0) {}
+        PartitionKind kind;
+        size_t column;  // An INT or LONG column.
+        int64_t width;  // Values per range partition, or the number of hash partitions.
+    };
+
+    /* Values of the partition column a scan may return, both ends included. */
+    struct PartitionBounds {
+        PartitionBounds() : lo(INT64_MIN), hi(INT64_MAX) {}
+        bool all() { return lo == INT64_MIN && hi == INT64_MAX; }
+        int64_t lo;
+        int64_t hi;
+    };
+
+    /*
+     * Tuple groups of one partition and their free slots. A table without
+     * partitions keeps all its rows in a single one.
+     */
+    struct Partition {
+        Partition(int64_t k, bool n) : key(k), null(n), groups(0), groupRows(TUPLE_GROUP_SIZE) {}
+        int64_t key;       // Range number, the value divided by the width rounded down, or hash.
+        bool null;         // Rows whose partition column is NULL.
+        size_t groups;
+        size_t groupRows;  // Of the next tuple group.
+        TupleList freeList;
+    };
+
+    /* Slots allocated at once, the live tuples among them and their zone map. */
+    struct TupleGroup {
+        explicit TupleGroup(std::vector<ColumnDefinition*>* columns)
+                : rows(0), live(0), id(0), partition(nullptr), zone(columns) {}
+
+        PageRange range;
+        size_t rows;
+        size_t live;
+        size_t id;  // Position in the tuple groups of the table.
+        Partition* partition;
+        TupleList tuples;
+        ZoneMap zone;
+    };
+
+    /*
+     * Column 'idx' = 'val' resolved against the tuple layout once, so a scan
+     * compares the raw bytes of a tuple instead of building its Expr.
+     * 'never' is set when no value of the column can be equal, e.g. for a
+     * literal of another type or a NULL literal.
+     */
+    struct ScanPredicate {
+        ScanPredicate() : idx(0), val(nullptr), type(DataType::UNKNOWN), offset(0), width(0),
+                          never(true), ival(0), len(0) {}
+        size_t idx;
+        Expr* val;
+        DataType type;
+        size_t offset;  // Of the column in Tuple::data.
+        size_t width;
+        bool never;
+        int64_t ival;
+        size_t len;     // Of the string literal val->name.
+    };
+
+    struct Index;
+    struct TruncatedData;
+
     class TableStore {
     public:
-        TableStore(std::vector<ColumnDefinition*>* columns);
+        TableStore(std::vector<ColumnDefinition*>* columns, std::vector<Index*>* indexes);
         ~TableStore();
 
         bool insertTuple(std::vector<Expr*>* values);
         bool deleteTuple(Tuple* tup);
-        bool updateTuple(Tuple* tup, std::vector<UpdateClause*>* updates);
+        /* Delete a batch of tuples, logging their undo records at once. */
+        bool deleteTuples(std::vector<Tuple*>& tups);
+        bool updateTuple(Tuple* tup, std::vector<size_t>& idxs, std::vector<Expr*>& values);
+
+        /* Used by transaction rollback and commit. */
+        void removeTuple(Tuple* tup);
+        void recoverTuple(Tuple* tup);
+        void freeTuple(Tuple* tup);
+        /*
+         * TRUNCATE: swap every tuple group, cold group, string and index entry
+         * of the table for empty ones, without visiting the rows. Inside a
+         * transaction the old ones are kept until it ends, rollback swaps them
+         * back in.
+         */
+        void truncate();
+        void swapContents(TruncatedData* data);
+        void freeTruncated(TruncatedData* data);
+        /*
+         * Update undo: append the NULL flag and value of columns 'idxs' of
+         * 'tup' to 'image' and return how many were saved. Rollback puts them
+         * back, commit frees the heap strings only they still point to.
+         */
+        size_t saveColumns(Tuple* tup, std::vector<size_t>& idxs, std::vector<uchar>* image);
+        void restoreColumns(Tuple* tup, const uchar* image, size_t columns);
+        void freeOldColumns(Tuple* tup, const uchar* image, size_t columns);
 
-        Tuple* seqScan(Tuple* tup);
-        void parseTuple(Tuple* tup, std::vector<Expr*>& values);
+        /*
+         * Next tuple after 'tup', the first one for nullptr. With 'pred', only
+         * tuples matching it, and groups whose zone map or Bloom filter rule
+         * it out are not read at all. With 'bounds', groups of partitions
+         * outside them are not read either.
+         */
+        Tuple* seqScan(Tuple* tup, ScanPredicate* pred = nullptr,
+                       PartitionBounds* bounds = nullptr);
+        void compilePredicate(size_t idx, Expr* val, ScanPredicate* pred);
+        bool matchPredicate(Tuple* tup, ScanPredicate& pred);
+        /*
+         * Values are Expr the caller deletes, or statement lifetime Expr from
+         * 'arena' if given. With 'cols', the columns not set in it are not read
+         * and get 'skipped' instead, which the caller owns.
+         */
+        void parseTuple(Tuple* tup, std::vector<Expr*>& values, Arena* arena = nullptr,
+                        std::vector<bool>* cols = nullptr, Expr* skipped = nullptr);
+        /* Column 'idx' = 'val', compared in place without building an Expr. */
+        bool columnEquals(Tuple* tup, size_t idx, Expr* val);
+
+        /*
+         * Cold groups: full tuple groups of a table without indexes that saw
+         * no update or delete since the previous pass are replaced by a
+         * ColdGroup. Anything that needs the rows as tuples thaws them first.
+         */
+        void compress();
+        void thaw();
+        std::vector<ColdGroup*>& coldGroups() { return coldGroups_; }
+        std::vector<TupleGroup*>& tupleGroups() { return tupleGroups_; }
+
+        /*
+         * Compaction: move the rows of sparse tuple groups into free slots of
+         * the other groups, repoint their index entries and free the emptied
+         * groups. Skipped inside a transaction, whose undo records point at
+         * tuples.
+         */
+        void compact();
+        /*
+         * TTL expiry: remove the rows whose INT or LONG column 'idx' is at
+         * most 'cutoff', about 'max_rows' of them at most, and return how
+         * many. Groups the zone map shows to be all expired are freed whole,
+         * groups it shows to have none are not read. Cold groups are decoded
+         * and thawed if only some of their rows expired.
+         */
+        size_t expire(size_t idx, int64_t cutoff, size_t max_rows);
+
+        /*
+         * Columns whose tuple groups keep a Bloom filter next to the zone map,
+         * chosen by ANALYZE. Turning one on fills the filters of the groups
+         * there are.
+         */
+        void setBloomColumns(std::vector<bool>& cols);
+        /* HashKeys of the columns 'idxs' of 'tup', without building an Expr. */
+        uint64_t keyHash(Tuple* tup, std::vector<size_t>& idxs, bool* has_null);
+
+        void buildIndex(Index* index);
+        void getIndexKey(Tuple* tup, Index* index, std::string* key);
+        void appendColumnKey(Tuple* tup, size_t idx, std::string* key);
+
+        /*
+         * Partitions: set once on an empty table. Rows are placed in tuple
+         * groups of their partition only, so scans skip the groups of pruned
+         * partitions and DROP PARTITION frees whole groups.
+         */
+        void setPartitioning(PartitionSpec& spec) { spec_ = spec; }
+        PartitionSpec& partitioning() { return spec_; }
+        bool partitionMayMatch(Partition* part, PartitionBounds& bounds);
+        /* Partitions there are, and how many of them may hold rows within 'bounds'. */
+        size_t partitionCount(PartitionBounds* bounds = nullptr);
+        /* Drop the partition of the rows whose partition column is 'value'; true on error. */
+        bool dropPartition(Expr* value, uint64_t* rows);
+
+        int tupleSize() { return tupleSize_; }
+        uint64_t rowCount() { return rowCount_; }
 
     private:
-        bool newTupleGroup();
+        int64_t partitionKey(int64_t val);
+        Partition* findPartition(int64_t key, bool null);
+        Partition* partitionOf(std::vector<Expr*>* values);
+        void releaseSlot(Tuple* tup);
+        bool newTupleGroup(Partition* part);
+        bool groupMayMatch(TupleGroup* group, ScanPredicate& pred);
+        Tuple* placeTuple(std::vector<Expr*>* values);
+        void compressGroup(TupleGroup* group);
+        void unlistFreeSlots(TupleGroup* group);
+        void evacuateGroup(TupleGroup* group);
+        void removeFreedGroups();
+        size_t dropGroup(TupleGroup* group);
+        size_t expireColdGroups(size_t idx, int64_t cutoff, size_t* dropped);
+        void thawGroup(ColdGroup* group, Arena* arena);
+        void linkTuple(Tuple* tup);
+        void unlinkTuple(Tuple* tup);
+        void unlinkRows(TupleGroup* group, size_t rows);
+        void zoneAdd(Tuple* tup);
+        void zoneAdd(Tuple* tup, int idx);
+        void zoneRemove(Tuple* tup);
         void setColValue(Tuple* tup, int idx, Expr* expr);
+        /* With 'changed', only the indexes over one of those columns. */
+        void insertIndexes(Tuple* tup, std::vector<size_t>* changed = nullptr);
+        void eraseIndexes(Tuple* tup, std::vector<size_t>* changed = nullptr);
+        bool heapString(Tuple* tup, size_t idx, VarString* str);
+        bool savedHeapString(const uchar* entry, size_t idx, VarString* str);
+        size_t savedSize(size_t idx);
+        void freeStrings(Tuple* tup, Tuple* keep = nullptr);
 
         int colNum_;
         int tupleSize_;
         uint64_t rowCount_;
+        bool hasVarString_;
+        uint64_t modCount_;      // Updates and deletes so far.
+        uint64_t passModCount_;  // modCount_ at the previous compression pass.
 
         std::vector<ColumnDefinition*>* columns_;
+        std::vector<Index*>* indexes_;
         std::vector<int> colOffset_;
-        std::vector<Tuple*> tupleGroups_;
-        TupleList freeList_;
-        TupleList dataList_;
+        std::vector<DataType> colTypes_;
+        TupleCodec codec_;  // Specialized for colTypes_, if there is one.
+        std::vector<bool> bloomCols_;
+        std::vector<TupleGroup*> tupleGroups_;
+        PartitionSpec spec_;
+        std::map<int64_t, Partition*> partitions_;
+        Partition* nullPartition_;
+        Partition* lastPartition_;  // Where the previous row went.
+        StringHeap strings_;
+        std::vector<ColdGroup*> coldGroups_;
     };
 
+    /* Compact the tuple groups of every table, unless a transaction is open. */
+    void CompactTupleGroups();
+    /* Remove the expired rows of every table with a TTL, unless a transaction is open. */
+    void ExpireTtlRows();
+
 }
\ No newline at end of file
@@ -1,29 +1,38 @@
 #include "trx.h"
+#include "metrics.h"
 
 namespace mydb {
     Transaction g_transaction;
 
     void Transaction::addInsertUndo(TableStore* table_store, Tuple* tup) {
-        Undo* undo = new Undo(kInsertUndo);
-        undo->tableStore = table_store;
-        undo->curTup = tup;
-        undoStack_.push(undo);
+        undoLog_.push_back(Undo{kInsertUndo, table_store, tup, 0, 0, nullptr});
+        CountMetric(kMetricUndoRecords);
     }
 
     void Transaction::addDeleteUndo(TableStore* table_store, Tuple* tup) {
-        Undo* undo = new Undo(kDeleteUndo);
-        undo->tableStore = table_store;
-        undo->oldTup = tup;
-        undoStack_.push(undo);
+        undoLog_.push_back(Undo{kDeleteUndo, table_store, tup, 0, 0, nullptr});
+        CountMetric(kMetricUndoRecords);
     }
 
-    void Transaction::addUpdateUndo(TableStore* table_store, Tuple* tup) {
-        Undo* undo = new Undo(kUpdateUndo);
-        undo->tableStore = table_store;
-        undo->oldTup = static_cast<Tuple*>(malloc(table_store->tupleSize()));
-        memcpy(undo->oldTup->data, tup->data, table_store->tupleSize() - TUPLE_HEADER_SIZE);
-        undo->curTup = tup;
-        undoStack_.push(undo);
+    void Transaction::addDeleteUndo(TableStore* table_store, std::vector<Tuple*>& tups) {
+        undoLog_.reserve(undoLog_.size() + tups.size());
+        for (auto tup : tups) {
+            undoLog_.push_back(Undo{kDeleteUndo, table_store, tup, 0, 0, nullptr});
+        }
+        CountMetric(kMetricUndoRecords, tups.size());
+    }
+
+    void Transaction::addUpdateUndo(TableStore* table_store, Tuple* tup,
+                                    std::vector<size_t>& idxs) {
+        size_t image = undoImages_.size();
+        size_t columns = table_store->saveColumns(tup, idxs, &undoImages_);
+        undoLog_.push_back(Undo{kUpdateUndo, table_store, tup, image, columns, nullptr});
+        CountMetric(kMetricUndoRecords);
+    }
+
+    void Transaction::addTruncateUndo(TableStore* table_store, TruncatedData* data) {
+        undoLog_.push_back(Undo{kTruncateUndo, table_store, nullptr, 0, 0, data});
+        CountMetric(kMetricUndoRecords);
     }
 
     void Transaction::begin() {
@@ -31,39 +40,67 @@ namespace mydb {
     }
 
     void Transaction::rollback() {
-        while (!undoStack_.empty()) {
-            auto undo = undoStack_.top();
+        for (auto undo = undoLog_.rbegin(); undo != undoLog_.rend(); ++undo) {
             TableStore* table_store = undo->tableStore;
-            undoStack_.pop();
             switch (undo->type) {
                 case kInsertUndo:
-                    table_store->removeTuple(undo->curTup);
+                    table_store->removeTuple(undo->tup);
                     break;
                 case kDeleteUndo:
-                    table_store->recoverTuple(undo->oldTup);
+                    table_store->recoverTuple(undo->tup);
                     break;
                 case kUpdateUndo:
-                    memcpy(undo->curTup->data, undo->oldTup->data, table_store->tupleSize() - TUPLE_HEADER_SIZE);
+                    table_store->restoreColumns(undo->tup, undoImages_.data() + undo->image,
+                                                undo->columns);
+                    break;
+                case kTruncateUndo:
+                    table_store->swapContents(undo->truncated);
+                    table_store->freeTruncated(undo->truncated);
                     break;
                 default:
                     break;
             }
-            delete undo;
         }
+        clearLog();
         inTransaction_ = false;
     }
 
+    /*
+     * Records older than a TRUNCATE refer to the rows the table had before it,
+     * so those are swapped back in while the records are committed and freed
+     * after the last one.
+     */
     void Transaction::commit() {
-        while (undoStack_.empty()) {
-            auto undo = undoStack_.top();
+        std::vector<Undo*> truncates;
+        for (auto undo = undoLog_.rbegin(); undo != undoLog_.rend(); ++undo) {
             TableStore* table_store = undo->tableStore;
-            undoStack_.pop();
             if (undo->type == kDeleteUndo) {
-                table_store->freeTuple(undo->oldTup);
+                table_store->freeTuple(undo->tup);
+            } else if (undo->type == kUpdateUndo) {
+                table_store->freeOldColumns(undo->tup, undoImages_.data() + undo->image,
+                                            undo->columns);
+            } else if (undo->type == kTruncateUndo) {
+                table_store->swapContents(undo->truncated);
+                truncates.push_back(&*undo);
             }
-            delete undo;
         }
+        for (auto undo = truncates.rbegin(); undo != truncates.rend(); ++undo) {
+            (*undo)->tableStore->swapContents((*undo)->truncated);
+            (*undo)->tableStore->freeTruncated((*undo)->truncated);
+        }
+        clearLog();
         inTransaction_ = false;
     }
 
-}
\ No newline at end of file
+    void Transaction::clearLog() {
+        if (undoLog_.capacity() > UNDO_LOG_KEEP_RECORDS) {
+            std::vector<Undo>().swap(undoLog_);
+        }
+        if (undoImages_.capacity() > UNDO_LOG_KEEP_RECORDS * sizeof(Undo)) {
+            std::vector<uchar>().swap(undoImages_);
+        }
+        undoLog_.clear();
+        undoImages_.clear();
+    }
+
+}
@@ -1,18 +1,64 @@
 #pragma once
 
-using namespace mydb {
-enum UndoType { kInsert, kDelete, kUpdate };
-
-struct Undo {
-    Undo(UndoType t, tup_id_t id) : type(t), tup_id(id), data(nullptr) {}
-    ~Undo() {
-        if (data != nullptr) {
-            free(data);
-        }
-    }
-    UndoType type;
-    tup_id_t tup_id;
-    uchar* data;
-};
-
-}
\ No newline at end of file
+#include "storage.h"
+
+#include <vector>
+
+namespace mydb {
+
+/* Undo log capacity kept across transactions, larger logs are released at the end. */
+#define UNDO_LOG_KEEP_RECORDS (64 * 1024)
+
+    enum UndoType { kInsertUndo, kDeleteUndo, kUpdateUndo, kTruncateUndo };
+
+    /*
+     * kInsertUndo: tup is the inserted tuple.
+     * kDeleteUndo: tup is the deleted tuple, freed at commit.
+     * kUpdateUndo: tup is the updated tuple, the old values of its 'columns'
+     * updated columns start at 'image' in the images of the transaction, see
+     * TableStore::saveColumns.
+     * kTruncateUndo: truncated holds the rows the table had before.
+     */
+    struct Undo {
+        UndoType type;
+        TableStore* tableStore;
+        Tuple* tup;
+        size_t image;
+        size_t columns;
+        TruncatedData* truncated;
+    };
+
+    /*
+     * Undo records are kept by value in one log and the column images of
+     * updates in one buffer, so logging a change allocates nothing once the
+     * two have grown to the size of the statements run.
+     */
+    class Transaction {
+    public:
+        Transaction() : inTransaction_(false) {}
+        ~Transaction() {}
+
+        void addInsertUndo(TableStore* table_store, Tuple* tup);
+        void addDeleteUndo(TableStore* table_store, Tuple* tup);
+        void addDeleteUndo(TableStore* table_store, std::vector<Tuple*>& tups);
+        /* Before columns 'idxs' of 'tup' are updated. */
+        void addUpdateUndo(TableStore* table_store, Tuple* tup, std::vector<size_t>& idxs);
+        void addTruncateUndo(TableStore* table_store, TruncatedData* data);
+
+        void begin();
+        void rollback();
+        void commit();
+
+        bool inTransaction() { return inTransaction_; }
+
+    private:
+        void clearLog();
+
+        bool inTransaction_;
+        std::vector<Undo> undoLog_;
+        std::vector<uchar> undoImages_;
+    };
+
+    extern Transaction g_transaction;
+
+}
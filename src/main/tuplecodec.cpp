@@ -0,0 +1,162 @@
+#include "tuplecodec.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace mydb {
+
+    enum CodecColumn { kCodecInt, kCodecLong };
+
+    template <CodecColumn kCol>
+    struct CodecValue;
+
+    template <>
+    struct CodecValue<kCodecInt> {
+        static const size_t kWidth = sizeof(int32_t);
+        static int64_t load(const unsigned char* ptr) {
+            int32_t val;
+            memcpy(&val, ptr, sizeof(val));
+            return val;
+        }
+        static void store(unsigned char* ptr, int64_t val) {
+            int32_t v = static_cast<int32_t>(val);
+            memcpy(ptr, &v, sizeof(v));
+        }
+    };
+
+    template <>
+    struct CodecValue<kCodecLong> {
+        static const size_t kWidth = sizeof(int64_t);
+        static int64_t load(const unsigned char* ptr) {
+            int64_t val;
+            memcpy(&val, ptr, sizeof(val));
+            return val;
+        }
+        static void store(unsigned char* ptr, int64_t val) { memcpy(ptr, &val, sizeof(val)); }
+    };
+
+    /*
+     * Columns kIdx... of a row whose values start at 'data', column kIdx
+     * being at constant offset kOffset. Every column peels one template
+     * argument, so the calls unroll into straight-line code.
+     */
+    template <size_t kIdx, size_t kOffset, CodecColumn... kCols>
+    struct CodecColumns {
+        static void parse(const unsigned char*, const unsigned char*, std::vector<Expr*>&, Arena*,
+                          std::vector<bool>*, Expr*) {}
+        static bool store(unsigned char*, unsigned char*, std::vector<Expr*>&) { return false; }
+        static void zoneAdd(const unsigned char*, const unsigned char*, ZoneMap&) {}
+    };
+
+    template <size_t kIdx, size_t kOffset, CodecColumn kCol, CodecColumn... kRest>
+    struct CodecColumns<kIdx, kOffset, kCol, kRest...> {
+        typedef CodecValue<kCol> Value;
+        typedef CodecColumns<kIdx + 1, kOffset + Value::kWidth, kRest...> Next;
+
+        static void parse(const unsigned char* is_null, const unsigned char* data,
+                          std::vector<Expr*>& values, Arena* arena, std::vector<bool>* cols,
+                          Expr* skipped) {
+            if (cols != nullptr && !(*cols)[kIdx]) {
+                values.push_back(skipped);
+            } else if (is_null[kIdx]) {
+                values.push_back((arena != nullptr) ? arena->makeNullLiteral()
+                                                    : Expr::makeNullLiteral());
+            } else {
+                int64_t val = Value::load(data + kOffset);
+                values.push_back((arena != nullptr) ? arena->makeLiteral(val)
+                                                    : Expr::makeLiteral(val));
+            }
+            Next::parse(is_null, data, values, arena, cols, skipped);
+        }
+
+        static bool store(unsigned char* is_null, unsigned char* data, std::vector<Expr*>& values) {
+            Expr* expr = values[kIdx];
+            if (expr->type == kExprLiteralInt) {
+                is_null[kIdx] = false;
+                Value::store(data + kOffset, expr->ival);
+            } else if (expr->type == kExprLiteralNull) {
+                is_null[kIdx] = true;
+            } else {
+                return true;
+            }
+            return Next::store(is_null, data, values);
+        }
+
+        static void zoneAdd(const unsigned char* is_null, const unsigned char* data,
+                            ZoneMap& zone) {
+            if (is_null[kIdx]) {
+                zone.addNull(kIdx);
+            } else {
+                zone.addInt(kIdx, Value::load(data + kOffset));
+            }
+            Next::zoneAdd(is_null, data, zone);
+        }
+    };
+
+    /* Whole rows: the NULL map has one byte per column, the values follow it. */
+    template <CodecColumn... kCols>
+    struct RowCodec {
+        static const size_t kColumns = sizeof...(kCols);
+        typedef CodecColumns<0, 0, kCols...> Columns;
+
+        static void parse(unsigned char* row, std::vector<Expr*>& values, Arena* arena,
+                          std::vector<bool>* cols, Expr* skipped) {
+            Columns::parse(row, row + kColumns, values, arena, cols, skipped);
+        }
+        static bool store(unsigned char* row, std::vector<Expr*>& values) {
+            return Columns::store(row, row + kColumns, values);
+        }
+        static void zoneAdd(unsigned char* row, ZoneMap& zone) {
+            Columns::zoneAdd(row, row + kColumns, zone);
+        }
+    };
+
+    /*
+     * Instantiate RowCodec for every sequence of up to kLeft more columns
+     * after kCols. The slot of a sequence is 1 followed by one bit per
+     * column, 0 for INT and 1 for LONG.
+     */
+    template <size_t kLeft, CodecColumn... kCols>
+    struct CodecTable {
+        static void fill(std::vector<TupleCodec>& table, size_t slot) {
+            CodecTable<0, kCols...>::fill(table, slot);
+            CodecTable<kLeft - 1, kCols..., kCodecInt>::fill(table, slot * 2);
+            CodecTable<kLeft - 1, kCols..., kCodecLong>::fill(table, slot * 2 + 1);
+        }
+    };
+
+    template <CodecColumn... kCols>
+    struct CodecTable<0, kCols...> {
+        static void fill(std::vector<TupleCodec>& table, size_t slot) {
+            table[slot].parse = &RowCodec<kCols...>::parse;
+            table[slot].store = &RowCodec<kCols...>::store;
+            table[slot].zoneAdd = &RowCodec<kCols...>::zoneAdd;
+        }
+    };
+
+    static std::vector<TupleCodec> BuildCodecTable() {
+        std::vector<TupleCodec> table(2 << TUPLE_CODEC_MAX_COLUMNS);
+        CodecTable<TUPLE_CODEC_MAX_COLUMNS>::fill(table, 1);
+        return table;
+    }
+
+    TupleCodec FindTupleCodec(std::vector<DataType>& types) {
+        static std::vector<TupleCodec> table = BuildCodecTable();
+        if (types.empty() || types.size() > TUPLE_CODEC_MAX_COLUMNS) {
+            return TupleCodec();
+        }
+
+        size_t slot = 1;
+        for (auto type : types) {
+            if (type == DataType::INT) {
+                slot = slot * 2;
+            } else if (type == DataType::LONG) {
+                slot = slot * 2 + 1;
+            } else {
+                return TupleCodec();
+            }
+        }
+        return table[slot];
+    }
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "arena.h"
+#include "zonemap.h"
+
+#include "sql/statements.h"
+
+#include <vector>
+
+using namespace hsql;
+
+namespace mydb {
+
+/* Tables of up to this many INT/LONG columns get a codec specialized for their layout. */
+#define TUPLE_CODEC_MAX_COLUMNS 4
+
+    /* 'row' is Tuple::data: the NULL map, then the column values. */
+    typedef void (*ParseRowFunc)(unsigned char* row, std::vector<Expr*>& values, Arena* arena,
+                                 std::vector<bool>* cols, Expr* skipped);
+    /* True if a value is neither an integer nor a NULL literal, the row is left unfinished. */
+    typedef bool (*StoreRowFunc)(unsigned char* row, std::vector<Expr*>& values);
+    typedef void (*ZoneRowFunc)(unsigned char* row, ZoneMap& zone);
+
+    /*
+     * Read and write paths of TableStore for one sequence of column types,
+     * instantiated from a template so the offsets are constants and there is
+     * no switch on the column type. Same results as the generic code.
+     */
+    struct TupleCodec {
+        TupleCodec() : parse(nullptr), store(nullptr), zoneAdd(nullptr) {}
+        ParseRowFunc parse;
+        StoreRowFunc store;
+        ZoneRowFunc zoneAdd;
+    };
+
+    /* The codec of a schema, with nullptr members if it has none. */
+    TupleCodec FindTupleCodec(std::vector<DataType>& types);
+
+}
@@ -158,10 +158,20 @@ const char* PlanTypeToString(PlanType type) {
             return "Sort";
         case kLimit:
             return "Limit";
+        case kJoin:
+            return "Join";
         case kTrx:
             return "Trx";
         case kShow:
             return "Show";
+        case kAnalyze:
+            return "Analyze";
+        case kMetrics:
+            return "Metrics";
+        case kTruncate:
+            return "Truncate";
+        case kDropPartition:
+            return "DropPartition";
         default:
             return "UNKNOWN";
     }
@@ -176,7 +186,7 @@ size_t ColumnTypeSize(ColumnType& type) {
     case DataType::CHAR:
       return type.length + 1;
     case DataType::VARCHAR:
-      return type.length + 1;
+      return sizeof(VarString);
     default:
       return -1;
   }
@@ -228,7 +238,6 @@ void PrintTuples(std::vector<ColumnDefinition*>& columns,
     for (size_t i = 0;i<columns.size();i++) {
         Expr *expr = tup[colIds[i]];
       std::cout.width(col_lens[i]);
-      i++;
       switch (expr->type) {
         case kExprLiteralString:
           std::cout << expr->name;
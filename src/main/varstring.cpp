@@ -0,0 +1,90 @@
+#include "varstring.h"
+#include "metrics.h"
+#include "profile.h"
+
+#include <cstdlib>
+#include <utility>
+
+namespace mydb {
+
+/* The smallest class still holds the free list link. */
+#define STRING_HEAP_MIN_CLASS_SHIFT 4
+
+    StringHeap::StringHeap()
+            : chunkSize_(STRING_HEAP_CHUNK_SIZE), cur_(nullptr), end_(nullptr) {
+        freeLists_.resize(SizeClass(STRING_HEAP_MAX_CLASS) + 1, nullptr);
+    }
+
+    StringHeap::~StringHeap() {
+        for (auto& chunk : chunks_) {
+            FreePages(chunk);
+        }
+    }
+
+    size_t StringHeap::SizeClass(size_t len) {
+        size_t cls = 0;
+        while ((static_cast<size_t>(1) << (cls + STRING_HEAP_MIN_CLASS_SHIFT)) < len) {
+            cls++;
+        }
+        return cls;
+    }
+
+    char* StringHeap::allocate(size_t len) {
+        CountAlloc(len);
+        if (len > STRING_HEAP_MAX_CLASS) {
+            return static_cast<char*>(malloc(len));
+        }
+
+        size_t cls = SizeClass(len);
+        char* str = freeLists_[cls];
+        if (str != nullptr) {
+            freeLists_[cls] = *reinterpret_cast<char**>(str);
+            return str;
+        }
+
+        size_t size = static_cast<size_t>(1) << (cls + STRING_HEAP_MIN_CLASS_SHIFT);
+        if (static_cast<size_t>(end_ - cur_) < size && newChunk()) {
+            return nullptr;
+        }
+        str = cur_;
+        cur_ += size;
+        return str;
+    }
+
+    void StringHeap::free(char* str, size_t len) {
+        if (len > STRING_HEAP_MAX_CLASS) {
+            ::free(str);
+            return;
+        }
+
+        size_t cls = SizeClass(len);
+        *reinterpret_cast<char**>(str) = freeLists_[cls];
+        freeLists_[cls] = str;
+    }
+
+    void StringHeap::swap(StringHeap& other) {
+        freeLists_.swap(other.freeLists_);
+        chunks_.swap(other.chunks_);
+        std::swap(chunkSize_, other.chunkSize_);
+        std::swap(cur_, other.cur_);
+        std::swap(end_, other.end_);
+    }
+
+    /* The tail of the previous chunk is dropped, it is smaller than the string asking for more. */
+    bool StringHeap::newChunk() {
+        PageRange chunk;
+        if (AllocPages(chunkSize_, &chunk)) {
+            return true;
+        }
+
+        chunks_.push_back(chunk);
+        cur_ = static_cast<char*>(chunk.addr);
+        end_ = cur_ + chunk.size;
+        CountMetric(kMetricStringHeapBytes, chunk.size);
+        if (chunkSize_ < HUGE_PAGE_SIZE) {
+            chunkSize_ *= 2;
+        }
+        return false;
+    }
+
+}
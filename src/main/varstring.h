@@ -0,0 +1,86 @@
+#pragma once
+
+#include "pages.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace mydb {
+
+/* Strings up to this many bytes are kept entirely inside the tuple. */
+#define VARSTRING_INLINE_SIZE 12
+#define VARSTRING_PREFIX_SIZE 4
+/* Heap size classes are powers of two from 16 bytes up to this, longer strings are malloc'ed. */
+#define STRING_HEAP_MAX_CLASS (64 * 1024)
+/* Size of the first string heap chunk, each following one is twice as large up to a huge page. */
+#define STRING_HEAP_CHUNK_SIZE (64 * 1024)
+
+    /*
+     * In-tuple part of a VARCHAR value, 16 bytes whatever the declared
+     * length. A short string lives in prefix and rest; a longer one keeps its
+     * first bytes in prefix and the whole string in the string heap of the
+     * table, so most comparisons are decided without following ptr.
+     */
+    struct VarString {
+        uint32_t len;
+        char prefix[VARSTRING_PREFIX_SIZE];
+        union {
+            char rest[VARSTRING_INLINE_SIZE - VARSTRING_PREFIX_SIZE];
+            char* ptr;
+        };
+
+        bool isInline() const { return len <= VARSTRING_INLINE_SIZE; }
+        /* Not NUL terminated, points into this struct for inline strings. */
+        const char* data() const { return isInline() ? prefix : ptr; }
+    };
+
+    static_assert(sizeof(VarString) == 16, "VarString must stay 16 bytes");
+
+    /* Tuple columns are not aligned, so the header is always copied in and out. */
+    inline void LoadVarString(const void* src, VarString* str) {
+        memcpy(str, src, sizeof(VarString));
+    }
+
+    inline void StoreVarString(const VarString& str, void* dst) {
+        memcpy(dst, &str, sizeof(VarString));
+    }
+
+    inline bool VarStringEquals(const VarString& str, const char* val, size_t len) {
+        if (str.len != len) {
+            return false;
+        }
+        size_t n = (len < VARSTRING_PREFIX_SIZE) ? len : VARSTRING_PREFIX_SIZE;
+        if (memcmp(str.prefix, val, n) != 0) {
+            return false;
+        }
+        return memcmp(str.data() + n, val + n, len - n) == 0;
+    }
+
+    /*
+     * Out-of-line storage of the long VARCHAR values of one table. Freed
+     * strings go to a free list per size class and are reused by later
+     * strings of the same class; chunks are only returned with the heap.
+     */
+    class StringHeap {
+    public:
+        StringHeap();
+        ~StringHeap();
+
+        char* allocate(size_t len);
+        void free(char* str, size_t len);
+        void swap(StringHeap& other);
+
+    private:
+        static size_t SizeClass(size_t len);
+        bool newChunk();
+
+        std::vector<char*> freeLists_;
+        std::vector<PageRange> chunks_;
+        size_t chunkSize_;
+        char* cur_;
+        char* end_;
+    };
+
+}
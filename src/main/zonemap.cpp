@@ -0,0 +1,102 @@
+#include "zonemap.h"
+#include "metadata.h"
+
+#include <cstring>
+
+namespace mydb {
+
+    ZoneMap::ZoneMap(std::vector<ColumnDefinition*>* columns)
+            : zones_(columns->size()), blooms_(columns->size(), nullptr) {
+        for (size_t i = 0; i < columns->size(); i++) {
+            DataType type = (*columns)[i]->type.data_type;
+            zones_[i].isString = (type == DataType::CHAR || type == DataType::VARCHAR);
+        }
+    }
+
+    ZoneMap::~ZoneMap() {
+        for (auto bloom : blooms_) {
+            delete bloom;
+        }
+    }
+
+    void ZoneMap::addInt(size_t idx, int64_t val) {
+        if (blooms_[idx] != nullptr) {
+            blooms_[idx]->add(CombineKeyHash(0, static_cast<uint64_t>(val)));
+        }
+
+        ColumnZone& zone = zones_[idx];
+        if (!zone.hasValue) {
+            zone.minInt = val;
+            zone.maxInt = val;
+            zone.hasValue = true;
+        } else if (val < zone.minInt) {
+            zone.minInt = val;
+        } else if (val > zone.maxInt) {
+            zone.maxInt = val;
+        }
+    }
+
+    void ZoneMap::addString(size_t idx, const char* val, size_t len) {
+        if (blooms_[idx] != nullptr) {
+            blooms_[idx]->add(CombineKeyHash(0, BKDRHash(val, len)));
+        }
+
+        ColumnZone& zone = zones_[idx];
+        if (!zone.hasValue) {
+            zone.minStr.assign(val, len);
+            zone.maxStr.assign(val, len);
+            zone.hasValue = true;
+        } else if (zone.minStr.compare(0, std::string::npos, val, len) > 0) {
+            zone.minStr.assign(val, len);
+        } else if (zone.maxStr.compare(0, std::string::npos, val, len) < 0) {
+            zone.maxStr.assign(val, len);
+        }
+    }
+
+    void ZoneMap::reset() {
+        for (auto& zone : zones_) {
+            zone.hasValue = false;
+            zone.nullCount = 0;
+        }
+        for (auto bloom : blooms_) {
+            if (bloom != nullptr) {
+                bloom->clear();
+            }
+        }
+    }
+
+    void ZoneMap::setBloom(size_t idx, size_t keys) {
+        delete blooms_[idx];
+        blooms_[idx] = (keys == 0) ? nullptr : new BloomFilter(keys);
+    }
+
+    /* A type mismatch or a NULL literal never compares equal, as in FilterOperator. */
+    bool ZoneMap::mayEqual(size_t idx, Expr* val) {
+        ColumnZone& zone = zones_[idx];
+        if (!zone.hasValue) {
+            return false;
+        }
+        if (zone.isString) {
+            return val->type == kExprLiteralString && zone.minStr.compare(val->name) <= 0 &&
+                   zone.maxStr.compare(val->name) >= 0;
+        }
+        return val->type == kExprLiteralInt && zone.minInt <= val->ival &&
+               val->ival <= zone.maxInt;
+    }
+
+    /* Hashed the way HashKeys hashes a single key. */
+    bool ZoneMap::bloomMayEqual(size_t idx, Expr* val) {
+        BloomFilter* bloom = blooms_[idx];
+        if (bloom == nullptr) {
+            return true;
+        }
+        if (val->type == kExprLiteralInt) {
+            return bloom->mayContain(CombineKeyHash(0, static_cast<uint64_t>(val->ival)));
+        }
+        if (val->type == kExprLiteralString) {
+            return bloom->mayContain(CombineKeyHash(0, BKDRHash(val->name, strlen(val->name))));
+        }
+        return false;
+    }
+
+}
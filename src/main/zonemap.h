@@ -0,0 +1,60 @@
+#pragma once
+
+#include "bloom.h"
+
+#include "sql/statements.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace hsql;
+
+namespace mydb {
+
+    /* Smallest and largest value of one column in a tuple group, and its NULL count. */
+    struct ColumnZone {
+        ColumnZone() : isString(false), hasValue(false), minInt(0), maxInt(0), nullCount(0) {}
+        bool isString;
+        bool hasValue;
+        int64_t minInt;
+        int64_t maxInt;
+        std::string minStr;
+        std::string maxStr;
+        uint64_t nullCount;
+    };
+
+    /*
+     * Zone map of a tuple group. Min/max only widen while the group has live
+     * tuples, so after updates and deletes they may be wider than the values
+     * left but never narrower; they start over once the group is empty. The
+     * same goes for the Bloom filters kept on some columns.
+     */
+    class ZoneMap {
+    public:
+        explicit ZoneMap(std::vector<ColumnDefinition*>* columns);
+        ~ZoneMap();
+
+        void addInt(size_t idx, int64_t val);
+        void addString(size_t idx, const char* val, size_t len);
+        void addNull(size_t idx) { zones_[idx].nullCount++; }
+        void removeNull(size_t idx) { zones_[idx].nullCount--; }
+        void reset();
+
+        /* False if no row of the group can have column 'idx' = 'val'. */
+        bool mayEqual(size_t idx, Expr* val);
+        /* Same as mayEqual, from the Bloom filter of the column. True if it has none. */
+        bool bloomMayEqual(size_t idx, Expr* val);
+        ColumnZone& zone(size_t idx) { return zones_[idx]; }
+
+        /* Give column 'idx' an empty Bloom filter sized for 'keys' values, or drop it for 0. */
+        void setBloom(size_t idx, size_t keys);
+        bool hasBloom(size_t idx) { return blooms_[idx] != nullptr; }
+
+    private:
+        std::vector<ColumnZone> zones_;
+        std::vector<BloomFilter*> blooms_;
+    };
+
+}